@@ -24,6 +24,7 @@
    var hasRuntime = false;
    var seekPos = 0;
    var avt = 0;
+   var avtTemplate = 0;
    var avtState = 0;
    var inputbox;
    var messagesDiv;
@@ -446,7 +447,8 @@
          break;
 
        var msgType = getValue(msg, 'i32');
-       var text = UTF8ToString(msg + 4);
+       var msgLength = getValue(msg + 4, 'i32');
+       var text = UTF8ToString(msg + 8, msgLength);
 
        if (msgType == 0 || lastDiv == null) {
          lastDiv = addMessage("note", text);
@@ -564,7 +566,13 @@
      inputbox.contentEditable = true;
      gameIsOver = false;
 
-     avtState = _pcx_avt_state_new(avt);
+     /* Give each game a different random state from the first turn */
+     var randomState = _malloc(16);
+     var randomValues = new Uint8Array(16);
+     crypto.getRandomValues(randomValues);
+     writeArrayToMemory(randomValues, randomState);
+     avtState = _pcx_avt_state_new_from_template(avtTemplate, randomState);
+     _free(randomState);
 
      addTitleMessage();
 
@@ -601,10 +609,13 @@
        _pcx_avt_state_free(avtState);
        avtState = 0;
      }
+     if (avtTemplate != 0)
+       _pcx_avt_state_template_free(avtTemplate);
      if (avt != 0)
        _pcx_avt_free(avt);
 
      avt = newAvt;
+     avtTemplate = _pcx_avt_state_template_new(avt);
 
      startGame();
 
@@ -0,0 +1,114 @@
+#!/usr/bin/python3
+
+# Generates src/pcx-avt-grammar-table.h from the list of grammar words
+# in src/pcx-avt-grammar.h. The table is a perfect hash so each word
+# can be found by hashing it once without any collisions.
+
+import sys
+import os
+import re
+
+MAKSIMUMAJ_SEMOJ = 100000
+
+dosierujo = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                         "..",
+                         "src")
+
+
+def legu_vortojn():
+    vortoj = []
+
+    with open(os.path.join(dosierujo, "pcx-avt-grammar.h"),
+              encoding="utf-8") as f:
+        for linio in f:
+            md = re.match(r'\s*PCX_AVT_GRAMMAR_WORD_(\w+), /\* (\S+) \*/',
+                          linio)
+            if md:
+                vortoj.append((md.group(1), md.group(2).encode("utf-8")))
+
+    return vortoj
+
+
+def haketu(semo, vorto):
+    # Must be the same as hash_word in src/pcx-avt-grammar.c
+    h = semo
+
+    for bajto in vorto:
+        h ^= bajto
+        h = (h * 16777619) & 0xffffffff
+
+    return h
+
+
+def trovu_semon(vortoj, bitoj):
+    for semo in range(2166136261, 2166136261 + MAKSIMUMAJ_SEMOJ):
+        lokoj = set()
+
+        for nomo, vorto in vortoj:
+            loko = haketu(semo, vorto) >> (32 - bitoj)
+            if loko in lokoj:
+                break
+            lokoj.add(loko)
+        else:
+            return semo
+
+    return None
+
+
+def ĉenigu(vorto):
+    return '"' + vorto.decode("utf-8") + '"'
+
+
+vortoj = legu_vortojn()
+
+if len(set(vorto for nomo, vorto in vortoj)) != len(vortoj):
+    print("Iu vorto estas en la listo pli ol unufoje", file=sys.stderr)
+    sys.exit(1)
+
+bitoj = 1
+
+while (1 << bitoj) < len(vortoj) * 2:
+    bitoj += 1
+
+while True:
+    semo = trovu_semon(vortoj, bitoj)
+    if semo is not None:
+        break
+    bitoj += 1
+
+with open(os.path.join(dosierujo, "pcx-avt-grammar-table.h"),
+          "w",
+          encoding="utf-8") as f:
+    print("/* Generated by skriptoj/generu-gramatikon.py from "
+          "pcx-avt-grammar.h.\n"
+          " * Don’t edit it directly.\n"
+          " */\n"
+          "\n"
+          "#define GRAMMAR_HASH_SEED UINT32_C({})\n"
+          "#define GRAMMAR_HASH_BITS {}\n"
+          "\n"
+          "static const struct grammar_word\n"
+          "grammar_words[] = {{".format(semo, bitoj),
+          file=f)
+
+    for nomo, vorto in vortoj:
+        print("        [PCX_AVT_GRAMMAR_WORD_{}] = {{ {}, {} }},".format(
+            nomo,
+            ĉenigu(vorto),
+            len(vorto)),
+              file=f)
+
+    print("};\n"
+          "\n"
+          "static const uint8_t\n"
+          "grammar_hash_table[1 << GRAMMAR_HASH_BITS] = {",
+          file=f)
+
+    lokoj = sorted((haketu(semo, vorto) >> (32 - bitoj), nomo)
+                   for nomo, vorto in vortoj)
+
+    for loko, nomo in lokoj:
+        print("        [{}] = PCX_AVT_GRAMMAR_WORD_{},".format(loko, nomo),
+              file=f)
+
+    print("};", file=f)
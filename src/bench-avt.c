@@ -0,0 +1,297 @@
+/*
+ * Aventuro - A text aventure system in Esperanto
+ * Copyright (C) 2021  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Replays the commands from a test script many times and reports how
+ * fast the interpreter got through them. The expected messages in the
+ * script are ignored.
+ */
+
+#include "config.h"
+
+#include "pcx-avt-load-file.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "pcx-avt-state.h"
+#include "pcx-avt-command.h"
+#include "pcx-avt-hat.h"
+#include "pcx-buffer.h"
+#include "pcx-util.h"
+
+#define DEFAULT_N_ITERATIONS 2000
+
+enum step_type {
+        STEP_COMMAND,
+        STEP_RESTART,
+        STEP_RANDOM,
+};
+
+struct step {
+        enum step_type type;
+        int random_number;
+        /* Number of rules that the command will check */
+        int n_rules;
+        char *command;
+};
+
+struct data {
+        const struct pcx_avt *avt;
+        struct pcx_avt_state_template *template;
+        struct pcx_buffer steps;
+        int random_number;
+};
+
+static int
+random_cb(void *user_data)
+{
+        struct data *data = user_data;
+
+        return data->random_number;
+}
+
+static struct pcx_avt_state *
+create_avt_state(struct data *data)
+{
+        struct pcx_avt_state *state =
+                pcx_avt_state_new_from_template(data->template,
+                                                NULL /* rs */);
+
+        pcx_avt_state_set_random_cb(state, random_cb, data);
+
+        return state;
+}
+
+static int
+count_verb_rules(const struct pcx_avt *avt,
+                 const char *command_text)
+{
+        const struct pcx_avt_verb *est =
+                avt->special_verbs[PCX_AVT_SPECIAL_VERB_EST];
+        /* The “est” rules are checked after every command */
+        int n_rules = est ? est->n_rules : 0;
+        struct pcx_avt_command command;
+        char *normalized = pcx_strdup(command_text);
+
+        pcx_avt_hat_normalize_string(normalized);
+
+        if (pcx_avt_command_parse(normalized, &command, NULL) &&
+            (command.has & PCX_AVT_COMMAND_HAS_VERB)) {
+                const struct pcx_avt_verb *verb =
+                        pcx_avt_find_verb(avt,
+                                          command.verb.start,
+                                          command.verb.length);
+
+                if (verb)
+                        n_rules += verb->n_rules;
+        }
+
+        pcx_free(normalized);
+
+        return n_rules;
+}
+
+static void
+add_step(struct data *data,
+         const struct step *step)
+{
+        pcx_buffer_append(&data->steps, step, sizeof *step);
+}
+
+static bool
+load_script(struct data *data,
+            const char *filename)
+{
+        FILE *input = fopen(filename, "rt");
+
+        if (input == NULL) {
+                fprintf(stderr, "%s: %s\n", filename, strerror(errno));
+                return false;
+        }
+
+        char line[512];
+
+        while (fgets(line, sizeof line, input)) {
+                size_t len = strlen(line);
+
+                while (len > 0 && (line[len - 1] == '\n' ||
+                                   line[len - 1] == ' '))
+                        len--;
+
+                line[len] = '\0';
+
+                const char *p = line;
+
+                while (*p == ' ')
+                        p++;
+
+                if (*p == '>') {
+                        p++;
+                        while (*p == ' ')
+                                p++;
+
+                        struct step step = {
+                                .type = STEP_COMMAND,
+                                .n_rules = count_verb_rules(data->avt, p),
+                                .command = pcx_strdup(p),
+                        };
+                        add_step(data, &step);
+                } else if (!strcmp(p, "@restart")) {
+                        struct step step = { .type = STEP_RESTART };
+                        add_step(data, &step);
+                } else if (!strncmp(p, "@random ", 8)) {
+                        struct step step = {
+                                .type = STEP_RANDOM,
+                                .random_number = strtol(p + 8, NULL, 10),
+                        };
+                        add_step(data, &step);
+                }
+        }
+
+        fclose(input);
+
+        return true;
+}
+
+static void
+free_steps(struct data *data)
+{
+        const struct step *steps = (const struct step *) data->steps.data;
+        size_t n_steps = data->steps.length / sizeof (struct step);
+
+        for (size_t i = 0; i < n_steps; i++)
+                pcx_free(steps[i].command);
+
+        pcx_buffer_destroy(&data->steps);
+}
+
+static void
+drain_messages(struct pcx_avt_state *state)
+{
+        while (pcx_avt_state_get_next_message(state))
+                ;
+}
+
+static double
+get_time(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+
+        return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+run_benchmark(struct data *data,
+              int n_iterations)
+{
+        const struct step *steps = (const struct step *) data->steps.data;
+        size_t n_steps = data->steps.length / sizeof (struct step);
+        long n_commands = 0, n_rules = 0;
+
+        double start_time = get_time();
+
+        for (int iteration = 0; iteration < n_iterations; iteration++) {
+                struct pcx_avt_state *state = create_avt_state(data);
+
+                data->random_number = 0;
+
+                for (size_t i = 0; i < n_steps; i++) {
+                        switch (steps[i].type) {
+                        case STEP_COMMAND:
+                                pcx_avt_state_run_command(state,
+                                                          steps[i].command);
+                                n_commands++;
+                                n_rules += steps[i].n_rules;
+                                break;
+                        case STEP_RESTART:
+                                pcx_avt_state_free(state);
+                                state = create_avt_state(data);
+                                break;
+                        case STEP_RANDOM:
+                                data->random_number = steps[i].random_number;
+                                break;
+                        }
+
+                        drain_messages(state);
+                }
+
+                pcx_avt_state_free(state);
+        }
+
+        double elapsed = get_time() - start_time;
+
+        printf("%li commands in %.3f seconds\n"
+               "%.0f commands per second\n"
+               "%.0f rules checked per second\n",
+               n_commands,
+               elapsed,
+               n_commands / elapsed,
+               n_rules / elapsed);
+}
+
+int
+main(int argc, char **argv)
+{
+        if (argc != 3 && argc != 4) {
+                fprintf(stderr,
+                        "usage: bench-avt <avt-file> <test-script> "
+                        "[iterations]\n");
+                return EXIT_FAILURE;
+        }
+
+        const char *avt_filename = argv[1];
+        const char *test_script = argv[2];
+        int n_iterations = (argc > 3 ?
+                            strtol(argv[3], NULL, 10) :
+                            DEFAULT_N_ITERATIONS);
+        struct pcx_error *error = NULL;
+        int retval = EXIT_SUCCESS;
+
+        struct pcx_avt *avt = pcx_avt_load_file(avt_filename, &error);
+
+        if (avt == NULL) {
+                fprintf(stderr,
+                        "%s: %s\n",
+                        avt_filename,
+                        error->message);
+                pcx_error_free(error);
+                return EXIT_FAILURE;
+        }
+
+        struct data data = {
+                .avt = avt,
+                .template = pcx_avt_state_template_new(avt),
+                .steps = PCX_BUFFER_STATIC_INIT,
+        };
+
+        if (load_script(&data, test_script))
+                run_benchmark(&data, n_iterations);
+        else
+                retval = EXIT_FAILURE;
+
+        free_steps(&data);
+        pcx_avt_state_template_free(data.template);
+        pcx_avt_free(avt);
+
+        return retval;
+}
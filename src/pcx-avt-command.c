@@ -22,9 +22,8 @@
 
 #include <string.h>
 
+#include "pcx-avt-grammar.h"
 #include "pcx-utf8.h"
-#include "pcx-util.h"
-#include "pcx-avt-hat.h"
 
 struct parse_pos {
         const char *p;
@@ -39,97 +38,72 @@ struct noun_part {
         struct pcx_avt_command_word word;
 };
 
-struct pronoun_name {
-        const char *word;
-        struct pcx_avt_command_pronoun value;
-};
-
-static const struct pronoun_name
-pronoun_names[] = {
-        {
-                "mi",
-                {
-                        .person = 1,
-                        PCX_AVT_COMMAND_GENDER_MAN |
-                        PCX_AVT_COMMAND_GENDER_WOMAN |
-                        PCX_AVT_COMMAND_GENDER_THING,
-                        .plural = false,
-                },
+#define FIRST_PRONOUN PCX_AVT_GRAMMAR_WORD_MI
+#define LAST_PRONOUN PCX_AVT_GRAMMAR_WORD_ILI
+
+/* Indexed by the grammar word minus FIRST_PRONOUN */
+static const struct pcx_avt_command_pronoun
+pronouns[] = {
+        [PCX_AVT_GRAMMAR_WORD_MI - FIRST_PRONOUN] = {
+                .person = 1,
+                PCX_AVT_COMMAND_GENDER_MAN |
+                PCX_AVT_COMMAND_GENDER_WOMAN |
+                PCX_AVT_COMMAND_GENDER_THING,
+                .plural = false,
         },
-        {
-                "ni",
-                {
-                        .person = 1,
-                        PCX_AVT_COMMAND_GENDER_MAN |
-                        PCX_AVT_COMMAND_GENDER_WOMAN |
-                        PCX_AVT_COMMAND_GENDER_THING,
-                        .plural = true,
-                },
+        [PCX_AVT_GRAMMAR_WORD_NI - FIRST_PRONOUN] = {
+                .person = 1,
+                PCX_AVT_COMMAND_GENDER_MAN |
+                PCX_AVT_COMMAND_GENDER_WOMAN |
+                PCX_AVT_COMMAND_GENDER_THING,
+                .plural = true,
         },
-        {
-                "vi",
-                {
-                        .person = 2,
-                        PCX_AVT_COMMAND_GENDER_MAN |
-                        PCX_AVT_COMMAND_GENDER_WOMAN |
-                        PCX_AVT_COMMAND_GENDER_THING,
-                        .plural = false,
-                },
+        [PCX_AVT_GRAMMAR_WORD_VI - FIRST_PRONOUN] = {
+                .person = 2,
+                PCX_AVT_COMMAND_GENDER_MAN |
+                PCX_AVT_COMMAND_GENDER_WOMAN |
+                PCX_AVT_COMMAND_GENDER_THING,
+                .plural = false,
         },
-        {
-                "li",
-                {
-                        .person = 3,
-                        PCX_AVT_COMMAND_GENDER_MAN,
-                        .plural = false,
-                },
+        [PCX_AVT_GRAMMAR_WORD_LI - FIRST_PRONOUN] = {
+                .person = 3,
+                PCX_AVT_COMMAND_GENDER_MAN,
+                .plural = false,
         },
-        {
-                "ŝi",
-                {
-                        .person = 3,
-                        PCX_AVT_COMMAND_GENDER_WOMAN,
-                        .plural = false,
-                },
+        [PCX_AVT_GRAMMAR_WORD_SXI - FIRST_PRONOUN] = {
+                .person = 3,
+                PCX_AVT_COMMAND_GENDER_WOMAN,
+                .plural = false,
         },
-        {
-                "ĝi",
-                {
-                        .person = 3,
-                        PCX_AVT_COMMAND_GENDER_THING,
-                        .plural = false,
-                },
+        [PCX_AVT_GRAMMAR_WORD_GXI - FIRST_PRONOUN] = {
+                .person = 3,
+                PCX_AVT_COMMAND_GENDER_THING,
+                .plural = false,
         },
-        {
-                "ri",
-                {
-                        .person = 3,
-                        PCX_AVT_COMMAND_GENDER_MAN |
-                        PCX_AVT_COMMAND_GENDER_WOMAN,
-                        .plural = false,
-                },
+        [PCX_AVT_GRAMMAR_WORD_RI - FIRST_PRONOUN] = {
+                .person = 3,
+                PCX_AVT_COMMAND_GENDER_MAN |
+                PCX_AVT_COMMAND_GENDER_WOMAN,
+                .plural = false,
         },
-        {
-                "ili",
-                {
-                        .person = 3,
-                        PCX_AVT_COMMAND_GENDER_MAN |
-                        PCX_AVT_COMMAND_GENDER_WOMAN |
-                        PCX_AVT_COMMAND_GENDER_THING,
-                        .plural = true,
-                },
+        [PCX_AVT_GRAMMAR_WORD_ILI - FIRST_PRONOUN] = {
+                .person = 3,
+                PCX_AVT_COMMAND_GENDER_MAN |
+                PCX_AVT_COMMAND_GENDER_WOMAN |
+                PCX_AVT_COMMAND_GENDER_THING,
+                .plural = true,
         },
 };
 
 static bool
 is_alphabetic(uint32_t ch)
 {
+        /* The text is already normalized so there are no capital
+         * letters.
+         */
         if (ch >= 'a' && ch <= 'z')
                 return true;
 
-        if (ch >= 'A' && ch <= 'Z')
-                return true;
-
         switch (ch) {
         case 0x0125: /* ĥ */
         case 0x015d: /* ŝ */
@@ -137,41 +111,16 @@ is_alphabetic(uint32_t ch)
         case 0x0109: /* ĉ */
         case 0x0135: /* ĵ */
         case 0x016d: /* ŭ */
-        case 0x0124: /* Ĥ */
-        case 0x015c: /* Ŝ */
-        case 0x011c: /* Ĝ */
-        case 0x0108: /* Ĉ */
-        case 0x0134: /* Ĵ */
-        case 0x016c: /* Ŭ */
                 return true;
         }
 
         return false;
 }
 
-static bool
-is_word(const char *word,
-        size_t length,
-        const char *test)
+static enum pcx_avt_grammar_word
+get_grammar_word(const struct pcx_avt_command_word *word)
 {
-        struct pcx_avt_hat_iter iter;
-
-        pcx_avt_hat_iter_init(&iter, word, length);
-
-        while (!pcx_avt_hat_iter_finished(&iter)) {
-                if (*test == '\0')
-                        return false;
-
-                uint32_t ch = pcx_avt_hat_iter_next(&iter);
-
-                if (pcx_avt_hat_to_lower(pcx_utf8_get_char(test)) !=
-                    pcx_avt_hat_to_lower(ch))
-                        return false;
-
-                test = pcx_utf8_next(test);
-        }
-
-        return *test == '\0';
+        return pcx_avt_grammar_find_word(word->start, word->length);
 }
 
 static bool
@@ -184,6 +133,7 @@ get_next_word(struct parse_pos *pos,
                 p++;
 
         word->start = p;
+        word->id = PCX_AVT_NO_WORD;
 
         while (*p) {
                 uint32_t ch = pcx_utf8_get_char(p);
@@ -212,9 +162,14 @@ parse_noun_part(struct parse_pos *pos_in_out,
         if (!get_next_word(&pos, &part->word))
                 return false;
 
+        /* “Kaj” separates commands so it can’t be part of a noun */
+        if (get_grammar_word(&part->word) == PCX_AVT_GRAMMAR_WORD_KAJ)
+                return false;
+
         const char *word = part->word.start;
+        enum pcx_avt_grammar_word grammar_word;
 
-        if (pcx_avt_hat_to_lower(word[part->word.length - 1]) == 'n') {
+        if (word[part->word.length - 1] == 'n') {
                 part->accusative = true;
                 part->word.length--;
                 if (part->word.length < 1)
@@ -223,7 +178,7 @@ parse_noun_part(struct parse_pos *pos_in_out,
                 part->accusative = false;
         }
 
-        if (pcx_avt_hat_to_lower(word[part->word.length - 1]) == 'j') {
+        if (word[part->word.length - 1] == 'j') {
                 part->plural = true;
                 part->word.length--;
                 if (part->word.length < 1)
@@ -235,10 +190,10 @@ parse_noun_part(struct parse_pos *pos_in_out,
         if (part->word.length < 2)
                 return false;
 
-        switch (pcx_avt_hat_to_lower(word[part->word.length - 1])) {
+        switch (word[part->word.length - 1]) {
         case 'a':
                 /* “La” is not an adjective */
-                if (is_word(word, part->word.length, "la"))
+                if (get_grammar_word(&part->word) == PCX_AVT_GRAMMAR_WORD_LA)
                         return false;
                 part->adjective = true;
                 part->is_pronoun = false;
@@ -253,18 +208,13 @@ parse_noun_part(struct parse_pos *pos_in_out,
                 if (part->plural)
                         return false;
 
-                for (int i = 0; i < PCX_N_ELEMENTS(pronoun_names); i++) {
-                        if (is_word(part->word.start,
-                                    part->word.length,
-                                    pronoun_names[i].word)) {
-                                part->pronoun = pronoun_names[i].value;
-                                goto found;
-                        }
-                }
+                grammar_word = get_grammar_word(&part->word);
 
-                return false;
+                if (grammar_word < FIRST_PRONOUN ||
+                    grammar_word > LAST_PRONOUN)
+                        return false;
 
-        found:
+                part->pronoun = pronouns[grammar_word - FIRST_PRONOUN];
                 part->adjective = false;
                 part->is_pronoun = true;
                 part->plural = part->pronoun.plural;
@@ -286,7 +236,7 @@ parse_noun(struct parse_pos *pos_in_out,
         if (!get_next_word(&pos, &word))
                 return false;
 
-        if (is_word(word.start, word.length, "la")) {
+        if (get_grammar_word(&word) == PCX_AVT_GRAMMAR_WORD_LA) {
                 noun->article = true;
         } else {
                 noun->article = false;
@@ -339,20 +289,21 @@ parse_noun(struct parse_pos *pos_in_out,
                         return false;
 
                 /* Treat “mia” the same as the article */
-                if (is_word(adjective->word.start,
-                            adjective->word.length,
-                            "mi")) {
+                if (get_grammar_word(&adjective->word) ==
+                    PCX_AVT_GRAMMAR_WORD_MI) {
                         if (noun->article)
                                 return false;
                         noun->article = true;
                         noun->adjective.start = NULL;
                         noun->adjective.length = 0;
+                        noun->adjective.id = PCX_AVT_NO_WORD;
                 } else {
                         noun->adjective = adjective->word;
                 }
         } else {
                 noun->adjective.start = NULL;
                 noun->adjective.length = 0;
+                noun->adjective.id = PCX_AVT_NO_WORD;
         }
 
         *pos_in_out = pos;
@@ -373,7 +324,7 @@ parse_verb(struct parse_pos *pos_in_out,
         if (word.length < 2)
                 return false;
 
-        switch (pcx_avt_hat_to_lower(word.start[word.length - 1])) {
+        switch (word.start[word.length - 1]) {
         case 'i':
         case 'u':
                 word.length--;
@@ -381,7 +332,7 @@ parse_verb(struct parse_pos *pos_in_out,
         case 's':
                 if (word.length < 3)
                         return false;
-                switch (pcx_avt_hat_to_lower(word.start[word.length - 2])) {
+                switch (word.start[word.length - 2]) {
                 case 'o':
                 case 'a':
                         break;
@@ -410,7 +361,7 @@ parse_tool(struct parse_pos *pos_in_out,
         if (!get_next_word(&pos, &noun.name))
                 return false;
 
-        if (!is_word(noun.name.start, noun.name.length, "per"))
+        if (get_grammar_word(&noun.name) != PCX_AVT_GRAMMAR_WORD_PER)
                 return false;
 
         if (!parse_noun(&pos, &noun))
@@ -437,11 +388,12 @@ parse_direction(struct parse_pos *pos_in_out,
 
         /* Accept directions like “maren” for “al la maro” */
         if (word.length > 2 &&
-            is_word(word.start + word.length - 2, 2, "en")) {
+            !memcmp(word.start + word.length - 2, "en", 2)) {
                 *pos_in_out = pos;
                 noun->name = word;
                 noun->name.length -= 2;
                 noun->adjective.start = NULL;
+                noun->adjective.id = PCX_AVT_NO_WORD;
                 noun->plural = false;
                 noun->article = false;
                 noun->accusative = false;
@@ -449,7 +401,7 @@ parse_direction(struct parse_pos *pos_in_out,
                 return true;
         }
 
-        if (!is_word(word.start, word.length, "al"))
+        if (get_grammar_word(&word) != PCX_AVT_GRAMMAR_WORD_AL)
                 return false;
 
         if (!parse_noun(&pos, noun) ||
@@ -471,7 +423,7 @@ parse_in(struct parse_pos *pos_in_out,
         if (!get_next_word(&pos, &noun.name))
                 return false;
 
-        if (!is_word(noun.name.start, noun.name.length, "en"))
+        if (get_grammar_word(&noun.name) != PCX_AVT_GRAMMAR_WORD_EN)
                 return false;
 
         if (!parse_noun(&pos, &noun))
@@ -487,73 +439,128 @@ parse_in(struct parse_pos *pos_in_out,
         return true;
 }
 
-static const char *
-handle_shortcut(const char *text)
+static bool
+skip_kaj(struct parse_pos *pos_in_out)
 {
-        while (*text == ' ')
-                text++;
-
-        int len = strlen(text);
-
-        while (len > 0 && text[len - 1] == ' ')
-                len--;
-
-        static const struct {
-                const char *in;
-                const char *out;
-        } shortcuts[] = {
-                { "n", "mi iras norden" },
-                { "s", "mi iras suden" },
-                { "o", "mi iras orienten" },
-                { "okc", "mi iras okcidenten" },
-                { "e", "mi iras orienten" },
-                { "u", "mi iras okcidenten" },
-                { "ĉ", "mi ĉesas" },
-                { "h", "helpu min" },
-                { "r", "rigardu" },
-                { "v", "mi vidas" },
-        };
-
-        for (int i = 0; i < PCX_N_ELEMENTS(shortcuts); i++) {
-                if (is_word(text, len, shortcuts[i].in))
-                        return shortcuts[i].out;
-        }
+        struct parse_pos pos = *pos_in_out;
+        struct pcx_avt_command_word word;
+
+        if (!get_next_word(&pos, &word) ||
+            get_grammar_word(&word) != PCX_AVT_GRAMMAR_WORD_KAJ)
+                return false;
+
+        *pos_in_out = pos;
 
-        return text;
+        return true;
 }
 
-static bool
-is_end(const char *p)
+enum clause_end {
+        CLAUSE_END_NONE,
+        CLAUSE_END_TEXT,
+        CLAUSE_END_SEPARATOR,
+};
+
+static enum clause_end
+end_clause(struct parse_pos *pos_in_out)
 {
-        /* Skip any punctuation */
-        switch (*p) {
+        struct parse_pos pos = *pos_in_out;
+
+        while (*pos.p == ' ')
+                pos.p++;
+
+        switch (*pos.p) {
+        case '\0':
+                *pos_in_out = pos;
+                return CLAUSE_END_TEXT;
         case '.':
         case '?':
         case '!':
-                p++;
+        case ',':
+        case ';':
+                pos.p++;
+                /* Allow “, kaj” */
+                skip_kaj(&pos);
+                break;
+        default:
+                if (!skip_kaj(&pos))
+                        return CLAUSE_END_NONE;
+                break;
         }
 
-        while (*p == ' ')
-                p++;
+        while (*pos.p == ' ')
+                pos.p++;
 
-        return *p == '\0';
+        *pos_in_out = pos;
+
+        return CLAUSE_END_SEPARATOR;
 }
 
-bool
-pcx_avt_command_parse(const char *text,
-                      struct pcx_avt_command *command)
+static const char *
+get_shortcut(struct parse_pos *pos_in_out,
+             enum clause_end *end)
 {
-        text = handle_shortcut(text);
+        struct parse_pos pos = *pos_in_out;
+        struct pcx_avt_command_word word;
+        const char *expansion;
 
-        struct parse_pos pos = { .p = text };
+        if (!get_next_word(&pos, &word))
+                return NULL;
+
+        switch (get_grammar_word(&word)) {
+        case PCX_AVT_GRAMMAR_WORD_N:
+                expansion = "mi iras norden";
+                break;
+        case PCX_AVT_GRAMMAR_WORD_S:
+                expansion = "mi iras suden";
+                break;
+        case PCX_AVT_GRAMMAR_WORD_O:
+        case PCX_AVT_GRAMMAR_WORD_E:
+                expansion = "mi iras orienten";
+                break;
+        case PCX_AVT_GRAMMAR_WORD_OKC:
+        case PCX_AVT_GRAMMAR_WORD_U:
+                expansion = "mi iras okcidenten";
+                break;
+        case PCX_AVT_GRAMMAR_WORD_CX:
+                expansion = "mi ĉesas";
+                break;
+        case PCX_AVT_GRAMMAR_WORD_H:
+                expansion = "helpu min";
+                break;
+        case PCX_AVT_GRAMMAR_WORD_R:
+                expansion = "rigardu";
+                break;
+        case PCX_AVT_GRAMMAR_WORD_V:
+                expansion = "mi vidas";
+                break;
+        default:
+                return NULL;
+        }
+
+        /* The shortcut must be the whole clause */
+        *end = end_clause(&pos);
+
+        if (*end == CLAUSE_END_NONE)
+                return NULL;
+
+        *pos_in_out = pos;
+
+        return expansion;
+}
+
+static bool
+parse_clause(struct parse_pos *pos_in_out,
+             struct pcx_avt_command *command,
+             enum clause_end *end)
+{
+        struct parse_pos pos = *pos_in_out;
 
         memset(command, 0, sizeof *command);
 
         while (true) {
-                while (*pos.p == ' ')
-                        pos.p++;
+                *end = end_clause(&pos);
 
-                if (is_end(pos.p))
+                if (*end != CLAUSE_END_NONE)
                         break;
 
                 struct pcx_avt_command_noun noun;
@@ -606,12 +613,44 @@ pcx_avt_command_parse(const char *text,
                 return false;
         }
 
+        *pos_in_out = pos;
+
         return true;
 }
 
 bool
-pcx_avt_command_word_equal(const struct pcx_avt_command_word *word1,
-                           const char *word2)
+pcx_avt_command_parse(const char *text,
+                      struct pcx_avt_command *command,
+                      const char **next)
 {
-        return is_word(word1->start, word1->length, word2);
+        struct parse_pos pos = { .p = text };
+        enum clause_end end;
+        const char *shortcut = get_shortcut(&pos, &end);
+
+        if (shortcut) {
+                struct parse_pos shortcut_pos = { .p = shortcut };
+                enum clause_end shortcut_end;
+
+                if (!parse_clause(&shortcut_pos, command, &shortcut_end))
+                        return false;
+        } else if (!parse_clause(&pos, command, &end)) {
+                return false;
+        }
+
+        /* An empty clause is only allowed if it is the whole text */
+        if (end == CLAUSE_END_SEPARATOR && command->has == 0)
+                return false;
+
+        if (*pos.p == '\0') {
+                if (next)
+                        *next = NULL;
+                return true;
+        }
+
+        if (next == NULL)
+                return false;
+
+        *next = pos.p;
+
+        return true;
 }
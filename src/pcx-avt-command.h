@@ -22,6 +22,7 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "pcx-avt.h"
 
@@ -38,6 +39,11 @@ enum pcx_avt_command_has {
 struct pcx_avt_command_word {
         const char *start;
         size_t length;
+        /* The number of the word in the vocabulary of the game. The
+         * parser sets this to PCX_AVT_NO_WORD and it can be filled in
+         * afterwards with pcx_avt_find_word.
+         */
+        uint32_t id;
 };
 
 enum pcx_avt_command_gender {
@@ -77,12 +83,32 @@ struct pcx_avt_command {
         struct pcx_avt_command_word verb;
 };
 
+/* Parses the first command in the text. The text can contain several
+ * commands separated by punctuation or by “kaj”. If next isn’t NULL
+ * it is set to the start of the following command, or to NULL if this
+ * was the last one, so that the rest can be parsed by calling the
+ * function again. If next is NULL then the text must contain only one
+ * command.
+ *
+ * The text must already have been converted to the canonical form
+ * with pcx_avt_hat_normalize so that the words don’t need to be
+ * decoded every time they are compared. The words of the command
+ * point into the text.
+ */
 bool
 pcx_avt_command_parse(const char *text,
-                      struct pcx_avt_command *command);
+                      struct pcx_avt_command *command,
+                      const char **next);
 
-bool
+/* Compares a word from the command with a string in the canonical
+ * form.
+ */
+static inline bool
 pcx_avt_command_word_equal(const struct pcx_avt_command_word *word1,
-                           const char *word2);
+                           const char *word2)
+{
+        return (strlen(word2) == word1->length &&
+                !memcmp(word1->start, word2, word1->length));
+}
 
 #endif /* PCX_AVT_COMMAND */
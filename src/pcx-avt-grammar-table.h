@@ -0,0 +1,136 @@
+/* Generated by skriptoj/generu-gramatikon.py from pcx-avt-grammar.h.
+ * Don’t edit it directly.
+ */
+
+#define GRAMMAR_HASH_SEED UINT32_C(2166163923)
+#define GRAMMAR_HASH_BITS 8
+
+static const struct grammar_word
+grammar_words[] = {
+        [PCX_AVT_GRAMMAR_WORD_LA] = { "la", 2 },
+        [PCX_AVT_GRAMMAR_WORD_AL] = { "al", 2 },
+        [PCX_AVT_GRAMMAR_WORD_EN] = { "en", 2 },
+        [PCX_AVT_GRAMMAR_WORD_PER] = { "per", 3 },
+        [PCX_AVT_GRAMMAR_WORD_KAJ] = { "kaj", 3 },
+        [PCX_AVT_GRAMMAR_WORD_MI] = { "mi", 2 },
+        [PCX_AVT_GRAMMAR_WORD_NI] = { "ni", 2 },
+        [PCX_AVT_GRAMMAR_WORD_VI] = { "vi", 2 },
+        [PCX_AVT_GRAMMAR_WORD_LI] = { "li", 2 },
+        [PCX_AVT_GRAMMAR_WORD_SXI] = { "ŝi", 3 },
+        [PCX_AVT_GRAMMAR_WORD_GXI] = { "ĝi", 3 },
+        [PCX_AVT_GRAMMAR_WORD_RI] = { "ri", 2 },
+        [PCX_AVT_GRAMMAR_WORD_ILI] = { "ili", 3 },
+        [PCX_AVT_GRAMMAR_WORD_N] = { "n", 1 },
+        [PCX_AVT_GRAMMAR_WORD_S] = { "s", 1 },
+        [PCX_AVT_GRAMMAR_WORD_O] = { "o", 1 },
+        [PCX_AVT_GRAMMAR_WORD_OKC] = { "okc", 3 },
+        [PCX_AVT_GRAMMAR_WORD_E] = { "e", 1 },
+        [PCX_AVT_GRAMMAR_WORD_U] = { "u", 1 },
+        [PCX_AVT_GRAMMAR_WORD_CX] = { "ĉ", 2 },
+        [PCX_AVT_GRAMMAR_WORD_H] = { "h", 1 },
+        [PCX_AVT_GRAMMAR_WORD_R] = { "r", 1 },
+        [PCX_AVT_GRAMMAR_WORD_V] = { "v", 1 },
+        [PCX_AVT_GRAMMAR_WORD_NORD] = { "nord", 4 },
+        [PCX_AVT_GRAMMAR_WORD_ORIENT] = { "orient", 6 },
+        [PCX_AVT_GRAMMAR_WORD_SUD] = { "sud", 3 },
+        [PCX_AVT_GRAMMAR_WORD_OKCIDENT] = { "okcident", 8 },
+        [PCX_AVT_GRAMMAR_WORD_SUPR] = { "supr", 4 },
+        [PCX_AVT_GRAMMAR_WORD_MALSUPR] = { "malsupr", 7 },
+        [PCX_AVT_GRAMMAR_WORD_SUB] = { "sub", 3 },
+        [PCX_AVT_GRAMMAR_WORD_EL] = { "el", 2 },
+        [PCX_AVT_GRAMMAR_WORD_BRULIG] = { "brulig", 6 },
+        [PCX_AVT_GRAMMAR_WORD_ELENIR] = { "elenir", 6 },
+        [PCX_AVT_GRAMMAR_WORD_ELIR] = { "elir", 4 },
+        [PCX_AVT_GRAMMAR_WORD_ENIR] = { "enir", 4 },
+        [PCX_AVT_GRAMMAR_WORD_ENMET] = { "enmet", 5 },
+        [PCX_AVT_GRAMMAR_WORD_FAJRIG] = { "fajrig", 6 },
+        [PCX_AVT_GRAMMAR_WORD_FALIG] = { "falig", 5 },
+        [PCX_AVT_GRAMMAR_WORD_FERM] = { "ferm", 4 },
+        [PCX_AVT_GRAMMAR_WORD_FORJXET] = { "forĵet", 7 },
+        [PCX_AVT_GRAMMAR_WORD_HAV] = { "hav", 3 },
+        [PCX_AVT_GRAMMAR_WORD_IR] = { "ir", 2 },
+        [PCX_AVT_GRAMMAR_WORD_KUNPORT] = { "kunport", 7 },
+        [PCX_AVT_GRAMMAR_WORD_LAS] = { "las", 3 },
+        [PCX_AVT_GRAMMAR_WORD_LEG] = { "leg", 3 },
+        [PCX_AVT_GRAMMAR_WORD_LUMIG] = { "lumig", 5 },
+        [PCX_AVT_GRAMMAR_WORD_MALFERM] = { "malferm", 7 },
+        [PCX_AVT_GRAMMAR_WORD_MALLUMIG] = { "mallumig", 8 },
+        [PCX_AVT_GRAMMAR_WORD_MALSUPRENIR] = { "malsuprenir", 11 },
+        [PCX_AVT_GRAMMAR_WORD_MALSXALT] = { "malŝalt", 8 },
+        [PCX_AVT_GRAMMAR_WORD_MET] = { "met", 3 },
+        [PCX_AVT_GRAMMAR_WORD_NORDENIR] = { "nordenir", 8 },
+        [PCX_AVT_GRAMMAR_WORD_OKCIDENTENIR] = { "okcidentenir", 12 },
+        [PCX_AVT_GRAMMAR_WORD_ORIENTENIR] = { "orientenir", 10 },
+        [PCX_AVT_GRAMMAR_WORD_PREN] = { "pren", 4 },
+        [PCX_AVT_GRAMMAR_WORD_RIGARD] = { "rigard", 6 },
+        [PCX_AVT_GRAMMAR_WORD_SUBENIR] = { "subenir", 7 },
+        [PCX_AVT_GRAMMAR_WORD_SUDENIR] = { "sudenir", 7 },
+        [PCX_AVT_GRAMMAR_WORD_SUPRENIR] = { "suprenir", 8 },
+        [PCX_AVT_GRAMMAR_WORD_JXET] = { "ĵet", 4 },
+        [PCX_AVT_GRAMMAR_WORD_SXALT] = { "ŝalt", 5 },
+};
+
+static const uint8_t
+grammar_hash_table[1 << GRAMMAR_HASH_BITS] = {
+        [2] = PCX_AVT_GRAMMAR_WORD_SXI,
+        [7] = PCX_AVT_GRAMMAR_WORD_MALLUMIG,
+        [8] = PCX_AVT_GRAMMAR_WORD_PER,
+        [12] = PCX_AVT_GRAMMAR_WORD_ORIENT,
+        [14] = PCX_AVT_GRAMMAR_WORD_LEG,
+        [17] = PCX_AVT_GRAMMAR_WORD_KUNPORT,
+        [21] = PCX_AVT_GRAMMAR_WORD_ELIR,
+        [33] = PCX_AVT_GRAMMAR_WORD_SXALT,
+        [44] = PCX_AVT_GRAMMAR_WORD_NORDENIR,
+        [45] = PCX_AVT_GRAMMAR_WORD_MALSUPRENIR,
+        [48] = PCX_AVT_GRAMMAR_WORD_FALIG,
+        [52] = PCX_AVT_GRAMMAR_WORD_ENIR,
+        [56] = PCX_AVT_GRAMMAR_WORD_HAV,
+        [61] = PCX_AVT_GRAMMAR_WORD_PREN,
+        [69] = PCX_AVT_GRAMMAR_WORD_SUPR,
+        [76] = PCX_AVT_GRAMMAR_WORD_EN,
+        [78] = PCX_AVT_GRAMMAR_WORD_EL,
+        [80] = PCX_AVT_GRAMMAR_WORD_LI,
+        [84] = PCX_AVT_GRAMMAR_WORD_NI,
+        [88] = PCX_AVT_GRAMMAR_WORD_LA,
+        [91] = PCX_AVT_GRAMMAR_WORD_FERM,
+        [97] = PCX_AVT_GRAMMAR_WORD_OKCIDENT,
+        [99] = PCX_AVT_GRAMMAR_WORD_RIGARD,
+        [104] = PCX_AVT_GRAMMAR_WORD_IR,
+        [107] = PCX_AVT_GRAMMAR_WORD_RI,
+        [108] = PCX_AVT_GRAMMAR_WORD_MI,
+        [109] = PCX_AVT_GRAMMAR_WORD_MALSXALT,
+        [110] = PCX_AVT_GRAMMAR_WORD_AL,
+        [112] = PCX_AVT_GRAMMAR_WORD_JXET,
+        [115] = PCX_AVT_GRAMMAR_WORD_VI,
+        [119] = PCX_AVT_GRAMMAR_WORD_OKCIDENTENIR,
+        [120] = PCX_AVT_GRAMMAR_WORD_SUPRENIR,
+        [121] = PCX_AVT_GRAMMAR_WORD_ORIENTENIR,
+        [137] = PCX_AVT_GRAMMAR_WORD_GXI,
+        [144] = PCX_AVT_GRAMMAR_WORD_MET,
+        [146] = PCX_AVT_GRAMMAR_WORD_NORD,
+        [165] = PCX_AVT_GRAMMAR_WORD_FAJRIG,
+        [167] = PCX_AVT_GRAMMAR_WORD_MALSUPR,
+        [169] = PCX_AVT_GRAMMAR_WORD_ELENIR,
+        [170] = PCX_AVT_GRAMMAR_WORD_OKC,
+        [178] = PCX_AVT_GRAMMAR_WORD_FORJXET,
+        [179] = PCX_AVT_GRAMMAR_WORD_BRULIG,
+        [192] = PCX_AVT_GRAMMAR_WORD_SUD,
+        [194] = PCX_AVT_GRAMMAR_WORD_SUB,
+        [202] = PCX_AVT_GRAMMAR_WORD_ILI,
+        [204] = PCX_AVT_GRAMMAR_WORD_SUDENIR,
+        [206] = PCX_AVT_GRAMMAR_WORD_CX,
+        [213] = PCX_AVT_GRAMMAR_WORD_MALFERM,
+        [217] = PCX_AVT_GRAMMAR_WORD_LUMIG,
+        [224] = PCX_AVT_GRAMMAR_WORD_S,
+        [225] = PCX_AVT_GRAMMAR_WORD_R,
+        [229] = PCX_AVT_GRAMMAR_WORD_V,
+        [230] = PCX_AVT_GRAMMAR_WORD_U,
+        [231] = PCX_AVT_GRAMMAR_WORD_SUBENIR,
+        [232] = PCX_AVT_GRAMMAR_WORD_KAJ,
+        [233] = PCX_AVT_GRAMMAR_WORD_ENMET,
+        [242] = PCX_AVT_GRAMMAR_WORD_LAS,
+        [246] = PCX_AVT_GRAMMAR_WORD_E,
+        [251] = PCX_AVT_GRAMMAR_WORD_H,
+        [252] = PCX_AVT_GRAMMAR_WORD_O,
+        [253] = PCX_AVT_GRAMMAR_WORD_N,
+};
@@ -0,0 +1,74 @@
+/*
+ * Aventuro - A text aventure system in Esperanto
+ * Copyright (C) 2021  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "pcx-avt-grammar.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+struct grammar_word {
+        const char *word;
+        size_t length;
+};
+
+#include "pcx-avt-grammar-table.h"
+
+static uint32_t
+hash_word(const char *word,
+          size_t length)
+{
+        /* FNV-1a starting from the seed that the generator found to
+         * have no collisions.
+         */
+        uint32_t hash = GRAMMAR_HASH_SEED;
+
+        for (size_t i = 0; i < length; i++) {
+                hash ^= (uint8_t) word[i];
+                hash *= 16777619;
+        }
+
+        return hash;
+}
+
+enum pcx_avt_grammar_word
+pcx_avt_grammar_find_word(const char *word,
+                          size_t length)
+{
+        uint32_t hash = hash_word(word, length);
+        enum pcx_avt_grammar_word grammar_word =
+                grammar_hash_table[hash >> (32 - GRAMMAR_HASH_BITS)];
+
+        if (grammar_word == PCX_AVT_GRAMMAR_WORD_NONE ||
+            grammar_words[grammar_word].length != length ||
+            memcmp(grammar_words[grammar_word].word, word, length))
+                return PCX_AVT_GRAMMAR_WORD_NONE;
+
+        return grammar_word;
+}
+
+const char *
+pcx_avt_grammar_get_word(enum pcx_avt_grammar_word word)
+{
+        assert(word > PCX_AVT_GRAMMAR_WORD_NONE &&
+               word < PCX_AVT_GRAMMAR_N_WORDS);
+
+        return grammar_words[word].word;
+}
@@ -0,0 +1,119 @@
+/*
+ * Aventuro - A text aventure system in Esperanto
+ * Copyright (C) 2021  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PCX_AVT_GRAMMAR_H
+#define PCX_AVT_GRAMMAR_H
+
+#include <stdlib.h>
+
+/* The words that have a fixed meaning in the grammar of the commands,
+ * regardless of the game. The comment after each value is the word in
+ * the canonical form. The table to look them up is generated from
+ * this list by skriptoj/generu-gramatikon.py so it must be run again
+ * whenever the list changes.
+ */
+enum pcx_avt_grammar_word {
+        PCX_AVT_GRAMMAR_WORD_NONE,
+
+        PCX_AVT_GRAMMAR_WORD_LA, /* la */
+        PCX_AVT_GRAMMAR_WORD_AL, /* al */
+        PCX_AVT_GRAMMAR_WORD_EN, /* en */
+        PCX_AVT_GRAMMAR_WORD_PER, /* per */
+        PCX_AVT_GRAMMAR_WORD_KAJ, /* kaj */
+
+        /* Pronouns */
+        PCX_AVT_GRAMMAR_WORD_MI, /* mi */
+        PCX_AVT_GRAMMAR_WORD_NI, /* ni */
+        PCX_AVT_GRAMMAR_WORD_VI, /* vi */
+        PCX_AVT_GRAMMAR_WORD_LI, /* li */
+        PCX_AVT_GRAMMAR_WORD_SXI, /* ŝi */
+        PCX_AVT_GRAMMAR_WORD_GXI, /* ĝi */
+        PCX_AVT_GRAMMAR_WORD_RI, /* ri */
+        PCX_AVT_GRAMMAR_WORD_ILI, /* ili */
+
+        /* Shortcuts that can be typed instead of a whole command */
+        PCX_AVT_GRAMMAR_WORD_N, /* n */
+        PCX_AVT_GRAMMAR_WORD_S, /* s */
+        PCX_AVT_GRAMMAR_WORD_O, /* o */
+        PCX_AVT_GRAMMAR_WORD_OKC, /* okc */
+        PCX_AVT_GRAMMAR_WORD_E, /* e */
+        PCX_AVT_GRAMMAR_WORD_U, /* u */
+        PCX_AVT_GRAMMAR_WORD_CX, /* ĉ */
+        PCX_AVT_GRAMMAR_WORD_H, /* h */
+        PCX_AVT_GRAMMAR_WORD_R, /* r */
+        PCX_AVT_GRAMMAR_WORD_V, /* v */
+
+        /* Compass directions */
+        PCX_AVT_GRAMMAR_WORD_NORD, /* nord */
+        PCX_AVT_GRAMMAR_WORD_ORIENT, /* orient */
+        PCX_AVT_GRAMMAR_WORD_SUD, /* sud */
+        PCX_AVT_GRAMMAR_WORD_OKCIDENT, /* okcident */
+        PCX_AVT_GRAMMAR_WORD_SUPR, /* supr */
+        PCX_AVT_GRAMMAR_WORD_MALSUPR, /* malsupr */
+        PCX_AVT_GRAMMAR_WORD_SUB, /* sub */
+        PCX_AVT_GRAMMAR_WORD_EL, /* el */
+
+        /* Verbs that have a built-in handler */
+        PCX_AVT_GRAMMAR_WORD_BRULIG, /* brulig */
+        PCX_AVT_GRAMMAR_WORD_ELENIR, /* elenir */
+        PCX_AVT_GRAMMAR_WORD_ELIR, /* elir */
+        PCX_AVT_GRAMMAR_WORD_ENIR, /* enir */
+        PCX_AVT_GRAMMAR_WORD_ENMET, /* enmet */
+        PCX_AVT_GRAMMAR_WORD_FAJRIG, /* fajrig */
+        PCX_AVT_GRAMMAR_WORD_FALIG, /* falig */
+        PCX_AVT_GRAMMAR_WORD_FERM, /* ferm */
+        PCX_AVT_GRAMMAR_WORD_FORJXET, /* forĵet */
+        PCX_AVT_GRAMMAR_WORD_HAV, /* hav */
+        PCX_AVT_GRAMMAR_WORD_IR, /* ir */
+        PCX_AVT_GRAMMAR_WORD_KUNPORT, /* kunport */
+        PCX_AVT_GRAMMAR_WORD_LAS, /* las */
+        PCX_AVT_GRAMMAR_WORD_LEG, /* leg */
+        PCX_AVT_GRAMMAR_WORD_LUMIG, /* lumig */
+        PCX_AVT_GRAMMAR_WORD_MALFERM, /* malferm */
+        PCX_AVT_GRAMMAR_WORD_MALLUMIG, /* mallumig */
+        PCX_AVT_GRAMMAR_WORD_MALSUPRENIR, /* malsuprenir */
+        PCX_AVT_GRAMMAR_WORD_MALSXALT, /* malŝalt */
+        PCX_AVT_GRAMMAR_WORD_MET, /* met */
+        PCX_AVT_GRAMMAR_WORD_NORDENIR, /* nordenir */
+        PCX_AVT_GRAMMAR_WORD_OKCIDENTENIR, /* okcidentenir */
+        PCX_AVT_GRAMMAR_WORD_ORIENTENIR, /* orientenir */
+        PCX_AVT_GRAMMAR_WORD_PREN, /* pren */
+        PCX_AVT_GRAMMAR_WORD_RIGARD, /* rigard */
+        PCX_AVT_GRAMMAR_WORD_SUBENIR, /* subenir */
+        PCX_AVT_GRAMMAR_WORD_SUDENIR, /* sudenir */
+        PCX_AVT_GRAMMAR_WORD_SUPRENIR, /* suprenir */
+        PCX_AVT_GRAMMAR_WORD_JXET, /* ĵet */
+        PCX_AVT_GRAMMAR_WORD_SXALT, /* ŝalt */
+};
+
+#define PCX_AVT_GRAMMAR_N_WORDS (PCX_AVT_GRAMMAR_WORD_SXALT + 1)
+
+/* Finds the grammar word that has the given text in the canonical
+ * form, or returns PCX_AVT_GRAMMAR_WORD_NONE if it isn’t one of them.
+ * The table is a perfect hash so this only looks at the bytes of the
+ * word once and doesn’t depend on the number of grammar words.
+ */
+enum pcx_avt_grammar_word
+pcx_avt_grammar_find_word(const char *word,
+                          size_t length);
+
+/* Returns the text of a grammar word in the canonical form */
+const char *
+pcx_avt_grammar_get_word(enum pcx_avt_grammar_word word);
+
+#endif /* PCX_AVT_GRAMMAR_H */
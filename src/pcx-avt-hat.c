@@ -20,6 +20,8 @@
 
 #include "pcx-avt-hat.h"
 
+#include <string.h>
+
 #include "pcx-utf8.h"
 
 uint32_t
@@ -138,3 +140,72 @@ pcx_avt_hat_iter_next(struct pcx_avt_hat_iter *iter)
 
         return ch;
 }
+
+size_t
+pcx_avt_hat_normalize(char *dst,
+                      const char *src,
+                      size_t length)
+{
+        char *out = dst;
+
+        while (length > 0) {
+                char ch = *src;
+
+                /* Most of the text is plain ASCII that can be copied
+                 * one byte at a time unless it is followed by an x.
+                 */
+                if ((ch & 0x80) == 0 &&
+                    (length < 2 || (src[1] != 'x' && src[1] != 'X'))) {
+                        if (ch >= 'A' && ch <= 'Z')
+                                ch = ch - 'A' + 'a';
+                        *(out++) = ch;
+                        src++;
+                        length--;
+                        continue;
+                }
+
+                struct pcx_avt_hat_iter iter;
+
+                pcx_avt_hat_iter_init(&iter, src, length);
+
+                uint32_t uch = pcx_avt_hat_iter_next(&iter);
+
+                uch = pcx_avt_hat_to_lower(uch);
+
+                /* The decoded character is never longer than the
+                 * bytes it was decoded from.
+                 */
+                out += pcx_utf8_encode(uch, out);
+                src = iter.pos;
+                length = iter.length;
+        }
+
+        return out - dst;
+}
+
+void
+pcx_avt_hat_normalize_string(char *str)
+{
+        size_t length = pcx_avt_hat_normalize(str, str, strlen(str));
+
+        str[length] = '\0';
+}
+
+uint32_t
+pcx_avt_hat_hash_word(const char *word,
+                      size_t length)
+{
+        /* FNV-1a */
+        uint32_t hash = 2166136261u;
+
+        for (size_t i = 0; i < length; i++)
+                hash = (hash ^ (uint8_t) word[i]) * 16777619u;
+
+        return hash;
+}
+
+uint32_t
+pcx_avt_hat_hash_string(const char *str)
+{
+        return pcx_avt_hat_hash_word(str, strlen(str));
+}
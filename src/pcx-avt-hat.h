@@ -55,4 +55,33 @@ pcx_avt_hat_is_alphabetic(uint32_t ch);
 bool
 pcx_avt_hat_is_alphabetic_string(const char *str);
 
+/* Converts text to the canonical form that words are compared in.
+ * Any letters written with the x-system are replaced with real hats
+ * and all of the letters are made lowercase. Once two words are in
+ * this form they are equal if they have the same bytes. The result is
+ * never longer than the source so dst can be the same as src to
+ * convert it in place. Returns the length of the result. It isn’t
+ * zero-terminated.
+ */
+size_t
+pcx_avt_hat_normalize(char *dst,
+                      const char *src,
+                      size_t length);
+
+/* Converts a zero-terminated string to the canonical form in place */
+void
+pcx_avt_hat_normalize_string(char *str);
+
+/* Calculates a hash of a word that is in the canonical form */
+uint32_t
+pcx_avt_hat_hash_word(const char *word,
+                      size_t length);
+
+/* Calculates the hash of a zero-terminated string in the canonical
+ * form. This will be the same as the hash of a word with the same
+ * letters.
+ */
+uint32_t
+pcx_avt_hat_hash_string(const char *str);
+
 #endif /* PCX_AVT_HAT_H */
@@ -1803,6 +1803,7 @@ done:
                 finalize_rule_verbs(&data);
 
         if (ret) {
+                pcx_avt_prepare(data.avt);
                 return data.avt;
         } else {
                 pcx_avt_free(data.avt);
@@ -21,12 +21,14 @@
 #include "pcx-avt-state.h"
 
 #include <string.h>
+#include <strings.h>
 #include <stddef.h>
 #include <stdalign.h>
 #include <assert.h>
 
 #include "pcx-util.h"
 #include "pcx-avt-command.h"
+#include "pcx-avt-grammar.h"
 #include "pcx-buffer.h"
 #include "pcx-list.h"
 #include "pcx-avt-hat.h"
@@ -36,23 +38,30 @@
 #define PCX_AVT_STATE_MAX_CARRYING_SIZE 100
 
 /* If a rule action triggers another rule action, we’ll limit the
- * recursion to this to prevent stack overflow.
+ * nesting to this to prevent games that run forever.
  */
 #define PCX_AVT_STATE_MAX_RECURSION_DEPTH 10
 
+/* The longest number of turns that a wandering monster will wait
+ * before moving again, however unlikely it is to wander.
+ */
+#define PCX_AVT_STATE_MAX_WANDER_DELAY 100
+
+/* The default maximum size of the history used to undo commands */
+#define PCX_AVT_STATE_DEFAULT_UNDO_LIMIT (256 * 1024)
+
 enum pcx_avt_state_movable_type {
         PCX_AVT_STATE_MOVABLE_TYPE_OBJECT,
         PCX_AVT_STATE_MOVABLE_TYPE_MONSTER,
 };
 
 /* This is a copy of either a monster or an object from pcx_avt. They
- * are all allocated individually and will have their stats updated as
- * the game progresses.
+ * are all allocated together in a single array in the state and will
+ * have their stats updated as the game progresses. The name and
+ * adjective always point to strings owned by the pcx_avt so changing
+ * them only changes which string is pointed to.
  */
 struct pcx_avt_state_movable {
-        /* Node avt->all_movables */
-        struct pcx_list all_node;
-
         /* Node in the list of the containing object. All movables
          * will always be in some list. If they aren’t in the game any
          * more then that list will be avt->nowhere.
@@ -70,6 +79,24 @@ struct pcx_avt_state_movable {
 
         enum pcx_avt_state_movable_type type;
 
+        /* The position of this movable in state->movables */
+        uint16_t index;
+
+        /* The index of the movable in the pcx_avt that this movable
+         * was last copied from, or its own index if it hasn’t been
+         * copied. The parts of the movable that can’t be changed by
+         * a rule always come from here.
+         */
+        uint16_t copied_from;
+
+        /* The total weight of everything inside this movable,
+         * including the things in closed containers, and the total
+         * size of the things directly inside it. These are kept
+         * up-to-date whenever something moves or changes its stats.
+         */
+        int contents_weight;
+        int contents_size;
+
         union {
                 struct pcx_avt_movable base;
                 struct pcx_avt_object object;
@@ -85,6 +112,17 @@ struct pcx_avt_state_room {
         bool visited;
 
         uint32_t attributes;
+
+        /* Incremented whenever something changes that affects the
+         * list of things in the room’s description.
+         */
+        uint32_t version;
+        /* The rendered text of the description and the version of
+         * the room that it was made for. The cache is empty until the
+         * description is first needed.
+         */
+        uint32_t description_version;
+        struct pcx_buffer description;
 };
 
 struct pcx_avt_state_reference {
@@ -100,6 +138,11 @@ struct pcx_avt_state_references {
 };
 
 struct pcx_avt_state_run_rule_data {
+        /* Set when the rule is run without any subjects so that the
+         * results of the conditions can be reused for as long as
+         * their inputs don’t change.
+         */
+        bool cache_conditions;
         const struct pcx_avt_command_word *verb;
         struct pcx_avt_state_movable *command_object;
         struct pcx_avt_state_movable *object;
@@ -110,6 +153,102 @@ struct pcx_avt_state_run_rule_data {
         int room;
 };
 
+/* The result of checking the conditions of a rule without any
+ * subjects, along with the versions of its inputs at the time.
+ */
+struct pcx_avt_state_condition_cache {
+        bool valid;
+        bool result;
+        int room;
+        uint32_t input_versions[PCX_AVT_N_RULE_INPUTS];
+};
+
+/* An entry in the hash table of names. There is one for the name of
+ * each movable and one for each of its aliases.
+ */
+struct pcx_avt_state_name_entry {
+        /* Number of the name in pcx_avt->words */
+        uint32_t word;
+        /* Index of the movable in state->movables */
+        int movable;
+        /* Index of the next entry in the same bucket, or -1 */
+        int next;
+};
+
+/* The same as the union at the end of pcx_avt_state_movable */
+union pcx_avt_state_movable_data {
+        struct pcx_avt_movable base;
+        struct pcx_avt_object object;
+        struct pcx_avt_monster monster;
+};
+
+enum pcx_avt_state_journal_type {
+        PCX_AVT_STATE_JOURNAL_LOCATION,
+        PCX_AVT_STATE_JOURNAL_MOVABLE,
+        PCX_AVT_STATE_JOURNAL_ROOM,
+        PCX_AVT_STATE_JOURNAL_CURRENT_ROOM,
+        PCX_AVT_STATE_JOURNAL_POINTS,
+        PCX_AVT_STATE_JOURNAL_GAME_ATTRIBUTES,
+        PCX_AVT_STATE_JOURNAL_GAME_OVER,
+};
+
+/* A change made by a command. The entry stores the value that
+ * something had before the change. Undoing the entry swaps that
+ * value with the current one so that the same entry can then be used
+ * to redo the change.
+ */
+struct pcx_avt_state_journal_entry {
+        enum pcx_avt_state_journal_type type;
+        /* The movable or room that changed */
+        uint16_t index;
+
+        union {
+                struct {
+                        /* The node in the list that the movable was
+                         * after. When the entries are undone in
+                         * reverse order this is always in the same
+                         * place as it was when the movable moved.
+                         */
+                        struct pcx_list *prev;
+                        struct pcx_avt_state_movable *container;
+                        enum pcx_avt_location_type location_type;
+                        uint8_t location;
+                } location;
+
+                /* Everything about the movable except its location */
+                struct {
+                        enum pcx_avt_state_movable_type type;
+                        uint16_t copied_from;
+                        union pcx_avt_state_movable_data data;
+                } movable;
+
+                struct {
+                        uint32_t attributes;
+                        bool visited;
+                } room;
+
+                int current_room;
+                int points;
+                uint64_t game_attributes;
+                bool game_over;
+        };
+};
+
+/* The start of the changes made by each command in the journal */
+struct pcx_avt_state_journal_command {
+        /* Index of the first pcx_avt_state_journal_entry */
+        size_t first_entry;
+        /* The references from before and after the command was run */
+        struct pcx_avt_state_references references_before;
+        struct pcx_avt_state_references references_after;
+};
+
+/* A time when a monster will next do something */
+struct pcx_avt_state_wakeup {
+        uint32_t turn;
+        uint16_t movable;
+};
+
 struct pcx_avt_state {
         const struct pcx_avt *avt;
 
@@ -121,54 +260,228 @@ struct pcx_avt_state {
 
         /* Things that the player is carrying */
         struct pcx_list carrying;
+        /* The total weight of everything in the carrying list
+         * including the things inside them, and the total size of
+         * just the things directly in the list.
+         */
+        int carrying_weight;
+        int carrying_size;
 
         /* Things that are nowhere */
         struct pcx_list nowhere;
 
-        /* All things */
-        struct pcx_list all_movables;
-
-        /* The objects and monsters that are originally created from
-         * the pcx_avt will be directly referenced by number and so
-         * have an index for them here.
+        /* All of the objects and monsters in a single allocation.
+         * They are referenced by their position in the array. The
+         * compiled rules refer to them with a single number where the
+         * monsters come after the objects so objects and monsters
+         * point into this array.
          */
-        struct pcx_avt_state_movable **object_index;
-        struct pcx_avt_state_movable **monster_index;
+        size_t n_movables;
+        struct pcx_avt_state_movable *movables;
+        struct pcx_avt_state_movable *objects;
+        struct pcx_avt_state_movable *monsters;
 
         /* Queue of messages to report with
          * pcx_avt_state_get_next_message. Each message is a
          * zero-terminated string prefixed with pcx_avt_state_message.
+         * If message_cb is set then each message is passed to it as
+         * soon as it is complete and removed from the buffer again
+         * unless the callback refuses it. The messages before
+         * message_buf_pos have already been read.
          */
         struct pcx_buffer message_buf;
         size_t message_buf_pos;
+        /* Offset of the message being built */
+        size_t message_start;
         bool message_in_progress;
 
+        bool (* message_cb)(const struct pcx_avt_state_message *, void *);
+        void *message_cb_data;
+
+        void (* event_cb)(const struct pcx_avt_state_event *, void *);
+        void *event_cb_data;
+
         uint64_t game_attributes;
 
         /* Temporary stack for searching for items */
         struct pcx_buffer stack;
 
+        /* The command being run, converted to the canonical form so
+         * that the parsed words can be compared directly.
+         */
+        struct pcx_buffer command_buf;
+
         /* Used to prevent infinite recursion when executing rules */
         int rule_recursion_depth;
 
+        /* The maximum number of steps that a command can take or
+         * zero if there is no limit. Each rule that is run and each
+         * action of a rule is a step. Once the limit is reached,
+         * out_of_steps is set and no more rules are run until the
+         * next command.
+         */
+        unsigned step_limit;
+        unsigned n_steps;
+        bool out_of_steps;
+
         /* The references that were used in the last command. This
          * will be used to resolve pronouns.
          */
         struct pcx_avt_state_references previous_references;
 
+        /* Used instead of random_state if it is not NULL */
         int (* random_cb)(void *);
         void *random_cb_data;
+        struct pcx_avt_state_random_state random_state;
+
+        /* A counter for each pcx_avt_rule_input that is incremented
+         * whenever that part of the state changes.
+         */
+        uint32_t input_versions[PCX_AVT_N_RULE_INPUTS];
+        /* One for each rule in the pcx_avt */
+        struct pcx_avt_state_condition_cache *condition_cache;
+
+        /* Bitmask with a bit for each movable in state->movables that
+         * might have a countdown running, ie, it is burning or its
+         * end is set. This is used to avoid looking at every movable
+         * after each command. Bits are set whenever a countdown
+         * might start and are only cleared once the countdown is
+         * found to have stopped.
+         */
+        uint32_t *timer_bits;
+
+        /* The number of times the monsters have had a turn */
+        uint32_t turn;
+        /* A binary min-heap of pcx_avt_state_wakeup ordered by the
+         * turn, with an entry for each monster that wanders. Only the
+         * monsters whose turn has come are looked at after each
+         * command. Entries for monsters that no longer wander are
+         * dropped when they come up.
+         */
+        struct pcx_buffer monster_schedule;
+        /* A bit for each movable that has an entry in the schedule so
+         * that a monster that starts wandering can be added without
+         * searching for it.
+         */
+        uint32_t *scheduled_bits;
+        /* The room that the player was in when the monsters last
+         * had a turn so that the monsters in the room can react when
+         * the player arrives.
+         */
+        int monster_check_room;
+
+        /* Hash table to find the movables that have a given name or
+         * alias without having to search through everything that the
+         * player can see. Each bucket is the index of the first
+         * pcx_avt_state_name_entry in name_entries or -1. Entries that
+         * are removed are chained together starting from
+         * free_name_entry so that they can be reused.
+         */
+        size_t name_hash_size;
+        int *name_buckets;
+        struct pcx_buffer name_entries;
+        int free_name_entry;
+
+        /* Cached result of check_light and a bitmask with a bit for
+         * each movable in state->movables that is present. These are
+         * calculated when they are first needed and invalidated
+         * whenever something moves, the player changes room, or an
+         * attribute that affects the light or whether a container is
+         * open changes.
+         */
+        bool visibility_valid;
+        bool room_is_lit;
+        uint32_t *present_bits;
+
+        /* Journal of the changes made by each command so that they
+         * can be undone. The commands from journal_first_command up
+         * to journal_n_done can be undone and the rest can be
+         * redone. Commands before journal_first_command have been
+         * forgotten to stay under undo_limit and are only removed
+         * from the buffers once they take up half of the space.
+         * Changes are only recorded while journal_recording is set.
+         */
+        bool journal_recording;
+        struct pcx_buffer journal_entries;
+        struct pcx_buffer journal_commands;
+        size_t journal_first_command;
+        size_t journal_n_done;
+        size_t undo_limit;
 };
 
+struct pcx_avt_state_template {
+        /* A state with everything in its starting position that is
+         * copied to create each new state.
+         */
+        struct pcx_avt_state *state;
+};
+
+static uint32_t
+rotate_left(uint32_t x,
+            int k)
+{
+        return (x << k) | (x >> (32 - k));
+}
+
+/* xoshiro128** by David Blackman and Sebastiano Vigna */
+static uint32_t
+next_random(struct pcx_avt_state_random_state *random_state)
+{
+        uint32_t *s = random_state->s;
+        uint32_t result = rotate_left(s[1] * 5, 7) * 9;
+        uint32_t t = s[1] << 9;
+
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+
+        s[2] ^= t;
+
+        s[3] = rotate_left(s[3], 11);
+
+        return result;
+}
+
+static uint64_t
+splitmix64(uint64_t *x)
+{
+        uint64_t z = (*x += UINT64_C(0x9e3779b97f4a7c15));
+
+        z = (z ^ (z >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+        z = (z ^ (z >> 27)) * UINT64_C(0x94d049bb133111eb);
+
+        return z ^ (z >> 31);
+}
+
+static void
+seed_random(struct pcx_avt_state_random_state *random_state,
+            uint64_t seed)
+{
+        /* Use splitmix64 to spread the bits of the seed over the
+         * state as recommended by the authors of xoshiro.
+         */
+        for (int i = 0; i < 4; i += 2) {
+                uint64_t value = splitmix64(&seed);
+
+                random_state->s[i] = value;
+                random_state->s[i + 1] = value >> 32;
+        }
+}
+
 static int
 get_random(struct pcx_avt_state *state)
 {
-        return state->random_cb(state->random_cb_data);
+        if (state->random_cb)
+                return state->random_cb(state->random_cb_data);
+
+        /* Scale to the range [0,99] using the top bits */
+        return ((uint64_t) next_random(&state->random_state) * 100) >> 32;
 }
 
 static bool
 run_special_rules(struct pcx_avt_state *state,
-                  const char *verb_str,
+                  enum pcx_avt_special_verb special_verb,
                   const struct pcx_avt_state_run_rule_data *data);
 
 static bool
@@ -179,6 +492,356 @@ run_rule_actions(struct pcx_avt_state *state,
 static void
 end_message(struct pcx_avt_state *state);
 
+static void
+update_monster_schedule(struct pcx_avt_state *state,
+                        const struct pcx_avt_state_movable *movable);
+
+static void
+input_changed(struct pcx_avt_state *state,
+              enum pcx_avt_rule_input input)
+{
+        state->input_versions[input]++;
+}
+
+static void
+send_event(struct pcx_avt_state *state,
+           const struct pcx_avt_state_event *event)
+{
+        state->event_cb(event, state->event_cb_data);
+}
+
+static void
+send_moved_event(struct pcx_avt_state *state,
+                 const struct pcx_avt_state_movable *movable)
+{
+        if (state->event_cb == NULL)
+                return;
+
+        struct pcx_avt_state_event event = {
+                .type = PCX_AVT_STATE_EVENT_MOVED,
+                .moved = {
+                        .movable = movable->index,
+                        .location_type = movable->base.location_type,
+                        .location = -1,
+                },
+        };
+
+        if (movable->container)
+                event.moved.location = movable->container->index;
+        else if (movable->base.location_type == PCX_AVT_LOCATION_TYPE_IN_ROOM)
+                event.moved.location = movable->base.location;
+
+        send_event(state, &event);
+}
+
+static void
+send_movable_changed_event(struct pcx_avt_state *state,
+                           const struct pcx_avt_state_movable *movable)
+{
+        if (state->event_cb == NULL)
+                return;
+
+        struct pcx_avt_state_event event = {
+                .type = PCX_AVT_STATE_EVENT_MOVABLE_CHANGED,
+                .movable_changed = {
+                        .movable = movable->index,
+                        .attributes = movable->base.attributes,
+                },
+        };
+
+        send_event(state, &event);
+}
+
+static void
+send_room_attributes_event(struct pcx_avt_state *state,
+                           int room)
+{
+        if (state->event_cb == NULL)
+                return;
+
+        struct pcx_avt_state_event event = {
+                .type = PCX_AVT_STATE_EVENT_ROOM_ATTRIBUTES,
+                .room_attributes = {
+                        .room = room,
+                        .attributes = state->rooms[room].attributes,
+                },
+        };
+
+        send_event(state, &event);
+}
+
+static void
+send_game_attributes_event(struct pcx_avt_state *state)
+{
+        if (state->event_cb == NULL)
+                return;
+
+        struct pcx_avt_state_event event = {
+                .type = PCX_AVT_STATE_EVENT_GAME_ATTRIBUTES,
+                .game_attributes = state->game_attributes,
+        };
+
+        send_event(state, &event);
+}
+
+static void
+send_current_room_event(struct pcx_avt_state *state)
+{
+        if (state->event_cb == NULL)
+                return;
+
+        struct pcx_avt_state_event event = {
+                .type = PCX_AVT_STATE_EVENT_CURRENT_ROOM,
+                .current_room = state->current_room,
+        };
+
+        send_event(state, &event);
+}
+
+static void
+send_points_event(struct pcx_avt_state *state)
+{
+        if (state->event_cb == NULL)
+                return;
+
+        struct pcx_avt_state_event event = {
+                .type = PCX_AVT_STATE_EVENT_POINTS,
+                .points = state->points,
+        };
+
+        send_event(state, &event);
+}
+
+static void
+send_game_over_event(struct pcx_avt_state *state)
+{
+        if (state->event_cb == NULL)
+                return;
+
+        struct pcx_avt_state_event event = {
+                .type = PCX_AVT_STATE_EVENT_GAME_OVER,
+                .game_over = state->game_over,
+        };
+
+        send_event(state, &event);
+}
+
+static void
+invalidate_visibility(struct pcx_avt_state *state)
+{
+        state->visibility_valid = false;
+}
+
+/* This should be called whenever the movable moves, before and
+ * after, and whenever something about it changes that would change
+ * how it is listed in the description of the room that it is in.
+ */
+static void
+invalidate_room_description(struct pcx_avt_state *state,
+                            const struct pcx_avt_state_movable *movable)
+{
+        if (movable->base.location_type == PCX_AVT_LOCATION_TYPE_IN_ROOM)
+                state->rooms[movable->base.location].version++;
+}
+
+static size_t
+get_n_journal_entries(const struct pcx_avt_state *state)
+{
+        return (state->journal_entries.length /
+                sizeof (struct pcx_avt_state_journal_entry));
+}
+
+static struct pcx_avt_state_journal_entry *
+get_journal_entries(struct pcx_avt_state *state)
+{
+        return (struct pcx_avt_state_journal_entry *)
+                state->journal_entries.data;
+}
+
+static size_t
+get_n_journal_commands(const struct pcx_avt_state *state)
+{
+        return (state->journal_commands.length /
+                sizeof (struct pcx_avt_state_journal_command));
+}
+
+static struct pcx_avt_state_journal_command *
+get_journal_commands(struct pcx_avt_state *state)
+{
+        return (struct pcx_avt_state_journal_command *)
+                state->journal_commands.data;
+}
+
+/* Adds an entry to the journal and returns it so that the caller can
+ * fill in the old value, or returns NULL if no command is being
+ * recorded.
+ */
+static struct pcx_avt_state_journal_entry *
+add_journal_entry(struct pcx_avt_state *state,
+                  enum pcx_avt_state_journal_type type,
+                  int index)
+{
+        if (!state->journal_recording)
+                return NULL;
+
+        size_t entry_num = get_n_journal_entries(state);
+
+        pcx_buffer_set_length(&state->journal_entries,
+                              state->journal_entries.length +
+                              sizeof (struct pcx_avt_state_journal_entry));
+
+        struct pcx_avt_state_journal_entry *entry =
+                get_journal_entries(state) + entry_num;
+
+        entry->type = type;
+        entry->index = index;
+
+        return entry;
+}
+
+static void
+journal_location(struct pcx_avt_state *state,
+                 const struct pcx_avt_state_movable *movable)
+{
+        struct pcx_avt_state_journal_entry *entry =
+                add_journal_entry(state,
+                                  PCX_AVT_STATE_JOURNAL_LOCATION,
+                                  movable->index);
+
+        if (entry == NULL)
+                return;
+
+        entry->location.prev = movable->location_node.prev;
+        entry->location.container = movable->container;
+        entry->location.location_type = movable->base.location_type;
+        entry->location.location = movable->base.location;
+}
+
+/* Must be called before changing anything about a movable other than
+ * its location.
+ */
+static void
+journal_movable(struct pcx_avt_state *state,
+                const struct pcx_avt_state_movable *movable)
+{
+        struct pcx_avt_state_journal_entry *entry =
+                add_journal_entry(state,
+                                  PCX_AVT_STATE_JOURNAL_MOVABLE,
+                                  movable->index);
+
+        if (entry == NULL)
+                return;
+
+        entry->movable.type = movable->type;
+        entry->movable.copied_from = movable->copied_from;
+        memcpy(&entry->movable.data,
+               &movable->base,
+               sizeof entry->movable.data);
+}
+
+static void
+journal_room(struct pcx_avt_state *state,
+             int room)
+{
+        struct pcx_avt_state_journal_entry *entry =
+                add_journal_entry(state, PCX_AVT_STATE_JOURNAL_ROOM, room);
+
+        if (entry == NULL)
+                return;
+
+        entry->room.attributes = state->rooms[room].attributes;
+        entry->room.visited = state->rooms[room].visited;
+}
+
+static void
+set_current_room(struct pcx_avt_state *state,
+                 int room)
+{
+        struct pcx_avt_state_journal_entry *entry =
+                add_journal_entry(state,
+                                  PCX_AVT_STATE_JOURNAL_CURRENT_ROOM,
+                                  0);
+
+        if (entry)
+                entry->current_room = state->current_room;
+
+        state->current_room = room;
+        invalidate_visibility(state);
+        input_changed(state, PCX_AVT_RULE_INPUT_CURRENT_ROOM);
+        send_current_room_event(state);
+}
+
+static void
+set_room_attributes(struct pcx_avt_state *state,
+                    int room,
+                    uint32_t attributes)
+{
+        journal_room(state, room);
+        state->rooms[room].attributes = attributes;
+        invalidate_visibility(state);
+        input_changed(state, PCX_AVT_RULE_INPUT_ROOM_ATTRIBUTES);
+        send_room_attributes_event(state, room);
+}
+
+static void
+set_game_attributes(struct pcx_avt_state *state,
+                    uint64_t attributes)
+{
+        struct pcx_avt_state_journal_entry *entry =
+                add_journal_entry(state,
+                                  PCX_AVT_STATE_JOURNAL_GAME_ATTRIBUTES,
+                                  0);
+
+        if (entry)
+                entry->game_attributes = state->game_attributes;
+
+        state->game_attributes = attributes;
+        input_changed(state, PCX_AVT_RULE_INPUT_GAME_ATTRIBUTES);
+        send_game_attributes_event(state);
+}
+
+static bool
+movable_has_timer(const struct pcx_avt_state_movable *movable)
+{
+        return (movable->type == PCX_AVT_STATE_MOVABLE_TYPE_OBJECT &&
+                ((movable->base.attributes &
+                  PCX_AVT_OBJECT_ATTRIBUTE_BURNING) ||
+                 movable->object.end > 0));
+}
+
+static void
+update_timer(struct pcx_avt_state *state,
+             const struct pcx_avt_state_movable *movable)
+{
+        if (movable_has_timer(movable)) {
+                state->timer_bits[movable->index / 32] |=
+                        UINT32_C(1) << (movable->index % 32);
+        }
+}
+
+static void
+set_movable_attributes(struct pcx_avt_state *state,
+                       struct pcx_avt_state_movable *movable,
+                       uint32_t attributes)
+{
+        journal_movable(state, movable);
+
+        if (((movable->base.attributes ^ attributes) &
+             (PCX_AVT_OBJECT_ATTRIBUTE_CLOSED |
+              PCX_AVT_OBJECT_ATTRIBUTE_LIT |
+              PCX_AVT_OBJECT_ATTRIBUTE_BURNING)))
+                invalidate_visibility(state);
+
+        if (((movable->base.attributes ^ attributes) &
+             PCX_AVT_OBJECT_ATTRIBUTE_PORTABLE))
+                invalidate_room_description(state, movable);
+
+        movable->base.attributes = attributes;
+        input_changed(state, PCX_AVT_RULE_INPUT_MOVABLES);
+        update_timer(state, movable);
+        send_movable_changed_event(state, movable);
+}
+
 static size_t
 align_message_start(size_t pos)
 {
@@ -205,6 +868,8 @@ start_message_type(struct pcx_avt_state *state,
 
         message->type = type;
 
+        state->message_start = message_start_offset;
+
         state->message_in_progress = true;
 }
 
@@ -242,23 +907,6 @@ add_message_c(struct pcx_avt_state *state,
         pcx_buffer_append_c(&state->message_buf, ch);
 }
 
-static void
-add_message_unichar(struct pcx_avt_state *state,
-                    uint32_t ch)
-{
-        ensure_message_in_progress(state);
-
-        pcx_buffer_ensure_size(&state->message_buf,
-                               state->message_buf.length +
-                               PCX_UTF8_MAX_CHAR_LENGTH);
-
-        int ch_length = pcx_utf8_encode(ch,
-                                        (char *)
-                                        state->message_buf.data +
-                                        state->message_buf.length);
-        state->message_buf.length += ch_length;
-}
-
 static void
 add_message_vprintf(struct pcx_avt_state *state,
                     const char *format,
@@ -284,10 +932,34 @@ static void
 end_message(struct pcx_avt_state *state)
 {
         ensure_message_in_progress(state);
+
+        size_t text_start = (state->message_start +
+                             offsetof(struct pcx_avt_state_message, text));
+        uint32_t length = state->message_buf.length - text_start;
+
         pcx_buffer_append_c(&state->message_buf, '\0');
-        pcx_buffer_set_length(&state->message_buf,
-                              align_message_start(state->message_buf.length));
         state->message_in_progress = false;
+
+        struct pcx_avt_state_message *message =
+                (struct pcx_avt_state_message *)
+                (state->message_buf.data + state->message_start);
+
+        message->length = length;
+
+        /* If an earlier message is still waiting in the queue then
+         * this one has to wait behind it so that the order is kept.
+         */
+        if (state->message_cb &&
+            state->message_buf_pos >= state->message_start &&
+            state->message_cb(message, state->message_cb_data)) {
+                pcx_buffer_set_length(&state->message_buf,
+                                      state->message_start);
+        } else {
+                pcx_buffer_set_length(&state->message_buf,
+                                      align_message_start(state->
+                                                          message_buf.
+                                                          length));
+        }
 }
 
 static PCX_PRINTF_FORMAT(2, 3) void
@@ -353,16 +1025,8 @@ static void
 add_word_to_message(struct pcx_avt_state *state,
                     const struct pcx_avt_command_word *word)
 {
-        struct pcx_avt_hat_iter iter;
-
-        pcx_avt_hat_iter_init(&iter, word->start, word->length);
-
-        while (!pcx_avt_hat_iter_finished(&iter)) {
-                uint32_t ch_upper = pcx_avt_hat_iter_next(&iter);
-                uint32_t ch = pcx_avt_hat_to_lower(ch_upper);
-
-                add_message_unichar(state, ch);
-        }
+        /* The word is already in lowercase with real hats */
+        add_message_data(state, word->start, word->length);
 }
 
 static void
@@ -465,8 +1129,7 @@ iterate_movables_in_list(struct pcx_avt_state *state,
 }
 
 static bool
-check_light_cb(struct pcx_avt_state_movable *movable,
-               void *user_data)
+is_light_source(const struct pcx_avt_state_movable *movable)
 {
         return (movable->type == PCX_AVT_STATE_MOVABLE_TYPE_OBJECT &&
                 (movable->base.attributes &
@@ -475,7 +1138,35 @@ check_light_cb(struct pcx_avt_state_movable *movable,
 }
 
 static bool
-check_light(struct pcx_avt_state *state)
+check_light_cb(struct pcx_avt_state_movable *movable,
+               void *user_data)
+{
+        return is_light_source(movable);
+}
+
+struct mark_present_closure {
+        struct pcx_avt_state *state;
+        bool found_light;
+};
+
+static bool
+mark_present_cb(struct pcx_avt_state_movable *movable,
+                void *user_data)
+{
+        struct mark_present_closure *closure = user_data;
+
+        closure->state->present_bits[movable->index / 32] |=
+                UINT32_C(1) << (movable->index % 32);
+
+        if (is_light_source(movable))
+                closure->found_light = true;
+
+        return false;
+}
+
+static bool
+room_is_lit(struct pcx_avt_state *state,
+            bool carrying_light)
 {
        struct pcx_avt_state_room *room = state->rooms + state->current_room;
 
@@ -485,32 +1176,74 @@ check_light(struct pcx_avt_state *state)
        if ((room->attributes & PCX_AVT_ROOM_ATTRIBUTE_UNLIGHTABLE))
                return false;
 
-       struct pcx_avt_state_movable *lit_movable;
+       if (carrying_light)
+               return true;
 
-       lit_movable = iterate_movables_in_list(state,
-                                              &state->carrying,
-                                              false, /* descend_closed */
-                                              check_light_cb,
-                                              NULL /* user_data */);
+       return iterate_movables_in_list(state,
+                                       &room->contents,
+                                       false, /* descend_closed */
+                                       check_light_cb,
+                                       NULL /* user_data */) != NULL;
+}
 
-       if (lit_movable)
-               return true;
+static void
+ensure_visibility(struct pcx_avt_state *state)
+{
+        if (state->visibility_valid)
+                return;
 
-       lit_movable = iterate_movables_in_list(state,
-                                              &room->contents,
-                                              false, /* descend_closed */
-                                              check_light_cb,
-                                              NULL /* user_data */);
+        memset(state->present_bits,
+               0,
+               (state->n_movables + 31) / 32 * sizeof (uint32_t));
 
-       if (lit_movable)
-               return true;
+        struct mark_present_closure closure = {
+                .state = state,
+                .found_light = false,
+        };
+
+        /* Everything that the player is carrying is present even if
+         * it is dark.
+         */
+        iterate_movables_in_list(state,
+                                 &state->carrying,
+                                 false, /* descend_closed */
+                                 mark_present_cb,
+                                 &closure);
 
-       return false;
+        state->room_is_lit = room_is_lit(state, closure.found_light);
+
+        if (state->room_is_lit) {
+                struct pcx_avt_state_room *room =
+                        state->rooms + state->current_room;
+
+                iterate_movables_in_list(state,
+                                         &room->contents,
+                                         false, /* descend_closed */
+                                         mark_present_cb,
+                                         &closure);
+        }
+
+        state->visibility_valid = true;
+}
+
+#ifdef ENABLE_CACHE_CHECKS
+
+static bool
+check_light_slow(struct pcx_avt_state *state)
+{
+       bool carrying_light =
+               iterate_movables_in_list(state,
+                                        &state->carrying,
+                                        false, /* descend_closed */
+                                        check_light_cb,
+                                        NULL /* user_data */) != NULL;
+
+       return room_is_lit(state, carrying_light);
 }
 
 static bool
-is_movable_present(struct pcx_avt_state *state,
-                   const struct pcx_avt_state_movable *base_movable)
+is_movable_present_slow(struct pcx_avt_state *state,
+                        const struct pcx_avt_state_movable *base_movable)
 {
         const struct pcx_avt_state_movable *movable = base_movable;
 
@@ -518,7 +1251,7 @@ is_movable_present(struct pcx_avt_state *state,
                 switch (movable->base.location_type) {
                 case PCX_AVT_LOCATION_TYPE_IN_ROOM:
                         return (movable->base.location == state->current_room &&
-                                check_light(state));
+                                check_light_slow(state));
                 case PCX_AVT_LOCATION_TYPE_CARRYING:
                         return true;
                 case PCX_AVT_LOCATION_TYPE_NOWHERE:
@@ -540,6 +1273,36 @@ is_movable_present(struct pcx_avt_state *state,
         }
 }
 
+#endif /* ENABLE_CACHE_CHECKS */
+
+static bool
+check_light(struct pcx_avt_state *state)
+{
+        ensure_visibility(state);
+
+#ifdef ENABLE_CACHE_CHECKS
+        assert(state->room_is_lit == check_light_slow(state));
+#endif
+
+        return state->room_is_lit;
+}
+
+static bool
+is_movable_present(struct pcx_avt_state *state,
+                   const struct pcx_avt_state_movable *movable)
+{
+        ensure_visibility(state);
+
+        bool present = ((state->present_bits[movable->index / 32] &
+                         (UINT32_C(1) << (movable->index % 32))) != 0);
+
+#ifdef ENABLE_CACHE_CHECKS
+        assert(present == is_movable_present_slow(state, movable));
+#endif
+
+        return present;
+}
+
 static bool
 movable_should_be_listed(const struct pcx_avt_state_movable *movable)
 {
@@ -593,7 +1356,60 @@ static void
 add_points(struct pcx_avt_state *state,
            int points)
 {
+        struct pcx_avt_state_journal_entry *entry =
+                add_journal_entry(state, PCX_AVT_STATE_JOURNAL_POINTS, 0);
+
+        if (entry)
+                entry->points = state->points;
+
         state->points += points;
+
+        if (points != 0)
+                send_points_event(state);
+}
+
+static void
+render_room_description(struct pcx_avt_state *state,
+                        const struct pcx_avt_state_room *room)
+{
+        add_message_string(state,
+                           state->avt->rooms[room - state->rooms].description);
+        add_room_contents_to_message(state, room);
+}
+
+static void
+add_room_description_to_message(struct pcx_avt_state *state,
+                                struct pcx_avt_state_room *room)
+{
+        struct pcx_buffer *cache = &room->description;
+
+        ensure_message_in_progress(state);
+
+        size_t start = state->message_buf.length;
+
+        if (cache->length > 0 && room->description_version == room->version) {
+                add_message_data(state, cache->data, cache->length);
+
+#ifdef ENABLE_CACHE_CHECKS
+                render_room_description(state, room);
+                assert(state->message_buf.length == start + cache->length * 2);
+                assert(!memcmp(state->message_buf.data + start,
+                               state->message_buf.data + start + cache->length,
+                               cache->length));
+                pcx_buffer_set_length(&state->message_buf,
+                                      start + cache->length);
+#endif
+
+                return;
+        }
+
+        render_room_description(state, room);
+
+        pcx_buffer_set_length(cache, 0);
+        pcx_buffer_append(cache,
+                          state->message_buf.data + start,
+                          state->message_buf.length - start);
+        room->description_version = room->version;
 }
 
 static void
@@ -606,13 +1422,7 @@ send_room_description(struct pcx_avt_state *state)
          */
         if ((room->attributes & PCX_AVT_ROOM_ATTRIBUTE_GAME_OVER) ||
             check_light(state)) {
-                const char *desc =
-                        state->avt->rooms[state->current_room].description;
-
-                add_message_string(state, desc);
-
-
-                add_room_contents_to_message(state, room);
+                add_room_description_to_message(state, room);
 
                 end_message(state);
 
@@ -621,77 +1431,257 @@ send_room_description(struct pcx_avt_state *state)
                 };
 
                 run_special_rules(state,
-                                  "priskrib",
+                                  PCX_AVT_SPECIAL_VERB_PRISKRIB,
                                   &data);
         } else {
                 send_message(state, "Estas mallume. Vi vidas nenion.");
         }
 
         if (!room->visited) {
+                journal_room(state, room - state->rooms);
                 add_points(state,
                            state->avt->rooms[state->current_room].points);
                 room->visited = true;
         }
 }
 
+static struct pcx_avt_state_name_entry *
+get_name_entries(struct pcx_avt_state *state)
+{
+        return (struct pcx_avt_state_name_entry *) state->name_entries.data;
+}
+
+static void
+add_name_to_index(struct pcx_avt_state *state,
+                  const struct pcx_avt_state_movable *movable,
+                  uint32_t word)
+{
+        int entry_num;
+
+        if (state->free_name_entry == -1) {
+                entry_num = (state->name_entries.length /
+                             sizeof (struct pcx_avt_state_name_entry));
+                pcx_buffer_set_length(&state->name_entries,
+                                      state->name_entries.length +
+                                      sizeof (struct
+                                              pcx_avt_state_name_entry));
+        } else {
+                entry_num = state->free_name_entry;
+                state->free_name_entry =
+                        get_name_entries(state)[entry_num].next;
+        }
+
+        struct pcx_avt_state_name_entry *entry =
+                get_name_entries(state) + entry_num;
+        int *bucket = (state->name_buckets +
+                       (word & (state->name_hash_size - 1)));
+
+        entry->word = word;
+        entry->movable = movable->index;
+        entry->next = *bucket;
+        *bucket = entry_num;
+}
+
+static void
+remove_name_from_index(struct pcx_avt_state *state,
+                       const struct pcx_avt_state_movable *movable,
+                       uint32_t word)
+{
+        struct pcx_avt_state_name_entry *entries = get_name_entries(state);
+        int *link = (state->name_buckets +
+                     (word & (state->name_hash_size - 1)));
+
+        while (*link != -1) {
+                int entry_num = *link;
+                struct pcx_avt_state_name_entry *entry = entries + entry_num;
+
+                if (entry->word == word && entry->movable == movable->index) {
+                        *link = entry->next;
+                        entry->next = state->free_name_entry;
+                        state->free_name_entry = entry_num;
+                        return;
+                }
+
+                link = &entry->next;
+        }
+}
+
+static void
+add_movable_to_name_index(struct pcx_avt_state *state,
+                          const struct pcx_avt_state_movable *movable)
+{
+        add_name_to_index(state, movable, movable->base.name_word);
+
+        for (size_t i = 0; i < movable->base.n_aliases; i++) {
+                add_name_to_index(state,
+                                  movable,
+                                  movable->base.aliases[i].name_word);
+        }
+}
+
+static void
+remove_movable_from_name_index(struct pcx_avt_state *state,
+                               const struct pcx_avt_state_movable *movable)
+{
+        remove_name_from_index(state, movable, movable->base.name_word);
+
+        for (size_t i = 0; i < movable->base.n_aliases; i++) {
+                remove_name_from_index(state,
+                                       movable,
+                                       movable->base.aliases[i].name_word);
+        }
+}
+
+static void
+init_name_index(struct pcx_avt_state *state)
+{
+        const struct pcx_avt *avt = state->avt;
+        size_t n_names = avt->n_objects + avt->n_monsters;
+
+        for (size_t i = 0; i < avt->n_objects; i++)
+                n_names += avt->objects[i].base.n_aliases;
+        for (size_t i = 0; i < avt->n_monsters; i++)
+                n_names += avt->monsters[i].base.n_aliases;
+
+        size_t size = 8;
+
+        while (size < n_names * 2)
+                size *= 2;
+
+        state->name_hash_size = size;
+        state->name_buckets = pcx_alloc(size * sizeof *state->name_buckets);
+
+        for (size_t i = 0; i < size; i++)
+                state->name_buckets[i] = -1;
+
+        pcx_buffer_init(&state->name_entries);
+        state->free_name_entry = -1;
+}
+
 static void
 init_movable(struct pcx_avt_state *state,
              struct pcx_avt_state_movable *movable)
 {
-        movable->base.name = pcx_strdup(movable->base.name);
-        movable->base.adjective =
-                movable->base.adjective ?
-                pcx_strdup(movable->base.adjective) :
-                NULL;
-
         pcx_list_init(&movable->contents);
+        movable->container = NULL;
+        movable->contents_weight = 0;
+        movable->contents_size = 0;
 
-        pcx_list_insert(state->all_movables.prev, &movable->all_node);
         pcx_list_insert(state->nowhere.prev, &movable->location_node);
+
+        add_movable_to_name_index(state, movable);
 }
 
 static void
 create_objects(struct pcx_avt_state *state)
 {
-        state->object_index =
-                pcx_alloc(state->avt->n_objects *
-                          sizeof (struct pcx_avt_state_movable *));
+        state->objects = state->movables;
 
         for (size_t i = 0; i < state->avt->n_objects; i++) {
-                struct pcx_avt_state_movable *movable =
-                        pcx_alloc(sizeof *movable);
-                state->object_index[i] = movable;
+                struct pcx_avt_state_movable *movable = state->objects + i;
                 movable->type = PCX_AVT_STATE_MOVABLE_TYPE_OBJECT;
+                movable->index = i;
+                movable->copied_from = i;
                 movable->object = state->avt->objects[i];
                 init_movable(state, movable);
+                update_timer(state, movable);
         }
 }
 
 static void
 create_monsters(struct pcx_avt_state *state)
 {
-        state->monster_index =
-                pcx_alloc(state->avt->n_monsters *
-                          sizeof (struct pcx_avt_state_movable *));
+        state->monsters = state->movables + state->avt->n_objects;
 
         for (size_t i = 0; i < state->avt->n_monsters; i++) {
-                struct pcx_avt_state_movable *movable =
-                        pcx_alloc(sizeof *movable);
-                state->monster_index[i] = movable;
+                struct pcx_avt_state_movable *movable = state->monsters + i;
                 movable->type = PCX_AVT_STATE_MOVABLE_TYPE_MONSTER;
+                movable->index = state->avt->n_objects + i;
+                movable->copied_from = movable->index;
                 movable->monster = state->avt->monsters[i];
                 init_movable(state, movable);
         }
 }
 
+static int
+get_own_weight(const struct pcx_avt_state_movable *movable)
+{
+        if (movable->type == PCX_AVT_STATE_MOVABLE_TYPE_OBJECT)
+                return movable->object.weight;
+        else
+                return 0;
+}
+
+static int
+get_own_size(const struct pcx_avt_state_movable *movable)
+{
+        if (movable->type == PCX_AVT_STATE_MOVABLE_TYPE_OBJECT)
+                return movable->object.size;
+        else
+                return 0;
+}
+
+static int
+get_weight_of_movable(const struct pcx_avt_state_movable *movable)
+{
+        return get_own_weight(movable) + movable->contents_weight;
+}
+
+/* Adds the weight and size of the movable to the totals of everything
+ * that contains it. This should be called with sign set to -1 before
+ * the movable is moved or its stats are changed and then again with
+ * sign set to 1 afterwards.
+ */
+static void
+update_container_totals(struct pcx_avt_state *state,
+                        struct pcx_avt_state_movable *base_movable,
+                        int sign)
+{
+        struct pcx_avt_state_movable *movable = base_movable;
+        int weight = sign * get_weight_of_movable(movable);
+        int size = sign * get_own_size(movable);
+
+        if (movable->container)
+                movable->container->contents_size += size;
+        else if (movable->base.location_type == PCX_AVT_LOCATION_TYPE_CARRYING)
+                state->carrying_size += size;
+
+        /* Rules can put a container inside itself, so the walk also
+         * stops if it goes round a loop that doesn’t include the base
+         * movable. The chain can’t be longer than the number of
+         * movables without repeating one.
+         */
+        for (size_t depth = 0;
+             movable->container && depth < state->n_movables;
+             depth++) {
+                if (movable->container == movable)
+                        return;
+                movable = movable->container;
+                if (movable == base_movable)
+                        return;
+                movable->contents_weight += weight;
+        }
+
+        if (movable->base.location_type == PCX_AVT_LOCATION_TYPE_CARRYING)
+                state->carrying_weight += weight;
+}
+
 static void
 disappear_movable(struct pcx_avt_state *state,
                   struct pcx_avt_state_movable *movable)
 {
+        journal_location(state, movable);
+        invalidate_room_description(state, movable);
+        update_container_totals(state, movable, -1);
         pcx_list_remove(&movable->location_node);
         pcx_list_insert(state->nowhere.prev, &movable->location_node);
         movable->container = NULL;
         movable->base.location_type = PCX_AVT_LOCATION_TYPE_NOWHERE;
+        update_container_totals(state, movable, 1);
+        invalidate_room_description(state, movable);
+        invalidate_visibility(state);
+        input_changed(state, PCX_AVT_RULE_INPUT_MOVABLES);
+        send_moved_event(state, movable);
 }
 
 static void
@@ -701,21 +1691,37 @@ put_movable_in_room(struct pcx_avt_state *state,
 {
         struct pcx_avt_state_room *room = state->rooms + room_number;
 
+        journal_location(state, movable);
+        invalidate_room_description(state, movable);
+        update_container_totals(state, movable, -1);
         pcx_list_remove(&movable->location_node);
         pcx_list_insert(room->contents.prev, &movable->location_node);
         movable->container = NULL;
         movable->base.location_type = PCX_AVT_LOCATION_TYPE_IN_ROOM;
         movable->base.location = room_number;
+        update_container_totals(state, movable, 1);
+        invalidate_room_description(state, movable);
+        invalidate_visibility(state);
+        input_changed(state, PCX_AVT_RULE_INPUT_MOVABLES);
+        send_moved_event(state, movable);
 }
 
 static void
 carry_movable(struct pcx_avt_state *state,
               struct pcx_avt_state_movable *movable)
 {
+        journal_location(state, movable);
+        invalidate_room_description(state, movable);
+        update_container_totals(state, movable, -1);
         pcx_list_remove(&movable->location_node);
         pcx_list_insert(state->carrying.prev, &movable->location_node);
         movable->container = NULL;
         movable->base.location_type = PCX_AVT_LOCATION_TYPE_CARRYING;
+        update_container_totals(state, movable, 1);
+        invalidate_room_description(state, movable);
+        invalidate_visibility(state);
+        input_changed(state, PCX_AVT_RULE_INPUT_MOVABLES);
+        send_moved_event(state, movable);
 }
 
 static void
@@ -723,6 +1729,9 @@ reparent_movable(struct pcx_avt_state *state,
                  struct pcx_avt_state_movable *parent,
                  struct pcx_avt_state_movable *movable)
 {
+        journal_location(state, movable);
+        invalidate_room_description(state, movable);
+        update_container_totals(state, movable, -1);
         pcx_list_remove(&movable->location_node);
         pcx_list_insert(parent->contents.prev, &movable->location_node);
         movable->container = parent;
@@ -737,6 +1746,12 @@ reparent_movable(struct pcx_avt_state *state,
                         PCX_AVT_LOCATION_TYPE_WITH_MONSTER;
                 break;
         }
+
+        update_container_totals(state, movable, 1);
+        invalidate_room_description(state, movable);
+        invalidate_visibility(state);
+        input_changed(state, PCX_AVT_RULE_INPUT_MOVABLES);
+        send_moved_event(state, movable);
 }
 
 static void
@@ -744,557 +1759,516 @@ replace_movable(struct pcx_avt_state *state,
                 struct pcx_avt_state_movable *old,
                 struct pcx_avt_state_movable *new)
 {
+        journal_location(state, new);
+        invalidate_room_description(state, new);
+        update_container_totals(state, new, -1);
         pcx_list_remove(&new->location_node);
         /* Put the new object in whatever list the old one is */
         pcx_list_insert(&old->location_node, &new->location_node);
         new->base.location_type = old->base.location_type;
         new->base.location = old->base.location;
         new->container = old->container;
+        update_container_totals(state, new, 1);
+        invalidate_room_description(state, new);
+        send_moved_event(state, new);
         disappear_movable(state, old);
 }
 
 static void
-copy_movable(struct pcx_avt_state_movable *dst,
+copy_movable(struct pcx_avt_state *state,
+             struct pcx_avt_state_movable *dst,
              const struct pcx_avt_state_movable *src)
 {
         if (dst == src)
                 return;
 
-        pcx_free(dst->base.adjective);
-        pcx_free(dst->base.name);
+        journal_movable(state, dst);
+        remove_movable_from_name_index(state, dst);
+        update_container_totals(state, dst, -1);
+
+        /* The copy stays where it is so its location has to be kept
+         * in sync with the list it is in.
+         */
+        enum pcx_avt_location_type location_type = dst->base.location_type;
+        uint8_t location = dst->base.location;
+
         memcpy(&dst->base,
                &src->base,
                sizeof (*dst) - offsetof(struct pcx_avt_state_movable, base));
         dst->type = src->type;
-        dst->base.adjective =
-                dst->base.adjective ?
-                pcx_strdup(dst->base.adjective) :
-                NULL;
-        dst->base.name = pcx_strdup(dst->base.name);
-}
-
-static bool
-adjective_is_same(const char *a,
-                  const char *b)
-{
-        if (a == NULL)
-                return b == NULL;
-        if (b == NULL)
-                return false;
-        return !strcmp(a, b);
-}
-
-static bool
-check_condition(struct pcx_avt_state *state,
-                const struct pcx_avt_condition_data *condition,
-                struct pcx_avt_state_movable *movable,
-                int room)
-{
-        switch (condition->condition) {
-        case PCX_AVT_CONDITION_IN_ROOM:
-                return room == condition->data;
-        case PCX_AVT_CONDITION_OBJECT_IS:
-                return movable == state->object_index[condition->data];
-        case PCX_AVT_CONDITION_ANOTHER_OBJECT_PRESENT:
-                return is_movable_present(state,
-                                          state->object_index[condition->data]);
-        case PCX_AVT_CONDITION_MONSTER_IS:
-                return movable == state->monster_index[condition->data];
-        case PCX_AVT_CONDITION_ANOTHER_MONSTER_PRESENT:
-                movable = state->monster_index[condition->data];
-                return is_movable_present(state, movable);
-        case PCX_AVT_CONDITION_SHOTS:
-                return (movable &&
-                        movable->type == PCX_AVT_STATE_MOVABLE_TYPE_OBJECT &&
-                        movable->object.shots >= condition->data);
-        case PCX_AVT_CONDITION_WEIGHT:
-                return (movable &&
-                        movable->type == PCX_AVT_STATE_MOVABLE_TYPE_OBJECT &&
-                        movable->object.weight >= condition->data);
-        case PCX_AVT_CONDITION_SIZE:
-                return (movable &&
-                        movable->type == PCX_AVT_STATE_MOVABLE_TYPE_OBJECT &&
-                        movable->object.size >= condition->data);
-        case PCX_AVT_CONDITION_CONTAINER_SIZE:
-                return (movable &&
-                        movable->type == PCX_AVT_STATE_MOVABLE_TYPE_OBJECT &&
-                        movable->object.container_size >= condition->data);
-        case PCX_AVT_CONDITION_BURN_TIME:
-                return (movable &&
-                        movable->type == PCX_AVT_STATE_MOVABLE_TYPE_OBJECT &&
-                        movable->object.burn_time >= condition->data);
-        case PCX_AVT_CONDITION_SOMETHING:
-                return movable != NULL;
-        case PCX_AVT_CONDITION_NOTHING:
-                return movable == NULL;
-        case PCX_AVT_CONDITION_NONE:
-                return true;
-        case PCX_AVT_CONDITION_OBJECT_ATTRIBUTE:
-                return (movable &&
-                        movable->type == PCX_AVT_STATE_MOVABLE_TYPE_OBJECT &&
-                        (movable->base.attributes & (1 << condition->data)));
-        case PCX_AVT_CONDITION_NOT_OBJECT_ATTRIBUTE:
-                return (movable &&
-                        movable->type == PCX_AVT_STATE_MOVABLE_TYPE_OBJECT &&
-                        (movable->base.attributes &
-                         (1 << condition->data)) == 0);
-        case PCX_AVT_CONDITION_ROOM_ATTRIBUTE:
-                return (state->rooms[room].attributes &
-                        (1 << condition->data));
-        case PCX_AVT_CONDITION_NOT_ROOM_ATTRIBUTE:
-                return (state->rooms[room].attributes &
-                        (1 << condition->data)) == 0;
-        case PCX_AVT_CONDITION_MONSTER_ATTRIBUTE:
-                return (movable &&
-                        movable->type == PCX_AVT_STATE_MOVABLE_TYPE_MONSTER &&
-                        (movable->base.attributes & (1 << condition->data)));
-        case PCX_AVT_CONDITION_NOT_MONSTER_ATTRIBUTE:
-                return (movable &&
-                        movable->type == PCX_AVT_STATE_MOVABLE_TYPE_MONSTER &&
-                        (movable->base.attributes &
-                         (1 << condition->data)) == 0);
-        case PCX_AVT_CONDITION_PLAYER_ATTRIBUTE:
-                return (state->game_attributes & (1 << condition->data));
-        case PCX_AVT_CONDITION_NOT_PLAYER_ATTRIBUTE:
-                return (state->game_attributes & (1 << condition->data)) == 0;
-        case PCX_AVT_CONDITION_CHANCE:
-                return get_random(state) < condition->data;
-        case PCX_AVT_CONDITION_OBJECT_SAME_ADJECTIVE:
-                return (movable &&
-                        adjective_is_same(movable->base.adjective,
-                                          state->object_index[condition->data]->
-                                          base.adjective));
-        case PCX_AVT_CONDITION_OBJECT_SAME_NAME:
-                return (movable &&
-                        !strcmp(movable->base.name,
-                                state->object_index[condition->data]->
-                                base.name));
-        case PCX_AVT_CONDITION_OBJECT_SAME_NOUN:
-                return (movable &&
-                        adjective_is_same(movable->base.adjective,
-                                          state->object_index[condition->data]->
-                                          base.adjective) &&
-                        !strcmp(movable->base.name,
-                                state->object_index[condition->data]->
-                                base.name));
-        case PCX_AVT_CONDITION_MONSTER_SAME_ADJECTIVE:
-                return (movable &&
-                        adjective_is_same(movable->base.adjective,
-                                          state->
-                                          monster_index[condition->data]->
-                                          base.adjective));
-        case PCX_AVT_CONDITION_MONSTER_SAME_NAME:
-                return (movable &&
-                        !strcmp(movable->base.name,
-                                state->monster_index[condition->data]->
-                                base.name));
-        case PCX_AVT_CONDITION_MONSTER_SAME_NOUN:
-                return (movable &&
-                        adjective_is_same(movable->base.adjective,
-                                          state->
-                                          monster_index[condition->data]->
-                                          base.adjective) &&
-                        !strcmp(movable->base.name,
-                                state->monster_index[condition->data]->
-                                base.name));
-        }
-
-        return false;
+        dst->copied_from = src->copied_from;
+        dst->base.location_type = location_type;
+        dst->base.location = location;
+
+        add_movable_to_name_index(state, dst);
+        update_container_totals(state, dst, 1);
+        invalidate_room_description(state, dst);
+
+        invalidate_visibility(state);
+        input_changed(state, PCX_AVT_RULE_INPUT_MOVABLES);
+        update_timer(state, dst);
+        update_monster_schedule(state, dst);
+        send_movable_changed_event(state, dst);
 }
 
 static void
-execute_action(struct pcx_avt_state *state,
-               const struct pcx_avt_action_data *action,
-               bool is_room,
-               struct pcx_avt_state_movable *movable,
-               const struct pcx_avt_state_run_rule_data *data)
+get_rule_subjects(const struct pcx_avt_state_run_rule_data *data,
+                  struct pcx_avt_state_movable **subjects)
 {
-        switch (action->action) {
-        case PCX_AVT_ACTION_MOVE_TO:
-                /* If the action is the room action then the player
-                 * moves, otherwise the object moves.
-                 */
-                if (is_room) {
-                        if (state->current_room != action->data) {
-                                state->current_room = action->data;
-                                send_room_description(state);
-                        }
-                } else {
-                        put_movable_in_room(state,
-                                            action->data,
-                                            movable);
-                }
-                break;
+        subjects[PCX_AVT_RULE_SUBJECT_ROOM] = data->command_object;
+        subjects[PCX_AVT_RULE_SUBJECT_OBJECT] = data->object;
+        subjects[PCX_AVT_RULE_SUBJECT_TOOL] = data->tool;
+        subjects[PCX_AVT_RULE_SUBJECT_MONSTER] = data->monster;
+        subjects[PCX_AVT_RULE_SUBJECT_DIRECTION] = data->direction;
+        subjects[PCX_AVT_RULE_SUBJECT_IN] = data->in;
+}
 
-        case PCX_AVT_ACTION_MOVE_INTO:
-                if (movable) {
-                        reparent_movable(state,
-                                         state->object_index[action->data],
-                                         movable);
-                }
-                break;
+static bool
+is_object(const struct pcx_avt_state_movable *movable)
+{
+        return (movable &&
+                movable->type == PCX_AVT_STATE_MOVABLE_TYPE_OBJECT);
+}
 
-        case PCX_AVT_ACTION_REPLACE_OBJECT_IN_ROOM:
-        case PCX_AVT_ACTION_REPLACE_OBJECT_IN_ROOM_2:
-                /* Despite the documentation, in testing with the
-                 * original interpreter these actions seem to do
-                 * exactly the same thing. If there is an object then
-                 * it disappears. The referenced object appears in the
-                 * room, even if the original object was being held by
-                 * the player.
-                 */
-                if (movable)
-                        disappear_movable(state, movable);
+static bool
+is_monster(const struct pcx_avt_state_movable *movable)
+{
+        return (movable &&
+                movable->type == PCX_AVT_STATE_MOVABLE_TYPE_MONSTER);
+}
 
-                put_movable_in_room(state,
-                                    data->room,
-                                    state->object_index[action->data]);
+static uint8_t *
+get_object_stat(struct pcx_avt_state_movable *movable,
+                unsigned offset)
+{
+        return (uint8_t *) &movable->object + offset;
+}
 
-                break;
+static bool
+check_conditions(struct pcx_avt_state *state,
+                 const struct pcx_avt_instruction *code,
+                 struct pcx_avt_state_movable * const *subjects,
+                 int room)
+{
+        for (const struct pcx_avt_instruction *ins = code; ; ins++) {
+                struct pcx_avt_state_movable *movable =
+                        subjects[ins->subject];
+                const struct pcx_avt_state_movable *other;
 
-        case PCX_AVT_ACTION_REPLACE_OBJECT:
-                if (movable) {
-                        struct pcx_avt_state_movable *o =
-                                state->object_index[action->data];
-                        replace_movable(state, movable, o);
+                switch ((enum pcx_avt_opcode) ins->op) {
+                case PCX_AVT_OP_END:
+                        return true;
+                case PCX_AVT_OP_IN_ROOM:
+                        if (room != ins->arg)
+                                return false;
+                        break;
+                case PCX_AVT_OP_IS_MOVABLE:
+                        if (movable != state->movables + ins->arg)
+                                return false;
+                        break;
+                case PCX_AVT_OP_MOVABLE_PRESENT:
+                        other = state->movables + ins->arg;
+                        if (!is_movable_present(state, other))
+                                return false;
+                        break;
+                case PCX_AVT_OP_OBJECT_STAT_AT_LEAST:
+                        if (!is_object(movable) ||
+                            *get_object_stat(movable, ins->arg) < ins->value)
+                                return false;
+                        break;
+                case PCX_AVT_OP_SOMETHING:
+                        if (movable == NULL)
+                                return false;
+                        break;
+                case PCX_AVT_OP_NOTHING:
+                        if (movable != NULL)
+                                return false;
+                        break;
+                case PCX_AVT_OP_OBJECT_ATTRIBUTE:
+                        if (!is_object(movable) ||
+                            (movable->base.attributes & ins->value) == 0)
+                                return false;
+                        break;
+                case PCX_AVT_OP_NOT_OBJECT_ATTRIBUTE:
+                        if (!is_object(movable) ||
+                            (movable->base.attributes & ins->value))
+                                return false;
+                        break;
+                case PCX_AVT_OP_MONSTER_ATTRIBUTE:
+                        if (!is_monster(movable) ||
+                            (movable->base.attributes & ins->value) == 0)
+                                return false;
+                        break;
+                case PCX_AVT_OP_NOT_MONSTER_ATTRIBUTE:
+                        if (!is_monster(movable) ||
+                            (movable->base.attributes & ins->value))
+                                return false;
+                        break;
+                case PCX_AVT_OP_ROOM_ATTRIBUTE:
+                        if ((state->rooms[room].attributes & ins->value) == 0)
+                                return false;
+                        break;
+                case PCX_AVT_OP_NOT_ROOM_ATTRIBUTE:
+                        if ((state->rooms[room].attributes & ins->value))
+                                return false;
+                        break;
+                case PCX_AVT_OP_PLAYER_ATTRIBUTE:
+                        if ((state->game_attributes & ins->value) == 0)
+                                return false;
+                        break;
+                case PCX_AVT_OP_NOT_PLAYER_ATTRIBUTE:
+                        if ((state->game_attributes & ins->value))
+                                return false;
+                        break;
+                case PCX_AVT_OP_CHANCE:
+                        if (get_random(state) >= (int) ins->value)
+                                return false;
+                        break;
+                case PCX_AVT_OP_SAME_ADJECTIVE:
+                        other = state->movables + ins->arg;
+                        if (movable == NULL ||
+                            movable->base.adjective_word !=
+                            other->base.adjective_word)
+                                return false;
+                        break;
+                case PCX_AVT_OP_SAME_NAME:
+                        other = state->movables + ins->arg;
+                        if (movable == NULL ||
+                            movable->base.name_word != other->base.name_word)
+                                return false;
+                        break;
+                case PCX_AVT_OP_SAME_NOUN:
+                        other = state->movables + ins->arg;
+                        if (movable == NULL ||
+                            movable->base.adjective_word !=
+                            other->base.adjective_word ||
+                            movable->base.name_word != other->base.name_word)
+                                return false;
+                        break;
+                default:
+                        return false;
                 }
-                break;
+        }
+}
 
-        case PCX_AVT_ACTION_REPLACE_MONSTER_IN_ROOM:
-        case PCX_AVT_ACTION_REPLACE_MONSTER_IN_ROOM_2:
-                if (movable)
-                        disappear_movable(state, movable);
+/* Uses up one of the steps that the command is allowed. Returns
+ * false if there are none left.
+ */
+static bool
+use_step(struct pcx_avt_state *state)
+{
+        if (state->out_of_steps)
+                return false;
 
-                put_movable_in_room(state,
-                                    data->room,
-                                    state->monster_index[action->data]);
+        if (state->step_limit > 0 && ++state->n_steps > state->step_limit) {
+                state->out_of_steps = true;
+                return false;
+        }
 
-                break;
+        return true;
+}
 
-        case PCX_AVT_ACTION_ANOTHER_OBJECT_APPEAR:
-                put_movable_in_room(state,
-                                    data->room,
-                                    state->object_index[action->data]);
-                break;
+/* Executes the actions starting from *ins_ptr until either the end of
+ * the code or an action that runs another rule. In the latter case
+ * the rule is returned and *ins_ptr is updated to point to the next
+ * action so that the caller can continue once the other rule has
+ * finished. Otherwise it returns NULL.
+ */
+static const struct pcx_avt_rule *
+execute_actions(struct pcx_avt_state *state,
+                const struct pcx_avt_instruction **ins_ptr,
+                struct pcx_avt_state_movable * const *subjects,
+                const struct pcx_avt_state_run_rule_data *data)
+{
+        for (const struct pcx_avt_instruction *ins = *ins_ptr; ; ins++) {
+                struct pcx_avt_state_movable *movable =
+                        subjects[ins->subject];
+                struct pcx_avt_state_movable *other;
+                uint32_t attributes;
 
-        case PCX_AVT_ACTION_CHANGE_END:
-                if (movable &&
-                    movable->type == PCX_AVT_STATE_MOVABLE_TYPE_OBJECT) {
-                        movable->object.end = action->data;
-                }
-                break;
-        case PCX_AVT_ACTION_CHANGE_SHOTS:
-                if (movable &&
-                    movable->type == PCX_AVT_STATE_MOVABLE_TYPE_OBJECT) {
-                        movable->object.shots = action->data;
-                }
-                break;
-        case PCX_AVT_ACTION_CHANGE_WEIGHT:
-                if (movable &&
-                    movable->type == PCX_AVT_STATE_MOVABLE_TYPE_OBJECT) {
-                        movable->object.weight = action->data;
-                }
-                break;
-        case PCX_AVT_ACTION_CHANGE_SIZE:
-                if (movable &&
-                    movable->type == PCX_AVT_STATE_MOVABLE_TYPE_OBJECT) {
-                        movable->object.size = action->data;
-                }
-                break;
-        case PCX_AVT_ACTION_CHANGE_CONTAINER_SIZE:
-                if (movable &&
-                    movable->type == PCX_AVT_STATE_MOVABLE_TYPE_OBJECT) {
-                        movable->object.container_size = action->data;
-                }
-                break;
-        case PCX_AVT_ACTION_CHANGE_BURN_TIME:
-                if (movable &&
-                    movable->type == PCX_AVT_STATE_MOVABLE_TYPE_OBJECT) {
-                        movable->object.burn_time = action->data;
-                }
-                break;
-        case PCX_AVT_ACTION_SOMETHING:
-                break;
-        case PCX_AVT_ACTION_NOTHING:
-                if (movable)
-                        disappear_movable(state, movable);
-                break;
-        case PCX_AVT_ACTION_NOTHING_ROOM:
-                break;
-        case PCX_AVT_ACTION_CARRY:
-                /* The original interpreter seems to make the object
-                 * disappear if you use this. Is that a bug? That
-                 * doesn’t seem very useful so let’s just make it do
-                 * what it seems like it should do.
+                /* The end of the code isn’t an action so it doesn’t
+                 * use a step.
                  */
-                if (movable &&
-                    movable->type == PCX_AVT_STATE_MOVABLE_TYPE_OBJECT)
-                        carry_movable(state, movable);
-                break;
-        case PCX_AVT_ACTION_CARRY_ANOTHER_OBJECT:
-                carry_movable(state, state->object_index[action->data]);
-                break;
-        case PCX_AVT_ACTION_SET_OBJECT_ATTRIBUTE:
-                if (movable &&
-                    movable->type == PCX_AVT_STATE_MOVABLE_TYPE_OBJECT)
-                        movable->base.attributes |= 1 << action->data;
-                break;
-        case PCX_AVT_ACTION_UNSET_OBJECT_ATTRIBUTE:
-                if (movable &&
-                    movable->type == PCX_AVT_STATE_MOVABLE_TYPE_OBJECT)
-                        movable->base.attributes &= ~(1 << action->data);
-                break;
-        case PCX_AVT_ACTION_SET_ROOM_ATTRIBUTE:
-                state->rooms[data->room].attributes |=
-                        1 << action->data;
-                break;
-        case PCX_AVT_ACTION_UNSET_ROOM_ATTRIBUTE:
-                state->rooms[data->room].attributes &=
-                        ~(1 << action->data);
-                break;
-        case PCX_AVT_ACTION_SET_MONSTER_ATTRIBUTE:
-                if (movable &&
-                    movable->type == PCX_AVT_STATE_MOVABLE_TYPE_MONSTER)
-                        movable->base.attributes |= 1 << action->data;
-                break;
-        case PCX_AVT_ACTION_UNSET_MONSTER_ATTRIBUTE:
-                if (movable &&
-                    movable->type == PCX_AVT_STATE_MOVABLE_TYPE_MONSTER)
-                        movable->base.attributes &= ~(1 << action->data);
-                break;
-        case PCX_AVT_ACTION_SET_PLAYER_ATTRIBUTE:
-                state->game_attributes |= 1 << action->data;
-                break;
-        case PCX_AVT_ACTION_UNSET_PLAYER_ATTRIBUTE:
-                state->game_attributes &= ~(1 << action->data);
-                break;
-        case PCX_AVT_ACTION_CHANGE_OBJECT_ADJECTIVE:
-                if (movable) {
-                        pcx_free(movable->base.adjective);
-                        const struct pcx_avt_state_movable *other =
-                                state->object_index[action->data];
-                        movable->base.adjective =
-                                other->base.adjective ?
-                                pcx_strdup(other->base.adjective) :
-                                NULL;
-                }
-                break;
-        case PCX_AVT_ACTION_CHANGE_MONSTER_ADJECTIVE:
-                if (movable) {
-                        pcx_free(movable->base.adjective);
-                        const struct pcx_avt_state_movable *other =
-                                state->monster_index[action->data];
-                        movable->base.adjective =
-                                other->base.adjective ?
-                                pcx_strdup(other->base.adjective) :
-                                NULL;
-                }
-                break;
-        case PCX_AVT_ACTION_CHANGE_OBJECT_NAME:
-                if (movable) {
-                        pcx_free(movable->base.name);
-                        const struct pcx_avt_state_movable *other =
-                                state->object_index[action->data];
-                        movable->base.name =
-                                pcx_strdup(other->base.name);
-                }
-                break;
-        case PCX_AVT_ACTION_CHANGE_MONSTER_NAME:
-                if (movable) {
-                        pcx_free(movable->base.name);
-                        const struct pcx_avt_state_movable *other =
-                                state->monster_index[action->data];
-                        movable->base.name =
-                                pcx_strdup(other->base.name);
-                }
-                break;
-        case PCX_AVT_ACTION_COPY_OBJECT:
-                if (movable) {
-                        copy_movable(movable,
-                                     state->object_index[action->data]);
-                }
-                break;
-        case PCX_AVT_ACTION_COPY_MONSTER:
-                if (movable) {
-                        copy_movable(movable,
-                                     state->monster_index[action->data]);
-                }
-                break;
-        case PCX_AVT_ACTION_RUN_RULE:
-                run_rule_actions(state,
-                                 state->avt->rules + action->data,
-                                 data);
-                break;
-        }
-}
+                if (ins->op == PCX_AVT_OP_END)
+                        return NULL;
 
-static void
-send_rule_message(struct pcx_avt_state *state,
-                  const char *text,
-                  const struct pcx_avt_state_run_rule_data *data)
-{
-        bool present = data->room == state->current_room;
+                if (!use_step(state))
+                        return NULL;
 
-        while (true) {
-                const char *dollar = strchr(text, '$');
+                switch ((enum pcx_avt_opcode) ins->op) {
+                case PCX_AVT_OP_MOVE_PLAYER:
+                        if (state->current_room != ins->arg) {
+                                set_current_room(state, ins->arg);
+                                send_room_description(state);
+                        }
+                        break;
 
-                if (dollar == NULL)
+                case PCX_AVT_OP_MOVE_TO_ROOM:
+                        if (movable)
+                                put_movable_in_room(state, ins->arg, movable);
                         break;
 
-                if (present)
-                        add_message_data(state, text, dollar - text);
+                case PCX_AVT_OP_MOVE_INTO:
+                        if (movable) {
+                                reparent_movable(state,
+                                                 state->movables + ins->arg,
+                                                 movable);
+                        }
+                        break;
 
-                switch (dollar[1]) {
-                case '\0':
-                        goto done;
-                case 'A':
-                        if (data->object) {
-                                const char *suffix = NULL;
+                case PCX_AVT_OP_REPLACE_IN_ROOM:
+                        /* Despite the documentation, in testing with
+                         * the original interpreter the two versions
+                         * of these actions seem to do exactly the same
+                         * thing. If there is an object then it
+                         * disappears. The referenced object appears in
+                         * the room, even if the original object was
+                         * being held by the player.
+                         */
+                        if (movable)
+                                disappear_movable(state, movable);
 
-                                if (dollar[2] == 'n') {
-                                        suffix = "n";
-                                        dollar++;
-                                }
+                        put_movable_in_room(state,
+                                            data->room,
+                                            state->movables + ins->arg);
+                        break;
 
-                                if (present) {
-                                        struct pcx_avt_state_movable *o =
-                                                data->object;
-                                        add_movable_to_message(state,
-                                                               &o->base,
-                                                               suffix);
-                                }
+                case PCX_AVT_OP_REPLACE:
+                        if (movable) {
+                                other = state->movables + ins->arg;
+                                replace_movable(state, movable, other);
                         }
                         break;
-                case 'P':
-                        if (data->tool) {
-                                const char *suffix = NULL;
 
-                                if (dollar[2] == 'n') {
-                                        suffix = "n";
-                                        dollar++;
-                                }
+                case PCX_AVT_OP_APPEAR:
+                        put_movable_in_room(state,
+                                            data->room,
+                                            state->movables + ins->arg);
+                        break;
 
-                                if (present) {
-                                        struct pcx_avt_state_movable *t =
-                                                data->tool;
-                                        add_movable_to_message(state,
-                                                               &t->base,
-                                                               suffix);
-                                }
+                case PCX_AVT_OP_SET_OBJECT_STAT:
+                        if (is_object(movable)) {
+                                uint8_t *stat =
+                                        get_object_stat(movable, ins->arg);
+                                journal_movable(state, movable);
+                                update_container_totals(state, movable, -1);
+                                *stat = ins->value;
+                                update_container_totals(state, movable, 1);
+                                update_timer(state, movable);
                         }
                         break;
-                case 'M':
-                        if (data->monster) {
-                                const char *suffix = NULL;
-
-                                if (dollar[2] == 'n') {
-                                        suffix = "n";
-                                        dollar++;
-                                }
-
-                                if (present) {
-                                        struct pcx_avt_state_movable *m =
-                                                data->monster;
-                                        add_movable_to_message(state,
-                                                               &m->base,
-                                                               suffix);
-                                }
+                case PCX_AVT_OP_DISAPPEAR:
+                        if (movable)
+                                disappear_movable(state, movable);
+                        break;
+                case PCX_AVT_OP_CARRY:
+                        /* The original interpreter seems to make the
+                         * object disappear if you use this. Is that a
+                         * bug? That doesn’t seem very useful so let’s
+                         * just make it do what it seems like it should
+                         * do.
+                         */
+                        if (is_object(movable))
+                                carry_movable(state, movable);
+                        break;
+                case PCX_AVT_OP_CARRY_MOVABLE:
+                        carry_movable(state, state->movables + ins->arg);
+                        break;
+                case PCX_AVT_OP_SET_OBJECT_ATTRIBUTE:
+                        if (is_object(movable)) {
+                                attributes = (movable->base.attributes |
+                                              ins->value);
+                                set_movable_attributes(state,
+                                                       movable,
+                                                       attributes);
                         }
                         break;
-                case 'E':
-                        if (data->in) {
-                                const char *suffix = NULL;
-
-                                if (dollar[2] == 'n') {
-                                        suffix = "n";
-                                        dollar++;
-                                }
-
-                                if (present) {
-                                        struct pcx_avt_state_movable *e =
-                                                data->in;
-                                        add_movable_to_message(state,
-                                                               &e->base,
-                                                               suffix);
-                                }
+                case PCX_AVT_OP_UNSET_OBJECT_ATTRIBUTE:
+                        if (is_object(movable)) {
+                                attributes = (movable->base.attributes &
+                                              ~ins->value);
+                                set_movable_attributes(state,
+                                                       movable,
+                                                       attributes);
+                        }
+                        break;
+                case PCX_AVT_OP_SET_ROOM_ATTRIBUTE:
+                        set_room_attributes(state,
+                                            data->room,
+                                            state->rooms[data->room].
+                                            attributes | ins->value);
+                        break;
+                case PCX_AVT_OP_UNSET_ROOM_ATTRIBUTE:
+                        set_room_attributes(state,
+                                            data->room,
+                                            state->rooms[data->room].
+                                            attributes & ~ins->value);
+                        break;
+                case PCX_AVT_OP_SET_MONSTER_ATTRIBUTE:
+                        if (is_monster(movable)) {
+                                attributes = (movable->base.attributes |
+                                              ins->value);
+                                set_movable_attributes(state,
+                                                       movable,
+                                                       attributes);
+                        }
+                        break;
+                case PCX_AVT_OP_UNSET_MONSTER_ATTRIBUTE:
+                        if (is_monster(movable)) {
+                                attributes = (movable->base.attributes &
+                                              ~ins->value);
+                                set_movable_attributes(state,
+                                                       movable,
+                                                       attributes);
+                        }
+                        break;
+                case PCX_AVT_OP_SET_PLAYER_ATTRIBUTE:
+                        set_game_attributes(state,
+                                            state->game_attributes |
+                                            ins->value);
+                        break;
+                case PCX_AVT_OP_UNSET_PLAYER_ATTRIBUTE:
+                        set_game_attributes(state,
+                                            state->game_attributes &
+                                            ~(uint64_t) ins->value);
+                        break;
+                case PCX_AVT_OP_CHANGE_ADJECTIVE:
+                        if (movable) {
+                                other = state->movables + ins->arg;
+                                journal_movable(state, movable);
+                                movable->base.adjective =
+                                        other->base.adjective;
+                                movable->base.adjective_word =
+                                        other->base.adjective_word;
+                                invalidate_room_description(state, movable);
+                                send_movable_changed_event(state, movable);
+                        }
+                        break;
+                case PCX_AVT_OP_CHANGE_NAME:
+                        if (movable) {
+                                other = state->movables + ins->arg;
+                                journal_movable(state, movable);
+                                remove_movable_from_name_index(state,
+                                                               movable);
+                                movable->base.name = other->base.name;
+                                movable->base.name_word =
+                                        other->base.name_word;
+                                add_movable_to_name_index(state, movable);
+                                invalidate_room_description(state, movable);
+                                send_movable_changed_event(state, movable);
+                        }
+                        break;
+                case PCX_AVT_OP_COPY:
+                        if (movable) {
+                                copy_movable(state,
+                                             movable,
+                                             state->movables + ins->arg);
                         }
                         break;
-                case '>':
-                        if (data->direction) {
-                                const char *suffix = NULL;
+                case PCX_AVT_OP_RUN_RULE:
+                        *ins_ptr = ins + 1;
+                        return state->avt->rules + ins->arg;
+                default:
+                        break;
+                }
+        }
+}
 
-                                if (dollar[2] == 'n') {
-                                        suffix = "n";
-                                        dollar++;
-                                }
+static void
+send_rule_message(struct pcx_avt_state *state,
+                  const struct pcx_avt_text_segment *segment,
+                  const struct pcx_avt_state_run_rule_data *data)
+{
+        bool present = data->room == state->current_room;
+        struct pcx_avt_state_movable *subjects[PCX_AVT_N_RULE_SUBJECTS];
 
-                                if (present) {
-                                        struct pcx_avt_state_movable *d =
-                                                data->direction;
-                                        add_movable_to_message(state,
-                                                               &d->base,
-                                                               suffix);
-                                }
+        get_rule_subjects(data, subjects);
+
+        for (; segment->op != PCX_AVT_TEXT_OP_END; segment++) {
+                switch ((enum pcx_avt_text_op) segment->op) {
+                case PCX_AVT_TEXT_OP_END:
+                        break;
+                case PCX_AVT_TEXT_OP_LITERAL:
+                        if (present) {
+                                add_message_data(state,
+                                                 segment->text,
+                                                 segment->length);
+                        }
+                        break;
+                case PCX_AVT_TEXT_OP_SUBJECT: {
+                        struct pcx_avt_state_movable *movable =
+                                subjects[segment->subject];
+
+                        if (!present)
+                                break;
+
+                        if (movable) {
+                                add_movable_to_message(state,
+                                                       &movable->base,
+                                                       segment->suffix ?
+                                                       "n" :
+                                                       NULL);
+                        } else if (segment->suffix) {
+                                /* The suffix is only part of the
+                                 * substitution if there is something
+                                 * to substitute.
+                                 */
+                                add_message_c(state, 'n');
                         }
                         break;
-                case 'V':
+                }
+                case PCX_AVT_TEXT_OP_VERB:
                         if (data->verb && present)
                                 add_word_to_message(state, data->verb);
                         break;
-                case 'D':
+                case PCX_AVT_TEXT_OP_DELAY:
                         if (present) {
                                 enum pcx_avt_state_message_type type =
                                         PCX_AVT_STATE_MESSAGE_TYPE_DELAY;
                                 start_message_type(state, type);
                         }
                         break;
-                case 'F':
-                        /* The monsters flee. FIXME */
-                        break;
-                case 'S':
-                        /* Show the following even if the player isn’t
-                         * present.
-                         */
+                case PCX_AVT_TEXT_OP_SHOW_ALWAYS:
                         present = true;
                         break;
-                case '$':
-                        /* This isn’t mentioned in the docs but it
-                         * seems like a good idea.
-                         */
-                        add_message_c(state, '$');
-                        break;
                 }
-
-                text = dollar + 2;
         }
 
-done:
-        if (present)
-                add_message_string(state, text);
-
         end_message(state);
 }
 
-static struct pcx_avt_state_movable *
-get_rule_subject(const struct pcx_avt_state_run_rule_data *data,
-                 enum pcx_avt_rule_subject subject)
-{
-        switch (subject) {
-        case PCX_AVT_RULE_SUBJECT_ROOM:
-                return data->command_object;
-        case PCX_AVT_RULE_SUBJECT_OBJECT:
-                return data->object;
-        case PCX_AVT_RULE_SUBJECT_TOOL:
-                return data->tool;
-        case PCX_AVT_RULE_SUBJECT_MONSTER:
-                return data->monster;
-        case PCX_AVT_RULE_SUBJECT_DIRECTION:
-                return data->direction;
-        case PCX_AVT_RULE_SUBJECT_IN:
-                return data->in;
+struct rule_frame {
+        const struct pcx_avt_rule *rule;
+        /* The next action to execute */
+        const struct pcx_avt_instruction *ins;
+};
+
+static bool
+start_rule(struct pcx_avt_state *state,
+           const struct pcx_avt_rule *rule,
+           const struct pcx_avt_state_run_rule_data *data)
+{
+        /* Prevent infinite recursion when rule actions trigger other rules.
+         */
+        if (state->rule_recursion_depth >= PCX_AVT_STATE_MAX_RECURSION_DEPTH ||
+            !use_step(state))
+                return false;
+
+        state->rule_recursion_depth++;
+
+        if (state->event_cb) {
+                struct pcx_avt_state_event event = {
+                        .type = PCX_AVT_STATE_EVENT_RULE,
+                        .rule = rule - state->avt->rules,
+                };
+
+                send_event(state, &event);
         }
 
-        return NULL;
+        if (rule->text_code)
+                send_rule_message(state, rule->text_code, data);
+
+        return true;
 }
 
 static bool
@@ -1302,72 +2276,199 @@ run_rule_actions(struct pcx_avt_state *state,
                  const struct pcx_avt_rule *rule,
                  const struct pcx_avt_state_run_rule_data *data)
 {
-        /* Prevent infinite recursion when rule actions trigger other rules.
-         */
-        if (state->rule_recursion_depth >= PCX_AVT_STATE_MAX_RECURSION_DEPTH)
+        if (!start_rule(state, rule, data))
                 return false;
 
-        state->rule_recursion_depth++;
+        struct pcx_avt_state_movable *subjects[PCX_AVT_N_RULE_SUBJECTS];
+
+        get_rule_subjects(data, subjects);
 
-        if (rule->text)
-                send_rule_message(state, rule->text, data);
+        /* The rules that are run by the actions share the same data
+         * so instead of recursing they are put on a stack of the
+         * rules that are waiting for them to finish.
+         */
+        struct rule_frame stack[PCX_AVT_STATE_MAX_RECURSION_DEPTH];
+        int depth = 0;
+
+        stack[depth++] = (struct rule_frame) {
+                .rule = rule,
+                .ins = rule->action_code,
+        };
+
+        while (depth > 0) {
+                struct rule_frame *frame = stack + depth - 1;
+                const struct pcx_avt_rule *next =
+                        execute_actions(state, &frame->ins, subjects, data);
+
+                if (next) {
+                        if (depth < PCX_N_ELEMENTS(stack) &&
+                            start_rule(state, next, data)) {
+                                stack[depth++] = (struct rule_frame) {
+                                        .rule = next,
+                                        .ins = next->action_code,
+                                };
+                        }
+                        continue;
+                }
 
-        for (unsigned a = 0; a < rule->n_actions; a++) {
-                const struct pcx_avt_action_data *act =
-                        rule->actions + a;
+                /* The command is abandoned without giving the points */
+                if (!state->out_of_steps)
+                        add_points(state, frame->rule->points);
 
-                execute_action(state,
-                               act,
-                               act->subject == PCX_AVT_RULE_SUBJECT_ROOM,
-                               get_rule_subject(data, act->subject),
-                               data);
+                state->rule_recursion_depth--;
+                depth--;
         }
 
-        add_points(state, rule->points);
+        return true;
+}
+
+static bool
+condition_cache_is_valid(struct pcx_avt_state *state,
+                         const struct pcx_avt_rule *rule,
+                         const struct pcx_avt_state_condition_cache *cache,
+                         int room)
+{
+        if (!cache->valid || cache->room != room || rule->has_chance)
+                return false;
 
-        state->rule_recursion_depth--;
+        for (int i = 0; i < PCX_AVT_N_RULE_INPUTS; i++) {
+                if ((rule->inputs & (1 << i)) &&
+                    cache->input_versions[i] != state->input_versions[i])
+                        return false;
+        }
 
         return true;
 }
 
+static bool
+check_rule_conditions(struct pcx_avt_state *state,
+                      int rule_num,
+                      struct pcx_avt_state_movable * const *subjects,
+                      const struct pcx_avt_state_run_rule_data *data)
+{
+        const struct pcx_avt_rule *rule = state->avt->rules + rule_num;
+
+        if (!data->cache_conditions) {
+                return check_conditions(state,
+                                        rule->condition_code,
+                                        subjects,
+                                        data->room);
+        }
+
+        struct pcx_avt_state_condition_cache *cache =
+                state->condition_cache + rule_num;
+
+        if (condition_cache_is_valid(state, rule, cache, data->room))
+                return cache->result;
+
+        cache->result = check_conditions(state,
+                                         rule->condition_code,
+                                         subjects,
+                                         data->room);
+        cache->valid = true;
+        cache->room = data->room;
+        memcpy(cache->input_versions,
+               state->input_versions,
+               sizeof cache->input_versions);
+
+        return cache->result;
+}
+
+struct rule_list {
+        const uint16_t *positions;
+        size_t n_positions;
+};
+
+static void
+set_rule_list(struct rule_list *list,
+              const struct pcx_avt_verb *verb,
+              const struct pcx_avt_rule_bucket *bucket)
+{
+        if (bucket) {
+                list->positions = verb->bucket_rules + bucket->start;
+                list->n_positions = bucket->n_rules;
+        } else {
+                list->n_positions = 0;
+        }
+}
+
 static bool
 run_verb_rules(struct pcx_avt_state *state,
                const struct pcx_avt_verb *verb,
                const struct pcx_avt_state_run_rule_data *data)
 {
         bool executed_rule = false;
+        struct pcx_avt_state_movable *subjects[PCX_AVT_N_RULE_SUBJECTS];
 
-        for (size_t i = 0; i < verb->n_rules; i++) {
-                const struct pcx_avt_rule *rule =
-                        state->avt->rules + verb->rules[i];
-                for (unsigned c = 0; c < rule->n_conditions; c++) {
-                        const struct pcx_avt_condition_data *cond =
-                                rule->conditions + c;
-
-                        struct pcx_avt_state_movable *subject =
-                                get_rule_subject(data, cond->subject);
-
-                        if (!check_condition(state,
-                                             cond,
-                                             subject,
-                                             data->room))
-                                goto skip;
+        get_rule_subjects(data, subjects);
+
+        /* Only the rules for the room and the movable of the command
+         * can match, as well as the shared rules. These are merged
+         * so that the rules are still run in the order they were
+         * declared in.
+         */
+        struct rule_list lists[3];
+
+        set_rule_list(lists + 0, verb, &verb->shared_bucket);
+        set_rule_list(lists + 1,
+                      verb,
+                      pcx_avt_find_rule_bucket(verb->room_buckets,
+                                               verb->n_room_buckets,
+                                               data->room));
+
+        if (data->command_object) {
+                set_rule_list(lists + 2,
+                              verb,
+                              pcx_avt_find_rule_bucket(verb->movable_buckets,
+                                                       verb->n_movable_buckets,
+                                                       data->command_object->
+                                                       index));
+        } else {
+                lists[2].n_positions = 0;
+        }
+
+        while (true) {
+                struct rule_list *next = NULL;
+
+                /* Count the command as handled so that nothing else
+                 * is done for it.
+                 */
+                if (state->out_of_steps)
+                        return true;
+
+                for (int i = 0; i < PCX_N_ELEMENTS(lists); i++) {
+                        if (lists[i].n_positions > 0 &&
+                            (next == NULL ||
+                             lists[i].positions[0] < next->positions[0]))
+                                next = lists + i;
                 }
 
+                if (next == NULL)
+                        break;
+
+                int rule_num = verb->rules[next->positions[0]];
+
+                next->positions++;
+                next->n_positions--;
+
+                if (!check_rule_conditions(state, rule_num, subjects, data))
+                        continue;
+
+                const struct pcx_avt_rule *rule =
+                        state->avt->rules + rule_num;
+
                 if (run_rule_actions(state, rule, data))
                         executed_rule = true;
-
-        skip:
-                continue;
         }
 
         return executed_rule;
 }
 
 static bool
-run_rules(struct pcx_avt_state *state,
-          const struct pcx_avt_command_word *verb,
-          const struct pcx_avt_state_run_rule_data *data_in)
+run_rules_for_verb(struct pcx_avt_state *state,
+                   const struct pcx_avt_verb *avt_verb,
+                   const struct pcx_avt_command_word *verb,
+                   const struct pcx_avt_state_run_rule_data *data_in)
 {
         struct pcx_avt_state_run_rule_data data = *data_in;
 
@@ -1386,41 +2487,56 @@ run_rules(struct pcx_avt_state *state,
 
         data.verb = verb;
 
-        for (size_t i = 0; i < state->avt->n_verbs; i++) {
-                const char *verb_name = state->avt->verbs[i].name;
-                if (!pcx_avt_command_word_equal(verb, verb_name))
-                        continue;
+        return run_verb_rules(state, avt_verb, &data);
+}
 
-                return run_verb_rules(state,
-                                      state->avt->verbs + i,
-                                      &data);
-        }
+static bool
+run_rules(struct pcx_avt_state *state,
+          const struct pcx_avt_command_word *verb,
+          const struct pcx_avt_state_run_rule_data *data)
+{
+        const struct pcx_avt_verb *avt_verb =
+                state->avt->word_verbs[verb->id];
 
-        return false;
+        if (avt_verb == NULL)
+                return false;
+
+        return run_rules_for_verb(state, avt_verb, verb, data);
 }
 
 static bool
 run_special_rules(struct pcx_avt_state *state,
-                  const char *verb_str,
+                  enum pcx_avt_special_verb special_verb,
                   const struct pcx_avt_state_run_rule_data *data)
 {
+        const struct pcx_avt_verb *avt_verb =
+                state->avt->special_verbs[special_verb];
+
+        if (avt_verb == NULL)
+                return false;
+
+        const char *verb_str = pcx_avt_special_verb_names[special_verb];
         struct pcx_avt_command_word verb = {
                 .start = verb_str,
                 .length = strlen(verb_str),
         };
 
-        return run_rules(state, &verb, data);
+        return run_rules_for_verb(state, avt_verb, &verb, data);
 }
 
 static void
 position_movables(struct pcx_avt_state *state)
 {
-        struct pcx_avt_state_movable *movable;
-
-        pcx_list_for_each(movable, &state->all_movables, all_node) {
+        for (size_t i = 0; i < state->n_movables; i++) {
+                struct pcx_avt_state_movable *movable = state->movables + i;
                 uint8_t loc = movable->base.location;
+                enum pcx_avt_location_type location_type =
+                        movable->base.location_type;
 
-                switch (movable->base.location_type) {
+                /* All of the movables start off in the nowhere list */
+                movable->base.location_type = PCX_AVT_LOCATION_TYPE_NOWHERE;
+
+                switch (location_type) {
                 case PCX_AVT_LOCATION_TYPE_IN_ROOM:
                         put_movable_in_room(state,
                                             loc,
@@ -1434,12 +2550,12 @@ position_movables(struct pcx_avt_state *state)
                         break;
                 case PCX_AVT_LOCATION_TYPE_WITH_MONSTER:
                         reparent_movable(state,
-                                         state->monster_index[loc],
+                                         state->monsters + loc,
                                          movable);
                         break;
                 case PCX_AVT_LOCATION_TYPE_IN_OBJECT:
                         reparent_movable(state,
-                                         state->object_index[loc],
+                                         state->objects + loc,
                                          movable);
                         break;
                 }
@@ -1489,8 +2605,19 @@ check_game_over(struct pcx_avt_state *state)
         const struct pcx_avt_room *room =
                 state->avt->rooms + state->current_room;
 
-        if ((room->attributes & PCX_AVT_ROOM_ATTRIBUTE_GAME_OVER))
+        if ((room->attributes & PCX_AVT_ROOM_ATTRIBUTE_GAME_OVER) &&
+            !state->game_over) {
+                struct pcx_avt_state_journal_entry *entry =
+                        add_journal_entry(state,
+                                          PCX_AVT_STATE_JOURNAL_GAME_OVER,
+                                          0);
+
+                if (entry)
+                        entry->game_over = state->game_over;
+
                 state->game_over = true;
+                send_game_over_event(state);
+        }
 
         return state->game_over;
 }
@@ -1524,7 +2651,10 @@ burn_out_object(struct pcx_avt_state *state,
         int room = get_movable_room(state, movable);
         bool is_present = is_movable_present(state, movable);
 
-        movable->base.attributes |= PCX_AVT_OBJECT_ATTRIBUTE_BURNT_OUT;
+        set_movable_attributes(state,
+                               movable,
+                               movable->base.attributes |
+                               PCX_AVT_OBJECT_ATTRIBUTE_BURNT_OUT);
 
         disappear_movable(state, movable);
 
@@ -1540,7 +2670,9 @@ burn_out_object(struct pcx_avt_state *state,
                 .room = room,
         };
 
-        run_special_rules(state, "fajrig", &data);
+        run_special_rules(state,
+                          PCX_AVT_SPECIAL_VERB_FAJRIG,
+                          &data);
 }
 
 static void
@@ -1548,12 +2680,15 @@ object_after_command(struct pcx_avt_state *state,
                      struct pcx_avt_state_movable *movable)
 {
         if ((movable->base.attributes & PCX_AVT_OBJECT_ATTRIBUTE_BURNING)) {
-                if (movable->object.burn_time > 0)
+                if (movable->object.burn_time > 0) {
+                        journal_movable(state, movable);
                         movable->object.burn_time--;
+                }
 
                 if (movable->object.burn_time <= 0) {
-                        movable->base.attributes &=
-                                ~PCX_AVT_OBJECT_ATTRIBUTE_BURNING;
+                        uint32_t attributes = movable->base.attributes;
+                        attributes &= ~PCX_AVT_OBJECT_ATTRIBUTE_BURNING;
+                        set_movable_attributes(state, movable, attributes);
 
                         if ((movable->base.attributes &
                              PCX_AVT_OBJECT_ATTRIBUTE_BURNT_OUT) == 0)
@@ -1563,6 +2698,7 @@ object_after_command(struct pcx_avt_state *state,
 
         if (movable->object.end > 0 &&
             movable->base.location_type != PCX_AVT_LOCATION_TYPE_NOWHERE) {
+                journal_movable(state, movable);
                 movable->object.end--;
 
                 if (movable->object.end <= 0) {
@@ -1571,94 +2707,635 @@ object_after_command(struct pcx_avt_state *state,
                                 .room = get_movable_room(state, movable),
                         };
 
-                        run_special_rules(state, "fin", &data);
+                        run_special_rules(state,
+                                          PCX_AVT_SPECIAL_VERB_FIN,
+                                          &data);
                 }
         }
 }
 
+static int
+get_next_timer(struct pcx_avt_state *state,
+               int start)
+{
+        int n_words = (state->n_movables + 31) / 32;
+
+        for (int word = start / 32; word < n_words; word++) {
+                uint32_t bits = state->timer_bits[word];
+
+                /* Ignore the bits before the start */
+                if (word == start / 32)
+                        bits &= UINT32_MAX << (start % 32);
+
+                if (bits)
+                        return word * 32 + ffs(bits) - 1;
+        }
+
+        return -1;
+}
+
 static void
 movables_after_command(struct pcx_avt_state *state)
 {
-        struct pcx_avt_state_movable *movable;
+        /* The movables are visited in the order of their index which
+         * is the same as the order they were created in. The next timer
+         * is looked up again after each one so that if a rule starts
+         * a countdown on a later movable then it will still be
+         * counted this turn.
+         */
+        for (int index = get_next_timer(state, 0);
+             index != -1;
+             index = get_next_timer(state, index + 1)) {
+                struct pcx_avt_state_movable *movable = state->movables + index;
 
-        pcx_list_for_each(movable, &state->all_movables, all_node) {
-                switch (movable->type) {
-                case PCX_AVT_STATE_MOVABLE_TYPE_OBJECT:
+                if (movable_has_timer(movable)) {
                         object_after_command(state, movable);
-                        break;
-                case PCX_AVT_STATE_MOVABLE_TYPE_MONSTER:
-                        break;
+
+                        if (check_game_over(state))
+                                break;
                 }
 
-                if (check_game_over(state))
-                        break;
+                if (!movable_has_timer(movable)) {
+                        state->timer_bits[index / 32] &=
+                                ~(UINT32_C(1) << (index % 32));
+                }
         }
 }
 
-static void
-after_command(struct pcx_avt_state *state)
+static bool
+monster_wanders(const struct pcx_avt_state_movable *movable)
 {
-        struct pcx_avt_state_run_rule_data data = {
-                .room = state->current_room,
-        };
+        return (movable->type == PCX_AVT_STATE_MOVABLE_TYPE_MONSTER &&
+                movable->monster.wander > 0);
+}
 
-        run_special_rules(state, "est", &data);
+static struct pcx_avt_state_wakeup *
+get_wakeups(struct pcx_avt_state *state)
+{
+        return (struct pcx_avt_state_wakeup *) state->monster_schedule.data;
+}
 
-        if (!check_game_over(state))
-                movables_after_command(state);
+static size_t
+get_n_wakeups(const struct pcx_avt_state *state)
+{
+        return (state->monster_schedule.length /
+                sizeof (struct pcx_avt_state_wakeup));
+}
 
-        if (check_game_over(state))
-                send_end_game_messages(state);
+static void
+swap_wakeups(struct pcx_avt_state_wakeup *a,
+             struct pcx_avt_state_wakeup *b)
+{
+        struct pcx_avt_state_wakeup tmp = *a;
+        *a = *b;
+        *b = tmp;
 }
 
-static int
-default_random_cb(void *user_data)
+/* The turn numbers can wrap around so they are compared relative to
+ * each other.
+ */
+static bool
+wakeup_is_before(const struct pcx_avt_state_wakeup *a,
+                 const struct pcx_avt_state_wakeup *b)
 {
-        return rand() % 100;
+        return (int32_t) (a->turn - b->turn) < 0;
 }
 
-struct pcx_avt_state *
-pcx_avt_state_new(const struct pcx_avt *avt)
+static bool
+monster_is_scheduled(const struct pcx_avt_state *state,
+                     const struct pcx_avt_state_movable *movable)
 {
-        struct pcx_avt_state *state = pcx_calloc(sizeof *state);
+        return (state->scheduled_bits[movable->index / 32] &
+                (UINT32_C(1) << (movable->index % 32))) != 0;
+}
 
-        pcx_buffer_init(&state->message_buf);
-        pcx_buffer_init(&state->stack);
+static void
+add_wakeup(struct pcx_avt_state *state,
+           const struct pcx_avt_state_wakeup *wakeup)
+{
+        pcx_buffer_append(&state->monster_schedule, wakeup, sizeof *wakeup);
 
-        state->random_cb = default_random_cb;
+        state->scheduled_bits[wakeup->movable / 32] |=
+                UINT32_C(1) << (wakeup->movable % 32);
 
-        state->avt = avt;
-        state->current_room = 0;
+        struct pcx_avt_state_wakeup *wakeups = get_wakeups(state);
 
-        pcx_list_init(&state->carrying);
-        pcx_list_init(&state->nowhere);
-        pcx_list_init(&state->all_movables);
+        for (size_t pos = get_n_wakeups(state) - 1; pos > 0;) {
+                size_t parent = (pos - 1) / 2;
 
-        state->rooms = pcx_alloc(avt->n_rooms * sizeof *state->rooms);
+                if (!wakeup_is_before(wakeups + pos, wakeups + parent))
+                        break;
+
+                swap_wakeups(wakeups + pos, wakeups + parent);
+                pos = parent;
+        }
+}
+
+/* Picks the number of turns until the monster next moves. The wander
+ * value is the percentage chance that the monster moves each turn.
+ * Rather than rolling the dice on every turn, a single random number
+ * picks the delay from the chance that the monster still hasn’t moved
+ * after each number of turns. A low random number moves it sooner, in
+ * the same way that a low number makes a chance condition pass.
+ */
+static uint32_t
+get_wander_delay(struct pcx_avt_state *state,
+                 const struct pcx_avt_state_movable *movable)
+{
+        unsigned stay_chance = (movable->monster.wander >= 100 ?
+                                0 :
+                                100 - movable->monster.wander);
+        /* Percentages in 16.16 fixed point */
+        uint32_t threshold = (uint32_t) (100 - get_random(state)) << 16;
+        uint32_t still = UINT32_C(100) << 16;
+        uint32_t delay = 1;
+
+        while (delay < PCX_AVT_STATE_MAX_WANDER_DELAY) {
+                still = still * stay_chance / 100;
+
+                if (still < threshold)
+                        break;
+
+                delay++;
+        }
+
+        return delay;
+}
+
+static void
+schedule_monster(struct pcx_avt_state *state,
+                 const struct pcx_avt_state_movable *movable)
+{
+        struct pcx_avt_state_wakeup wakeup = {
+                .turn = state->turn + get_wander_delay(state, movable),
+                .movable = movable->index,
+        };
+
+        add_wakeup(state, &wakeup);
+}
+
+/* Adds the monster to the schedule if it has started wandering. A
+ * monster that has stopped wandering is left in the schedule and
+ * dropped when its turn comes up so that nothing else has to change.
+ */
+static void
+update_monster_schedule(struct pcx_avt_state *state,
+                        const struct pcx_avt_state_movable *movable)
+{
+        if (monster_wanders(movable) && !monster_is_scheduled(state, movable))
+                schedule_monster(state, movable);
+}
+
+static struct pcx_avt_state_wakeup
+pop_wakeup(struct pcx_avt_state *state)
+{
+        struct pcx_avt_state_wakeup *wakeups = get_wakeups(state);
+        struct pcx_avt_state_wakeup first = wakeups[0];
+        size_t n_wakeups = get_n_wakeups(state) - 1;
+
+        wakeups[0] = wakeups[n_wakeups];
+        pcx_buffer_set_length(&state->monster_schedule,
+                              n_wakeups * sizeof *wakeups);
+
+        state->scheduled_bits[first.movable / 32] &=
+                ~(UINT32_C(1) << (first.movable % 32));
+
+        for (size_t pos = 0; ;) {
+                size_t smallest = pos;
+
+                for (size_t child = pos * 2 + 1;
+                     child <= pos * 2 + 2 && child < n_wakeups;
+                     child++) {
+                        if (wakeup_is_before(wakeups + child,
+                                             wakeups + smallest))
+                                smallest = child;
+                }
+
+                if (smallest == pos)
+                        break;
+
+                swap_wakeups(wakeups + pos, wakeups + smallest);
+                pos = smallest;
+        }
+
+        return first;
+}
+
+static void
+schedule_all_monsters(struct pcx_avt_state *state)
+{
+        for (size_t i = 0; i < state->n_movables; i++)
+                update_monster_schedule(state, state->movables + i);
+}
+
+/* Moves the monster through a random exit of the room it is in.
+ * Returns false if it isn’t in a room or there is no way out.
+ */
+static bool
+move_monster_randomly(struct pcx_avt_state *state,
+                      struct pcx_avt_state_movable *movable)
+{
+        if (movable->base.location_type != PCX_AVT_LOCATION_TYPE_IN_ROOM)
+                return false;
+
+        const struct pcx_avt_room *room =
+                state->avt->rooms + movable->base.location;
+        uint8_t exits[PCX_AVT_N_DIRECTIONS];
+        int n_exits = 0;
+
+        for (int i = 0; i < PCX_AVT_N_DIRECTIONS; i++) {
+                if (room->movements[i] != PCX_AVT_DIRECTION_BLOCKED)
+                        exits[n_exits++] = room->movements[i];
+        }
+
+        if (n_exits == 0)
+                return false;
+
+        put_movable_in_room(state,
+                            exits[get_random(state) * n_exits / 100],
+                            movable);
+
+        return true;
+}
+
+static void
+send_monster_message(struct pcx_avt_state *state,
+                     const struct pcx_avt_state_movable *movable,
+                     const char *verb)
+{
+        add_message_string(state, "La ");
+        add_movable_to_message(state, &movable->base, NULL);
+        add_message_printf(state, " %s.", verb);
+        end_message(state);
+}
+
+static void
+wander_monster(struct pcx_avt_state *state,
+               struct pcx_avt_state_movable *movable)
+{
+        bool was_present = is_movable_present(state, movable);
+
+        if (!move_monster_randomly(state, movable))
+                return;
+
+        if (was_present)
+                send_monster_message(state, movable, "foriras");
+        else if (is_movable_present(state, movable))
+                send_monster_message(state, movable, "alvenas");
+}
+
+static void
+check_fleeing_monsters(struct pcx_avt_state *state)
+{
+        struct pcx_avt_state_room *room = state->rooms + state->current_room;
+        struct pcx_avt_state_movable *movable, *tmp;
+
+        /* The monsters are only disturbed when the player arrives */
+        if (state->monster_check_room == state->current_room)
+                return;
+
+        state->monster_check_room = state->current_room;
+
+        pcx_list_for_each_safe(movable, tmp, &room->contents, location_node) {
+                if (movable->type != PCX_AVT_STATE_MOVABLE_TYPE_MONSTER ||
+                    movable->monster.escape == 0 ||
+                    get_random(state) >= movable->monster.escape)
+                        continue;
+
+                bool was_present = is_movable_present(state, movable);
+
+                if (move_monster_randomly(state, movable) && was_present)
+                        send_monster_message(state, movable, "forkuras");
+        }
+}
+
+static void
+monsters_after_command(struct pcx_avt_state *state)
+{
+        state->turn++;
+
+        check_fleeing_monsters(state);
+
+        while (get_n_wakeups(state) > 0 &&
+               (int32_t) (get_wakeups(state)->turn - state->turn) <= 0 &&
+               !check_game_over(state)) {
+                struct pcx_avt_state_wakeup wakeup = pop_wakeup(state);
+                struct pcx_avt_state_movable *movable =
+                        state->movables + wakeup.movable;
+
+                if (!monster_wanders(movable))
+                        continue;
+
+                wander_monster(state, movable);
+                schedule_monster(state, movable);
+        }
+}
+
+static void
+after_command(struct pcx_avt_state *state)
+{
+        /* These rules are run after every command so it’s worth
+         * avoiding checking the conditions again if nothing they
+         * depend on has changed.
+         */
+        struct pcx_avt_state_run_rule_data data = {
+                .cache_conditions = true,
+                .room = state->current_room,
+        };
+
+        run_special_rules(state,
+                          PCX_AVT_SPECIAL_VERB_EST,
+                          &data);
+
+        if (!check_game_over(state))
+                movables_after_command(state);
+
+        if (!check_game_over(state))
+                monsters_after_command(state);
+
+        if (check_game_over(state))
+                send_end_game_messages(state);
+}
+
+/* Creates a state with everything in its starting position but
+ * without queuing any messages or running any rules.
+ */
+static struct pcx_avt_state *
+create_initial_state(const struct pcx_avt *avt)
+{
+        struct pcx_avt_state *state = pcx_calloc(sizeof *state);
+
+        pcx_buffer_init(&state->message_buf);
+        pcx_buffer_init(&state->stack);
+        pcx_buffer_init(&state->command_buf);
+
+        seed_random(&state->random_state, 0);
+
+        state->avt = avt;
+        state->current_room = 0;
+
+        pcx_list_init(&state->carrying);
+        pcx_list_init(&state->nowhere);
+
+        state->rooms = pcx_alloc(avt->n_rooms * sizeof *state->rooms);
 
         for (int i = 0; i < avt->n_rooms; i++) {
                 pcx_list_init(&state->rooms[i].contents);
                 state->rooms[i].attributes = avt->rooms[i].attributes;
                 state->rooms[i].visited = false;
+                state->rooms[i].version = 0;
+                state->rooms[i].description_version = 0;
+                pcx_buffer_init(&state->rooms[i].description);
         }
 
+        state->n_movables = avt->n_objects + avt->n_monsters;
+        state->movables =
+                pcx_alloc(state->n_movables * sizeof *state->movables);
+
+        state->condition_cache =
+                pcx_calloc(avt->n_rules * sizeof *state->condition_cache);
+
+        state->timer_bits =
+                pcx_calloc((state->n_movables + 31) / 32 * sizeof (uint32_t));
+        state->present_bits =
+                pcx_calloc((state->n_movables + 31) / 32 * sizeof (uint32_t));
+        state->scheduled_bits =
+                pcx_calloc((state->n_movables + 31) / 32 * sizeof (uint32_t));
+
+        init_name_index(state);
+
+        pcx_buffer_init(&state->journal_entries);
+        pcx_buffer_init(&state->journal_commands);
+        state->undo_limit = PCX_AVT_STATE_DEFAULT_UNDO_LIMIT;
+
+        pcx_buffer_init(&state->monster_schedule);
+        state->monster_check_room = state->current_room;
+
         create_objects(state);
         create_monsters(state);
 
         position_movables(state);
 
+        state->game_attributes = avt->game_attributes;
+
+        return state;
+}
+
+static void
+start_game(struct pcx_avt_state *state)
+{
         if (state->avt->introduction)
                 send_message(state, "%s", state->avt->introduction);
 
-        state->game_attributes = avt->game_attributes;
-
         send_room_description(state);
 
+        /* This is done here rather than in the template so that it
+         * uses the random state of the new game.
+         */
+        schedule_all_monsters(state);
+
         after_command(state);
+}
+
+struct pcx_avt_state *
+pcx_avt_state_new(const struct pcx_avt *avt)
+{
+        struct pcx_avt_state *state = create_initial_state(avt);
+
+        start_game(state);
+
+        return state;
+}
+
+struct pcx_avt_state *
+pcx_avt_state_new_with_random(const struct pcx_avt *avt,
+                              const struct pcx_avt_state_random_state *rs)
+{
+        struct pcx_avt_state *state = create_initial_state(avt);
+
+        pcx_avt_state_set_random_state(state, rs);
+
+        start_game(state);
+
+        return state;
+}
+
+static bool
+pointer_is_in_range(const void *ptr,
+                    const void *start,
+                    size_t size)
+{
+        uintptr_t p = (uintptr_t) ptr, s = (uintptr_t) start;
+
+        return p >= s && p - s < size;
+}
+
+/* Converts a pointer into the memory of the state src into a pointer
+ * to the same place in the copy dst. Anything else is left alone.
+ */
+static void *
+relocate_pointer(const struct pcx_avt_state *src,
+                 struct pcx_avt_state *dst,
+                 const void *ptr)
+{
+        size_t movables_size = src->n_movables * sizeof *src->movables;
+        size_t rooms_size = src->avt->n_rooms * sizeof *src->rooms;
+        const uint8_t *p = ptr;
+
+        if (pointer_is_in_range(ptr, src->movables, movables_size))
+                return (uint8_t *) dst->movables +
+                        (p - (const uint8_t *) src->movables);
+        if (pointer_is_in_range(ptr, src->rooms, rooms_size))
+                return (uint8_t *) dst->rooms +
+                        (p - (const uint8_t *) src->rooms);
+        if (pointer_is_in_range(ptr, src, sizeof *src))
+                return (uint8_t *) dst + (p - (const uint8_t *) src);
+
+        return (void *) ptr;
+}
+
+static void
+relocate_list(const struct pcx_avt_state *src,
+              struct pcx_avt_state *dst,
+              struct pcx_list *list)
+{
+        list->next = relocate_pointer(src, dst, list->next);
+        list->prev = relocate_pointer(src, dst, list->prev);
+}
+
+static void
+relocate_reference(const struct pcx_avt_state *src,
+                   struct pcx_avt_state *dst,
+                   struct pcx_avt_state_reference *ref)
+{
+        ref->movable = relocate_pointer(src, dst, ref->movable);
+}
+
+/* Makes a copy of the state with a bulk copy of each array and then
+ * fixes up all of the pointers that point back into the state.
+ */
+static struct pcx_avt_state *
+copy_state(const struct pcx_avt_state *src)
+{
+        const struct pcx_avt *avt = src->avt;
+        struct pcx_avt_state *dst = pcx_memdup(src, sizeof *src);
+        size_t n_bit_words = (src->n_movables + 31) / 32;
+
+        pcx_buffer_init(&dst->message_buf);
+        /* The buffer has no data at all if it was never used */
+        if (src->message_buf.length > 0) {
+                pcx_buffer_append(&dst->message_buf,
+                                  src->message_buf.data,
+                                  src->message_buf.length);
+        }
+        pcx_buffer_init(&dst->stack);
+        pcx_buffer_init(&dst->command_buf);
+
+        dst->rooms = pcx_memdup(src->rooms, avt->n_rooms * sizeof *src->rooms);
+        dst->movables = pcx_memdup(src->movables,
+                                   src->n_movables * sizeof *src->movables);
+        dst->objects = dst->movables;
+        dst->monsters = dst->movables + avt->n_objects;
+        dst->condition_cache =
+                pcx_memdup(src->condition_cache,
+                           avt->n_rules * sizeof *src->condition_cache);
+        dst->timer_bits = pcx_memdup(src->timer_bits,
+                                     n_bit_words * sizeof (uint32_t));
+        dst->present_bits = pcx_memdup(src->present_bits,
+                                       n_bit_words * sizeof (uint32_t));
+        dst->scheduled_bits = pcx_memdup(src->scheduled_bits,
+                                         n_bit_words * sizeof (uint32_t));
+
+        /* The name index only uses numbers so it can be copied as is */
+        dst->name_buckets = pcx_memdup(src->name_buckets,
+                                       src->name_hash_size *
+                                       sizeof *src->name_buckets);
+        pcx_buffer_init(&dst->name_entries);
+        if (src->name_entries.length > 0) {
+                pcx_buffer_append(&dst->name_entries,
+                                  src->name_entries.data,
+                                  src->name_entries.length);
+        }
+
+        pcx_buffer_init(&dst->monster_schedule);
+        if (src->monster_schedule.length > 0) {
+                pcx_buffer_append(&dst->monster_schedule,
+                                  src->monster_schedule.data,
+                                  src->monster_schedule.length);
+        }
+
+        /* The history isn’t copied */
+        dst->journal_recording = false;
+        pcx_buffer_init(&dst->journal_entries);
+        pcx_buffer_init(&dst->journal_commands);
+        dst->journal_first_command = 0;
+        dst->journal_n_done = 0;
+
+        relocate_list(src, dst, &dst->carrying);
+        relocate_list(src, dst, &dst->nowhere);
+
+        for (int i = 0; i < avt->n_rooms; i++) {
+                relocate_list(src, dst, &dst->rooms[i].contents);
+                /* The cached descriptions aren’t copied */
+                pcx_buffer_init(&dst->rooms[i].description);
+        }
+
+        for (size_t i = 0; i < dst->n_movables; i++) {
+                struct pcx_avt_state_movable *movable = dst->movables + i;
+
+                relocate_list(src, dst, &movable->location_node);
+                relocate_list(src, dst, &movable->contents);
+                movable->container =
+                        relocate_pointer(src, dst, movable->container);
+        }
+
+        struct pcx_avt_state_references *refs = &dst->previous_references;
+
+        relocate_reference(src, dst, &refs->object);
+        relocate_reference(src, dst, &refs->tool);
+        relocate_reference(src, dst, &refs->in);
+        relocate_reference(src, dst, &refs->direction);
+
+        return dst;
+}
+
+struct pcx_avt_state *
+pcx_avt_state_clone(const struct pcx_avt_state *state)
+{
+        return copy_state(state);
+}
+
+struct pcx_avt_state_template *
+pcx_avt_state_template_new(const struct pcx_avt *avt)
+{
+        struct pcx_avt_state_template *template = pcx_alloc(sizeof *template);
+
+        template->state = create_initial_state(avt);
+
+        return template;
+}
+
+struct pcx_avt_state *
+pcx_avt_state_new_from_template(const struct pcx_avt_state_template *template,
+                                const struct pcx_avt_state_random_state *rs)
+{
+        struct pcx_avt_state *state = copy_state(template->state);
+
+        if (rs)
+                pcx_avt_state_set_random_state(state, rs);
+
+        start_game(state);
 
         return state;
 }
 
+void
+pcx_avt_state_template_free(struct pcx_avt_state_template *template)
+{
+        pcx_avt_state_free(template->state);
+        pcx_free(template);
+}
+
 static const char *
 get_pronoun_name(enum pcx_avt_pronoun pronoun)
 {
@@ -1695,21 +3372,18 @@ get_capital_pronoun_name(enum pcx_avt_pronoun pronoun)
 
 static bool
 movable_parts_matches_noun(bool plural,
-                           const char *adjective,
-                           const char *name,
+                           uint32_t adjective,
+                           uint32_t name,
                            const struct pcx_avt_command_noun *noun)
 {
         if (noun->plural != plural)
                 return false;
 
-        if (noun->adjective.start) {
-                if (adjective == NULL ||
-                    !pcx_avt_command_word_equal(&noun->adjective,
-                                                adjective))
-                        return false;
-        }
+        if (noun->adjective.start &&
+            (adjective == PCX_AVT_NO_WORD || noun->adjective.id != adjective))
+                return false;
 
-        return pcx_avt_command_word_equal(&noun->name, name);
+        return noun->name.id == name;
 }
 
 static bool
@@ -1718,8 +3392,8 @@ movable_matches_noun(const struct pcx_avt_movable *movable,
 {
         if (movable_parts_matches_noun(movable->pronoun ==
                                        PCX_AVT_PRONOUN_PLURAL,
-                                       movable->adjective,
-                                       movable->name,
+                                       movable->adjective_word,
+                                       movable->name_word,
                                        noun))
                 return true;
 
@@ -1727,8 +3401,8 @@ movable_matches_noun(const struct pcx_avt_movable *movable,
                 const struct pcx_avt_alias *alias = movable->aliases + i;
 
                 if (movable_parts_matches_noun(alias->plural,
-                                               alias->adjective,
-                                               alias->name,
+                                               alias->adjective_word,
+                                               alias->name_word,
                                                noun))
                         return true;
         }
@@ -1803,45 +3477,153 @@ find_movable_by_pronoun(struct pcx_avt_state *state,
         return NULL;
 }
 
-static bool
-find_movable_cb(struct pcx_avt_state_movable *movable,
-                void *user_data)
+/* Returns the list that the player would search through to find the
+ * movable, ie, either the carrying list or the contents of the current
+ * room, or NULL if the movable can’t be reached from either of them.
+ */
+static struct pcx_list *
+get_search_list(struct pcx_avt_state *state,
+                const struct pcx_avt_state_movable *base_movable)
 {
-        const struct pcx_avt_command_noun *noun = user_data;
+        const struct pcx_avt_state_movable *movable = base_movable;
+
+        while (true) {
+                switch (movable->base.location_type) {
+                case PCX_AVT_LOCATION_TYPE_IN_ROOM:
+                        if (movable->base.location != state->current_room)
+                                return NULL;
+                        return &state->rooms[state->current_room].contents;
+                case PCX_AVT_LOCATION_TYPE_CARRYING:
+                        return &state->carrying;
+                case PCX_AVT_LOCATION_TYPE_NOWHERE:
+                        return NULL;
+                case PCX_AVT_LOCATION_TYPE_WITH_MONSTER:
+                case PCX_AVT_LOCATION_TYPE_IN_OBJECT:
+                        movable = movable->container;
+                        if (movable == base_movable)
+                                return NULL;
+                        if (movable->type ==
+                            PCX_AVT_STATE_MOVABLE_TYPE_OBJECT &&
+                            (movable->base.attributes &
+                             PCX_AVT_OBJECT_ATTRIBUTE_CLOSED))
+                                return NULL;
+                        continue;
+                }
 
-        return movable_matches_noun(&movable->base, noun);
+                return NULL;
+        }
 }
 
-static struct pcx_avt_state_movable *
-find_movable(struct pcx_avt_state *state,
-             const struct pcx_avt_command_noun *noun)
+static int
+get_container_depth(const struct pcx_avt_state_movable *movable)
 {
-        struct pcx_avt_state_movable *found;
+        int depth = 0;
 
-        if (noun->is_pronoun)
-                return find_movable_by_pronoun(state, &noun->pronoun);
+        for (; movable->container; movable = movable->container)
+                depth++;
 
-        found = iterate_movables_in_list(state,
-                                         &state->carrying,
-                                         false, /* descend_closed */
-                                         find_movable_cb,
-                                         (void *) noun /* user_data */);
-        if (found)
-                return found;
+        return depth;
+}
 
-        if (check_light(state)) {
-                struct pcx_avt_state_room *room =
-                        state->rooms + state->current_room;
+/* Returns whether a would be found before b when searching
+ * depth-first through the given list with iterate_movables_in_list.
+ * Both movables must be reachable from the list.
+ */
+static bool
+is_found_before(struct pcx_list *list,
+                const struct pcx_avt_state_movable *a,
+                const struct pcx_avt_state_movable *b)
+{
+        int a_depth = get_container_depth(a);
+        int b_depth = get_container_depth(b);
 
-                found = iterate_movables_in_list(state,
-                                                 &room->contents,
-                                                 false, /* descend_closed */
-                                                 find_movable_cb,
-                                                 (void *) noun /* user_data */);
-                if (found)
-                        return found;
+        /* A container is always found before its contents */
+        for (; a_depth > b_depth; a_depth--) {
+                a = a->container;
+                if (a == b)
+                        return false;
+        }
+        for (; b_depth > a_depth; b_depth--) {
+                b = b->container;
+                if (b == a)
+                        return true;
         }
 
+        /* Move up to the first ancestors that share a list */
+        while (a->container != b->container) {
+                a = a->container;
+                b = b->container;
+        }
+
+        struct pcx_list *parent = a->container ? &a->container->contents : list;
+
+        for (const struct pcx_list *node = a->location_node.next;
+             node != parent;
+             node = node->next) {
+                if (node == &b->location_node)
+                        return true;
+        }
+
+        return false;
+}
+
+static struct pcx_avt_state_movable *
+find_movable(struct pcx_avt_state *state,
+             const struct pcx_avt_command_noun *noun)
+{
+        if (noun->is_pronoun)
+                return find_movable_by_pronoun(state, &noun->pronoun);
+
+        /* Look at each movable with a matching name and pick the one
+         * that would be found first by a depth-first search of the
+         * things that the player is carrying followed by the things
+         * in the room.
+         */
+        uint32_t word = noun->name.id;
+
+        /* Nothing can have a name that isn’t in the vocabulary */
+        if (word == PCX_AVT_NO_WORD)
+                return NULL;
+
+        const struct pcx_avt_state_name_entry *entries =
+                get_name_entries(state);
+        struct pcx_avt_state_movable *carried = NULL, *in_room = NULL;
+
+        for (int entry_num = (state->name_buckets
+                              [word & (state->name_hash_size - 1)]);
+             entry_num != -1;
+             entry_num = entries[entry_num].next) {
+                const struct pcx_avt_state_name_entry *entry =
+                        entries + entry_num;
+
+                if (entry->word != word)
+                        continue;
+
+                struct pcx_avt_state_movable *movable =
+                        state->movables + entry->movable;
+
+                if (movable == carried || movable == in_room ||
+                    !movable_matches_noun(&movable->base, noun))
+                        continue;
+
+                struct pcx_list *list = get_search_list(state, movable);
+
+                if (list == NULL)
+                        continue;
+
+                struct pcx_avt_state_movable **best =
+                        list == &state->carrying ? &carried : &in_room;
+
+                if (*best == NULL || is_found_before(list, movable, *best))
+                        *best = movable;
+        }
+
+        if (carried)
+                return carried;
+
+        if (in_room && check_light(state))
+                return in_room;
+
         return NULL;
 }
 
@@ -1930,6 +3712,8 @@ get_direction_or_message(struct pcx_avt_state *state,
         return references->direction.movable;
 }
 
+#ifdef ENABLE_CACHE_CHECKS
+
 struct get_weight_closure {
         int weight;
 };
@@ -1940,15 +3724,14 @@ get_weight_cb(struct pcx_avt_state_movable *movable,
 {
         struct get_weight_closure *data = user_data;
 
-        if (movable->type == PCX_AVT_STATE_MOVABLE_TYPE_OBJECT)
-                data->weight += movable->object.weight;
+        data->weight += get_own_weight(movable);
 
         return false;
 }
 
 static int
-get_weight_of_list(struct pcx_avt_state *state,
-                   struct pcx_list *list)
+get_weight_of_list_slow(struct pcx_avt_state *state,
+                        struct pcx_list *list)
 {
         struct get_weight_closure closure = { .weight = 0 };
 
@@ -1962,41 +3745,50 @@ get_weight_of_list(struct pcx_avt_state *state,
 }
 
 static int
-get_weight_of_movable(struct pcx_avt_state *state,
-                      struct pcx_avt_state_movable *movable)
+get_size_in_list_slow(struct pcx_list *list)
 {
-        int weight = 0;
+        struct pcx_avt_state_movable *movable;
+        int size = 0;
 
-        if (movable->type == PCX_AVT_STATE_MOVABLE_TYPE_OBJECT)
-                weight += movable->object.weight;
+        pcx_list_for_each(movable, list, location_node)
+                size += get_own_size(movable);
 
-        return weight + get_weight_of_list(state, &movable->contents);
+        return size;
 }
 
+#endif /* ENABLE_CACHE_CHECKS */
+
 static int
-get_size_in_list(struct pcx_list *list)
+get_carrying_weight(struct pcx_avt_state *state)
 {
-        struct pcx_avt_state_movable *movable;
-        int size = 0;
-
-        pcx_list_for_each(movable, list, location_node) {
-                if (movable->type == PCX_AVT_STATE_MOVABLE_TYPE_OBJECT)
-                        size += movable->object.size;
-        }
+#ifdef ENABLE_CACHE_CHECKS
+        assert(state->carrying_weight ==
+               get_weight_of_list_slow(state, &state->carrying));
+#endif
 
-        return size;
+        return state->carrying_weight;
 }
 
 static int
 get_carrying_size(struct pcx_avt_state *state)
 {
-        return get_size_in_list(&state->carrying);
+#ifdef ENABLE_CACHE_CHECKS
+        assert(state->carrying_size ==
+               get_size_in_list_slow(&state->carrying));
+#endif
+
+        return state->carrying_size;
 }
 
 static int
 get_movable_contents_size(struct pcx_avt_state_movable *movable)
 {
-        return get_size_in_list(&movable->contents);
+#ifdef ENABLE_CACHE_CHECKS
+        assert(movable->contents_size ==
+               get_size_in_list_slow(&movable->contents));
+#endif
+
+        return movable->contents_size;
 }
 
 static bool
@@ -2051,54 +3843,58 @@ handle_compass_direction(struct pcx_avt_state *state,
         if (noun->plural || noun->is_pronoun)
                 return false;
 
+        /* Indexed by the grammar word minus PCX_AVT_GRAMMAR_WORD_NORD */
         static const struct {
-                const char *word;
-                const char *verb;
+                enum pcx_avt_special_verb verb;
                 int direction;
         } direction_map[] = {
-                { "nord", "nordenir", PCX_AVT_DIRECTION_NORTH },
-                { "orient", "orientenir", PCX_AVT_DIRECTION_EAST },
-                { "sud", "sudenir", PCX_AVT_DIRECTION_SOUTH },
-                { "okcident", "okcidentenir", PCX_AVT_DIRECTION_WEST },
-                { "supr", "suprenir", PCX_AVT_DIRECTION_UP },
-                { "malsupr", "subenir", PCX_AVT_DIRECTION_DOWN },
-                { "sub", "subenir", PCX_AVT_DIRECTION_DOWN },
-                { "el", "elir", PCX_AVT_DIRECTION_EXIT },
+#define DIR(word, verb, dir)                                            \
+                [PCX_AVT_GRAMMAR_WORD_ ## word -                        \
+                 PCX_AVT_GRAMMAR_WORD_NORD] = {                         \
+                        PCX_AVT_SPECIAL_VERB_ ## verb,                  \
+                        PCX_AVT_DIRECTION_ ## dir,                      \
+                }
+                DIR(NORD, NORDENIR, NORTH),
+                DIR(ORIENT, ORIENTENIR, EAST),
+                DIR(SUD, SUDENIR, SOUTH),
+                DIR(OKCIDENT, OKCIDENTENIR, WEST),
+                DIR(SUPR, SUPRENIR, UP),
+                DIR(MALSUPR, SUBENIR, DOWN),
+                DIR(SUB, SUBENIR, DOWN),
+                DIR(EL, ELIR, EXIT),
+#undef DIR
         };
 
-        const struct pcx_avt_room *room =
-                state->avt->rooms + state->current_room;
+        enum pcx_avt_grammar_word word =
+                pcx_avt_grammar_find_word(noun->name.start,
+                                          noun->name.length);
 
-        for (int i = 0; i < PCX_N_ELEMENTS(direction_map); i++) {
-                if (pcx_avt_command_word_equal(&noun->name,
-                                               direction_map[i].word)) {
-                        struct pcx_avt_state_run_rule_data data = {
-                                .room = state->current_room,
-                        };
+        if (word < PCX_AVT_GRAMMAR_WORD_NORD ||
+            word > PCX_AVT_GRAMMAR_WORD_EL)
+                return false;
 
-                        if (run_special_rules(state,
-                                              direction_map[i].verb,
-                                              &data))
-                                return true;
-
-                        int dir = direction_map[i].direction;
-                        int new_room = room->movements[dir];
-
-                        if (new_room == PCX_AVT_DIRECTION_BLOCKED) {
-                                send_message(state,
-                                             "Vi ne povas iri %sen de "
-                                             "ĉi tie.",
-                                             direction_map[i].word);
-                        } else {
-                                state->current_room = new_room;
-                                send_room_description(state);
-                        }
+        int map_index = word - PCX_AVT_GRAMMAR_WORD_NORD;
+        struct pcx_avt_state_run_rule_data data = {
+                .room = state->current_room,
+        };
 
-                        return true;
-                }
+        if (run_special_rules(state, direction_map[map_index].verb, &data))
+                return true;
+
+        const struct pcx_avt_room *room =
+                state->avt->rooms + state->current_room;
+        int new_room = room->movements[direction_map[map_index].direction];
+
+        if (new_room == PCX_AVT_DIRECTION_BLOCKED) {
+                send_message(state,
+                             "Vi ne povas iri %sen de ĉi tie.",
+                             pcx_avt_grammar_get_word(word));
+        } else {
+                set_current_room(state, new_room);
+                send_room_description(state);
         }
 
-        return false;
+        return true;
 }
 
 static bool
@@ -2112,9 +3908,8 @@ handle_named_direction(struct pcx_avt_state *state,
                 state->avt->rooms + state->current_room;
 
         for (int i = 0; i < room->n_directions; i++) {
-                if (pcx_avt_command_word_equal(&noun->name,
-                                               room->directions[i].name)) {
-                        state->current_room = room->directions[i].target;
+                if (noun->name.id == room->directions[i].name_word) {
+                        set_current_room(state, room->directions[i].target);
                         send_room_description(state);
                         return true;
                 }
@@ -2143,10 +3938,6 @@ handle_direction(struct pcx_avt_state *state,
              command->subject.pronoun.plural))
                 return false;
 
-        if ((command->has & PCX_AVT_COMMAND_HAS_VERB) &&
-            !pcx_avt_command_word_equal(&command->verb, "ir"))
-                return false;
-
         if (handle_compass_direction(state, &command->direction))
                 return true;
 
@@ -2209,11 +4000,6 @@ handle_inventory(struct pcx_avt_state *state,
             !pcx_avt_command_word_equal(&command->object.name, "ki"))
                 return false;
 
-        if ((command->has & PCX_AVT_COMMAND_HAS_VERB) &&
-            !pcx_avt_command_word_equal(&command->verb, "hav") &&
-            !pcx_avt_command_word_equal(&command->verb, "kunport"))
-                return false;
-
         add_message_string(state, "Vi kunportas ");
 
         if (pcx_list_empty(&state->carrying))
@@ -2244,8 +4030,7 @@ handle_look_direction(struct pcx_avt_state *state,
                 if (description == NULL)
                         continue;
 
-                if (!pcx_avt_command_word_equal(&noun->name,
-                                                room->directions[i].name))
+                if (noun->name.id != room->directions[i].name_word)
                         continue;
 
                 add_message_string(state, description);
@@ -2321,9 +4106,6 @@ handle_look(struct pcx_avt_state *state,
              command->subject.pronoun.plural))
                 return false;
 
-        if (!pcx_avt_command_word_equal(&command->verb, "rigard"))
-                return false;
-
         if ((command->has & PCX_AVT_COMMAND_HAS_OBJECT) == 0) {
                 send_room_description(state);
                 return true;
@@ -2393,7 +4175,9 @@ handle_look(struct pcx_avt_state *state,
                 .room = state->current_room,
         };
 
-        run_special_rules(state, "rigard", &data);
+        run_special_rules(state,
+                          PCX_AVT_SPECIAL_VERB_RIGARD,
+                          &data);
 
         return true;
 }
@@ -2446,8 +4230,7 @@ try_take(struct pcx_avt_state *state,
         }
 
         if (!is_carrying_movable(state, movable) &&
-            get_weight_of_movable(state, movable) +
-            get_weight_of_list(state, &state->carrying) >
+            get_weight_of_movable(movable) + get_carrying_weight(state) >
             PCX_AVT_STATE_MAX_CARRYING_WEIGHT) {
                 add_message_string(state,
                                    "Kune kun tio kion vi jam portas la ");
@@ -2478,7 +4261,9 @@ try_take(struct pcx_avt_state *state,
                 .room = state->current_room,
         };
 
-        if (run_special_rules(state, "pren", &data)) {
+        if (run_special_rules(state,
+                              PCX_AVT_SPECIAL_VERB_PREN,
+                              &data)) {
                 /* The rule replaces the default action, but it might
                  * end up causing the object to be carried anyway.
                  */
@@ -2513,9 +4298,6 @@ handle_take(struct pcx_avt_state *state,
         if (!is_verb_object_command(command))
                 return false;
 
-        if (!pcx_avt_command_word_equal(&command->verb, "pren"))
-                return false;
-
         struct pcx_avt_state_movable *movable =
                 get_object_or_message(state, command, references);
 
@@ -2545,12 +4327,6 @@ handle_drop(struct pcx_avt_state *state,
         if (!is_verb_object_command(command))
                 return false;
 
-        if (!pcx_avt_command_word_equal(&command->verb, "ĵet") &&
-            !pcx_avt_command_word_equal(&command->verb, "forĵet") &&
-            !pcx_avt_command_word_equal(&command->verb, "falig") &&
-            !pcx_avt_command_word_equal(&command->verb, "las"))
-                return false;
-
         struct pcx_avt_state_movable *movable =
                 get_object_or_message(state, command, references);
 
@@ -2571,7 +4347,9 @@ handle_drop(struct pcx_avt_state *state,
                 .room = state->current_room,
         };
 
-        if (!run_special_rules(state, "ĵet", &data)) {
+        if (!run_special_rules(state,
+                               PCX_AVT_SPECIAL_VERB_JXET,
+                               &data)) {
                 put_movable_in_room(state,
                                     state->current_room,
                                     movable);
@@ -2609,10 +4387,6 @@ handle_put(struct pcx_avt_state *state,
                                      PCX_AVT_COMMAND_HAS_IN))
                 return false;
 
-        if (!pcx_avt_command_word_equal(&command->verb, "met") &&
-            !pcx_avt_command_word_equal(&command->verb, "enmet"))
-                return false;
-
         struct pcx_avt_state_movable *container =
                 get_in_or_message(state, command, references);
         if (container == NULL)
@@ -2670,7 +4444,9 @@ handle_put(struct pcx_avt_state *state,
                 .room = state->current_room,
         };
 
-        if (run_special_rules(state, "met", &data))
+        if (run_special_rules(state,
+                              PCX_AVT_SPECIAL_VERB_MET,
+                              &data))
                 return true;
 
         reparent_movable(state, container, containee);
@@ -2716,7 +4492,9 @@ handle_enter(struct pcx_avt_state *state,
                 .room = state->current_room,
         };
 
-        if (run_special_rules(state, "enir", &data))
+        if (run_special_rules(state,
+                              PCX_AVT_SPECIAL_VERB_ENIR,
+                              &data))
                 return true;
 
         if (movable->type != PCX_AVT_STATE_MOVABLE_TYPE_OBJECT ||
@@ -2728,7 +4506,7 @@ handle_enter(struct pcx_avt_state *state,
                 return true;
         }
 
-        state->current_room = movable->object.enter_room;
+        set_current_room(state, movable->object.enter_room);
         send_room_description(state);
 
         return true;
@@ -2739,15 +4517,16 @@ handle_exit(struct pcx_avt_state *state,
             const struct pcx_avt_command *command,
             const struct pcx_avt_state_references *references)
 {
-        if (!is_verb_command_and_has(command, 0) ||
-            !pcx_avt_command_word_equal(&command->verb, "elir"))
+        if (!is_verb_command_and_has(command, 0))
                 return false;
 
         struct pcx_avt_state_run_rule_data data = {
                 .room = state->current_room,
         };
 
-        if (run_special_rules(state, "elir", &data))
+        if (run_special_rules(state,
+                              PCX_AVT_SPECIAL_VERB_ELIR,
+                              &data))
                 return true;
 
         const struct pcx_avt_room *room =
@@ -2757,7 +4536,7 @@ handle_exit(struct pcx_avt_state *state,
         if (new_room == PCX_AVT_DIRECTION_BLOCKED) {
                 send_message(state, "Vi ne povas eliri de ĉi tie.");
         } else {
-                state->current_room = new_room;
+                set_current_room(state, new_room);
                 send_room_description(state);
         }
 
@@ -2822,9 +4601,11 @@ handle_open_close(struct pcx_avt_state *state,
                 return true;
         }
 
-        movable->base.attributes = ((movable->base.attributes &
-                                     ~PCX_AVT_OBJECT_ATTRIBUTE_CLOSED) |
-                                    new_state);
+        set_movable_attributes(state,
+                               movable,
+                               (movable->base.attributes &
+                                ~PCX_AVT_OBJECT_ATTRIBUTE_CLOSED) |
+                               new_state);
 
         add_message_string(state, "Vi ");
         add_word_to_message(state, &command->verb);
@@ -2848,9 +4629,6 @@ handle_read(struct pcx_avt_state *state,
         if (!is_verb_object_command(command))
                 return false;
 
-        if (!pcx_avt_command_word_equal(&command->verb, "leg"))
-                return false;
-
         struct pcx_avt_state_movable *movable =
                 get_object_or_message(state, command, references);
 
@@ -2862,7 +4640,9 @@ handle_read(struct pcx_avt_state *state,
                 .room = state->current_room,
         };
 
-        if (run_special_rules(state, "leg", &data))
+        if (run_special_rules(state,
+                              PCX_AVT_SPECIAL_VERB_LEG,
+                              &data))
                 return true;
 
         if (movable->type != PCX_AVT_STATE_MOVABLE_TYPE_OBJECT ||
@@ -2896,10 +4676,6 @@ handle_set_alight(struct pcx_avt_state *state,
              command->subject.pronoun.plural))
                 return false;
 
-        if (!pcx_avt_command_word_equal(&command->verb, "fajrig") &&
-            !pcx_avt_command_word_equal(&command->verb, "brulig"))
-                return false;
-
         struct pcx_avt_state_movable *object =
                 get_object_or_message(state, command, references);
 
@@ -2947,7 +4723,10 @@ handle_set_alight(struct pcx_avt_state *state,
 
         bool had_light = check_light(state);
 
-        object->base.attributes |= PCX_AVT_OBJECT_ATTRIBUTE_BURNING;
+        set_movable_attributes(state,
+                               object,
+                               object->base.attributes |
+                               PCX_AVT_OBJECT_ATTRIBUTE_BURNING);
 
         add_message_string(state, "La ");
         add_movable_to_message(state, &object->base, NULL);
@@ -2965,7 +4744,9 @@ handle_set_alight(struct pcx_avt_state *state,
         /* The verbs in the original interpreter seem to be the other
          * way around from what is described in the document.
          */
-        run_special_rules(state, "brulig", &data);
+        run_special_rules(state,
+                          PCX_AVT_SPECIAL_VERB_BRULIG,
+                          &data);
 
         return true;
 }
@@ -3031,9 +4812,11 @@ handle_turn_on_off(struct pcx_avt_state *state,
 
         bool had_light = check_light(state);
 
-        movable->base.attributes = ((movable->base.attributes &
-                                     ~PCX_AVT_OBJECT_ATTRIBUTE_LIT) |
-                                    new_state);
+        set_movable_attributes(state,
+                               movable,
+                               (movable->base.attributes &
+                                ~PCX_AVT_OBJECT_ATTRIBUTE_LIT) |
+                               new_state);
 
         add_message_string(state, "Vi ");
         add_word_to_message(state, &command->verb);
@@ -3067,9 +4850,6 @@ handle_throw_to(struct pcx_avt_state *state,
                                      PCX_AVT_COMMAND_HAS_DIRECTION))
                 return false;
 
-        if (!pcx_avt_command_word_equal(&command->verb, "ĵet"))
-                return false;
-
         struct pcx_avt_state_movable *target =
                 get_direction_or_message(state, command, references);
         if (target == NULL)
@@ -3088,7 +4868,9 @@ handle_throw_to(struct pcx_avt_state *state,
                 .room = state->current_room,
         };
 
-        if (run_special_rules(state, "ĵet", &data))
+        if (run_special_rules(state,
+                              PCX_AVT_SPECIAL_VERB_JXET,
+                              &data))
                 return true;
 
         add_message_string(state, "Vi ne povas ĵeti la ");
@@ -3213,52 +4995,94 @@ handle_unknown_command(struct pcx_avt_state *state,
         return true;
 }
 
-static void
-handle_command(struct pcx_avt_state *state,
-               const struct pcx_avt_command *command,
-               const struct pcx_avt_state_references *references)
-{
-        if (handle_direction(state, command, references))
-                return;
-
-        if (handle_direction_verb(state, command, references))
-                return;
-
-        if (handle_look(state, command, references))
-                return;
-
-        if (handle_take(state, command, references))
-                return;
+typedef bool
+(* command_handler)(struct pcx_avt_state *state,
+                    const struct pcx_avt_command *command,
+                    const struct pcx_avt_state_references *references);
 
-        if (handle_drop(state, command, references))
-                return;
+#define PCX_AVT_STATE_MAX_VERB_HANDLERS 2
 
-        if (handle_put(state, command, references))
-                return;
+struct handler_list {
+        /* The handlers to try in order. The list ends early with NULL
+         * if there are fewer handlers.
+         */
+        command_handler handlers[PCX_AVT_STATE_MAX_VERB_HANDLERS];
+};
 
-        if (handle_inventory(state, command, references))
-                return;
+/* The built-in handlers that are responsible for each verb, indexed
+ * by the grammar word of the verb. The handlers don’t check the verb
+ * again so each one must only be listed for the verbs it understands.
+ */
+static const struct handler_list
+verb_handlers[PCX_AVT_GRAMMAR_N_WORDS] = {
+        [PCX_AVT_GRAMMAR_WORD_BRULIG] = { { handle_set_alight } },
+        [PCX_AVT_GRAMMAR_WORD_ELENIR] = { { handle_direction_verb } },
+        [PCX_AVT_GRAMMAR_WORD_ELIR] = { { handle_exit } },
+        [PCX_AVT_GRAMMAR_WORD_ENIR] = { { handle_enter } },
+        [PCX_AVT_GRAMMAR_WORD_ENMET] = { { handle_put } },
+        [PCX_AVT_GRAMMAR_WORD_FAJRIG] = { { handle_set_alight } },
+        [PCX_AVT_GRAMMAR_WORD_FALIG] = { { handle_drop } },
+        [PCX_AVT_GRAMMAR_WORD_FERM] = { { handle_open_close } },
+        [PCX_AVT_GRAMMAR_WORD_FORJXET] = { { handle_drop } },
+        [PCX_AVT_GRAMMAR_WORD_HAV] = { { handle_inventory } },
+        [PCX_AVT_GRAMMAR_WORD_IR] = { { handle_direction, handle_enter } },
+        [PCX_AVT_GRAMMAR_WORD_KUNPORT] = { { handle_inventory } },
+        [PCX_AVT_GRAMMAR_WORD_LAS] = { { handle_drop } },
+        [PCX_AVT_GRAMMAR_WORD_LEG] = { { handle_read } },
+        [PCX_AVT_GRAMMAR_WORD_LUMIG] = { { handle_turn_on_off } },
+        [PCX_AVT_GRAMMAR_WORD_MALFERM] = { { handle_open_close } },
+        [PCX_AVT_GRAMMAR_WORD_MALLUMIG] = { { handle_turn_on_off } },
+        [PCX_AVT_GRAMMAR_WORD_MALSUPRENIR] = { { handle_direction_verb } },
+        [PCX_AVT_GRAMMAR_WORD_MALSXALT] = { { handle_turn_on_off } },
+        [PCX_AVT_GRAMMAR_WORD_MET] = { { handle_put } },
+        [PCX_AVT_GRAMMAR_WORD_NORDENIR] = { { handle_direction_verb } },
+        [PCX_AVT_GRAMMAR_WORD_OKCIDENTENIR] = { { handle_direction_verb } },
+        [PCX_AVT_GRAMMAR_WORD_ORIENTENIR] = { { handle_direction_verb } },
+        [PCX_AVT_GRAMMAR_WORD_PREN] = { { handle_take } },
+        [PCX_AVT_GRAMMAR_WORD_RIGARD] = { { handle_look } },
+        [PCX_AVT_GRAMMAR_WORD_SUBENIR] = { { handle_direction_verb } },
+        [PCX_AVT_GRAMMAR_WORD_SUDENIR] = { { handle_direction_verb } },
+        [PCX_AVT_GRAMMAR_WORD_SUPRENIR] = { { handle_direction_verb } },
+        [PCX_AVT_GRAMMAR_WORD_JXET] = { { handle_drop, handle_throw_to } },
+        [PCX_AVT_GRAMMAR_WORD_SXALT] = { { handle_turn_on_off } },
+};
 
-        if (handle_enter(state, command, references))
-                return;
+/* The handlers for a command without a verb */
+static const struct handler_list
+no_verb_handlers = {
+        { handle_direction, handle_inventory }
+};
 
-        if (handle_exit(state, command, references))
-                return;
+static const struct handler_list *
+find_verb_handlers(const struct pcx_avt_command *command)
+{
+        if ((command->has & PCX_AVT_COMMAND_HAS_VERB) == 0)
+                return &no_verb_handlers;
 
-        if (handle_open_close(state, command, references))
-                return;
+        enum pcx_avt_grammar_word word =
+                pcx_avt_grammar_find_word(command->verb.start,
+                                          command->verb.length);
 
-        if (handle_read(state, command, references))
-                return;
+        return verb_handlers + word;
+}
 
-        if (handle_set_alight(state, command, references))
-                return;
+static void
+handle_command(struct pcx_avt_state *state,
+               const struct pcx_avt_command *command,
+               const struct pcx_avt_state_references *references)
+{
+        const struct handler_list *handlers =
+                find_verb_handlers(command);
 
-        if (handle_turn_on_off(state, command, references))
-                return;
+        if (handlers) {
+                for (int i = 0; i < PCX_AVT_STATE_MAX_VERB_HANDLERS; i++) {
+                        if (handlers->handlers[i] == NULL)
+                                break;
 
-        if (handle_throw_to(state, command, references))
-                return;
+                        if (handlers->handlers[i](state, command, references))
+                                return;
+                }
+        }
 
         if (handle_custom_command(state, command, references))
                 return;
@@ -3295,111 +5119,1577 @@ get_references(struct pcx_avt_state *state,
         }
 }
 
-void
-pcx_avt_state_run_command(struct pcx_avt_state *state,
-                          const char *command_str)
+/* Returns the number of bytes used by the commands in the journal
+ * that haven’t been forgotten.
+ */
+static size_t
+get_journal_size(struct pcx_avt_state *state)
 {
-        struct pcx_avt_command command;
-        struct pcx_avt_state_references references;
+        size_t first_command = state->journal_first_command;
+        size_t n_commands = get_n_journal_commands(state);
 
-        /* Free up any messages that we’ve already reported to the
-         * caller
+        if (first_command >= n_commands)
+                return 0;
+
+        size_t first_entry = get_journal_commands(state)[first_command].
+                first_entry;
+
+        return ((get_n_journal_entries(state) - first_entry) *
+                sizeof (struct pcx_avt_state_journal_entry) +
+                (n_commands - first_command) *
+                sizeof (struct pcx_avt_state_journal_command));
+}
+
+/* Removes the forgotten commands from the start of the buffers */
+static void
+compact_journal(struct pcx_avt_state *state)
+{
+        size_t first_command = state->journal_first_command;
+        size_t n_commands = get_n_journal_commands(state);
+        size_t n_entries = get_n_journal_entries(state);
+        struct pcx_avt_state_journal_command *commands =
+                get_journal_commands(state);
+        size_t first_entry = (first_command < n_commands ?
+                              commands[first_command].first_entry :
+                              n_entries);
+
+        memmove(commands,
+                commands + first_command,
+                (n_commands - first_command) * sizeof *commands);
+        pcx_buffer_set_length(&state->journal_commands,
+                              (n_commands - first_command) *
+                              sizeof *commands);
+
+        for (size_t i = 0; i < n_commands - first_command; i++)
+                commands[i].first_entry -= first_entry;
+
+        struct pcx_avt_state_journal_entry *entries =
+                get_journal_entries(state);
+
+        memmove(entries,
+                entries + first_entry,
+                (n_entries - first_entry) * sizeof *entries);
+        pcx_buffer_set_length(&state->journal_entries,
+                              (n_entries - first_entry) * sizeof *entries);
+
+        state->journal_n_done -= first_command;
+        state->journal_first_command = 0;
+}
+
+/* Forgets the oldest commands until the journal fits in the limit */
+static void
+trim_journal(struct pcx_avt_state *state)
+{
+        while (state->journal_first_command < state->journal_n_done &&
+               get_journal_size(state) > state->undo_limit)
+                state->journal_first_command++;
+
+        /* Moving the data is only worth it once the forgotten
+         * commands take up at least half of the buffers.
          */
-        memmove(state->message_buf.data,
-                state->message_buf.data + state->message_buf_pos,
-                state->message_buf.length - state->message_buf_pos);
-        state->message_buf.length -= state->message_buf_pos;
-        state->message_buf_pos = state->message_buf.length;
+        size_t total_size = (state->journal_entries.length +
+                             state->journal_commands.length);
 
-        state->rule_recursion_depth = 0;
+        if (state->journal_first_command > 0 &&
+            get_journal_size(state) * 2 <= total_size)
+                compact_journal(state);
+}
 
-        if (state->game_over) {
-                send_message(state, "La ludo jam finiĝis.");
+/* Starts recording the changes made by a command. The returned
+ * command should be passed to end_journal_command.
+ */
+static struct pcx_avt_state_journal_command
+begin_journal_command(struct pcx_avt_state *state)
+{
+        struct pcx_avt_state_journal_command command = {
+                .first_entry = get_n_journal_entries(state),
+                .references_before = state->previous_references,
+        };
+
+        state->journal_recording = state->undo_limit > 0;
+
+        return command;
+}
+
+static void
+end_journal_command(struct pcx_avt_state *state,
+                    struct pcx_avt_state_journal_command *command)
+{
+        if (!state->journal_recording)
                 return;
-        }
 
-        if (pcx_avt_command_parse(command_str, &command)) {
-                get_references(state, &command, &references);
+        state->journal_recording = false;
 
-                handle_command(state, &command, &references);
+        size_t n_entries = get_n_journal_entries(state);
+        size_t n_new_entries = n_entries - command->first_entry;
 
-                state->previous_references = references;
-        } else {
-                send_message(state, "Mi ne komprenas vin.");
+        /* Commands that don’t change anything, such as looking
+         * around, aren’t remembered so that they don’t have to be
+         * undone separately and they don’t stop the player from
+         * redoing.
+         */
+        if (n_new_entries == 0)
+                return;
+
+        /* Otherwise the new command replaces anything that could be
+         * redone.
+         */
+        size_t n_done = state->journal_n_done;
+
+        if (n_done < get_n_journal_commands(state)) {
+                size_t redo_start =
+                        get_journal_commands(state)[n_done].first_entry;
+                struct pcx_avt_state_journal_entry *entries =
+                        get_journal_entries(state);
+
+                memmove(entries + redo_start,
+                        entries + command->first_entry,
+                        n_new_entries * sizeof *entries);
+                pcx_buffer_set_length(&state->journal_entries,
+                                      (redo_start + n_new_entries) *
+                                      sizeof *entries);
+                pcx_buffer_set_length(&state->journal_commands,
+                                      n_done * sizeof *command);
+
+                command->first_entry = redo_start;
         }
 
-        after_command(state);
-}
+        command->references_after = state->previous_references;
 
-const struct pcx_avt_state_message *
-pcx_avt_state_get_next_message(struct pcx_avt_state *state)
-{
-        if (state->message_buf_pos >= state->message_buf.length)
-                return NULL;
+        pcx_buffer_append(&state->journal_commands,
+                          command,
+                          sizeof *command);
 
-        struct pcx_avt_state_message *message =
-                (struct pcx_avt_state_message *)
-                (state->message_buf.data +
-                 state->message_buf_pos);
+        state->journal_n_done = get_n_journal_commands(state);
 
-        state->message_buf_pos +=
-                align_message_start(offsetof(struct pcx_avt_state_message,
-                                             text) +
-                                    strlen(message->text) + 1);
+        trim_journal(state);
+}
 
-        return message;
+static void
+swap_journal_location(struct pcx_avt_state *state,
+                      struct pcx_avt_state_journal_entry *entry)
+{
+        struct pcx_avt_state_movable *movable = state->movables + entry->index;
+        struct pcx_list *prev = movable->location_node.prev;
+        struct pcx_avt_state_movable *container = movable->container;
+        enum pcx_avt_location_type location_type = movable->base.location_type;
+        uint8_t location = movable->base.location;
+
+        invalidate_room_description(state, movable);
+        update_container_totals(state, movable, -1);
+        pcx_list_remove(&movable->location_node);
+        pcx_list_insert(entry->location.prev, &movable->location_node);
+        movable->container = entry->location.container;
+        movable->base.location_type = entry->location.location_type;
+        movable->base.location = entry->location.location;
+        update_container_totals(state, movable, 1);
+        invalidate_room_description(state, movable);
+
+        entry->location.prev = prev;
+        entry->location.container = container;
+        entry->location.location_type = location_type;
+        entry->location.location = location;
+
+        send_moved_event(state, movable);
 }
 
 static void
-free_movables(struct pcx_avt_state *state)
+swap_journal_movable(struct pcx_avt_state *state,
+                     struct pcx_avt_state_journal_entry *entry)
 {
-        struct pcx_avt_state_movable *movable, *tmp;
+        struct pcx_avt_state_movable *movable = state->movables + entry->index;
+        enum pcx_avt_state_movable_type type = movable->type;
+        uint16_t copied_from = movable->copied_from;
+        union pcx_avt_state_movable_data data;
+
+        remove_movable_from_name_index(state, movable);
+        update_container_totals(state, movable, -1);
+
+        memcpy(&data, &movable->base, sizeof data);
+        memcpy(&movable->base, &entry->movable.data, sizeof data);
+        memcpy(&entry->movable.data, &data, sizeof data);
+
+        /* The location is journaled separately */
+        movable->base.location_type = data.base.location_type;
+        movable->base.location = data.base.location;
+
+        movable->type = entry->movable.type;
+        movable->copied_from = entry->movable.copied_from;
+        entry->movable.type = type;
+        entry->movable.copied_from = copied_from;
+
+        add_movable_to_name_index(state, movable);
+        update_container_totals(state, movable, 1);
+        invalidate_room_description(state, movable);
+        update_timer(state, movable);
+        update_monster_schedule(state, movable);
+        send_movable_changed_event(state, movable);
+}
+
+static void
+swap_journal_entry(struct pcx_avt_state *state,
+                   struct pcx_avt_state_journal_entry *entry)
+{
+        struct pcx_avt_state_room *room;
+        int old_int;
+        uint64_t old_attributes;
+        uint32_t old_room_attributes;
+        bool old_bool;
+
+        switch (entry->type) {
+        case PCX_AVT_STATE_JOURNAL_LOCATION:
+                swap_journal_location(state, entry);
+                break;
+        case PCX_AVT_STATE_JOURNAL_MOVABLE:
+                swap_journal_movable(state, entry);
+                break;
+        case PCX_AVT_STATE_JOURNAL_ROOM:
+                room = state->rooms + entry->index;
+                old_room_attributes = room->attributes;
+                old_bool = room->visited;
+                room->attributes = entry->room.attributes;
+                room->visited = entry->room.visited;
+                entry->room.attributes = old_room_attributes;
+                entry->room.visited = old_bool;
+                send_room_attributes_event(state, entry->index);
+                break;
+        case PCX_AVT_STATE_JOURNAL_CURRENT_ROOM:
+                old_int = state->current_room;
+                state->current_room = entry->current_room;
+                entry->current_room = old_int;
+                send_current_room_event(state);
+                break;
+        case PCX_AVT_STATE_JOURNAL_POINTS:
+                old_int = state->points;
+                state->points = entry->points;
+                entry->points = old_int;
+                send_points_event(state);
+                break;
+        case PCX_AVT_STATE_JOURNAL_GAME_ATTRIBUTES:
+                old_attributes = state->game_attributes;
+                state->game_attributes = entry->game_attributes;
+                entry->game_attributes = old_attributes;
+                send_game_attributes_event(state);
+                break;
+        case PCX_AVT_STATE_JOURNAL_GAME_OVER:
+                old_bool = state->game_over;
+                state->game_over = entry->game_over;
+                entry->game_over = old_bool;
+                send_game_over_event(state);
+                break;
+        }
+}
 
-        pcx_list_for_each_safe(movable, tmp, &state->all_movables, all_node) {
-                pcx_free(movable->base.name);
-                pcx_free(movable->base.adjective);
-                pcx_free(movable);
+/* Swaps the values in all of the entries of the command with the
+ * current state. The entries are undone in reverse order and redone
+ * in the original order.
+ */
+static void
+swap_journal_command(struct pcx_avt_state *state,
+                     size_t command_num,
+                     bool undo)
+{
+        struct pcx_avt_state_journal_command *command =
+                get_journal_commands(state) + command_num;
+        struct pcx_avt_state_journal_entry *entries =
+                get_journal_entries(state);
+        size_t first_entry = command->first_entry;
+        size_t end_entry = (command_num + 1 < get_n_journal_commands(state) ?
+                            command[1].first_entry :
+                            get_n_journal_entries(state));
+
+        if (undo) {
+                for (size_t i = end_entry; i > first_entry; i--)
+                        swap_journal_entry(state, entries + i - 1);
+        } else {
+                for (size_t i = first_entry; i < end_entry; i++)
+                        swap_journal_entry(state, entries + i);
         }
+
+        state->previous_references = (undo ?
+                                      command->references_before :
+                                      command->references_after);
+
+        /* Anything that is cached could have changed */
+        invalidate_visibility(state);
+        state->monster_check_room = state->current_room;
+
+        for (int i = 0; i < PCX_AVT_N_RULE_INPUTS; i++)
+                input_changed(state, i);
 }
 
 bool
-pcx_avt_state_game_is_over(struct pcx_avt_state *state)
+pcx_avt_state_undo(struct pcx_avt_state *state)
 {
-        return state->game_over;
+        if (state->journal_n_done <= state->journal_first_command)
+                return false;
+
+        state->journal_n_done--;
+        swap_journal_command(state, state->journal_n_done, true);
+
+        return true;
 }
 
-void
-pcx_avt_state_set_random_cb(struct pcx_avt_state *state,
-                            int (* cb)(void *),
-                            void *user_data)
+bool
+pcx_avt_state_redo(struct pcx_avt_state *state)
 {
-        state->random_cb = cb;
-        state->random_cb_data = user_data;
+        if (state->journal_n_done >= get_n_journal_commands(state))
+                return false;
+
+        swap_journal_command(state, state->journal_n_done, false);
+        state->journal_n_done++;
+
+        return true;
 }
 
-const char *
-pcx_avt_state_get_current_room_name(struct pcx_avt_state *state)
+void
+pcx_avt_state_set_step_limit(struct pcx_avt_state *state,
+                             unsigned max_steps)
 {
-        if (state->game_over)
-                return "fino";
-        else if (!check_light(state))
-                return "mallume";
-        else
-                return state->avt->rooms[state->current_room].name;
+        state->step_limit = max_steps;
 }
 
 void
-pcx_avt_state_free(struct pcx_avt_state *state)
+pcx_avt_state_set_undo_limit(struct pcx_avt_state *state,
+                             size_t max_bytes)
 {
-        pcx_buffer_destroy(&state->message_buf);
+        state->undo_limit = max_bytes;
+
+        if (max_bytes == 0) {
+                pcx_buffer_set_length(&state->journal_entries, 0);
+                pcx_buffer_set_length(&state->journal_commands, 0);
+                state->journal_first_command = 0;
+                state->journal_n_done = 0;
+        } else {
+                trim_journal(state);
+        }
+}
+
+static bool
+handle_history_command(struct pcx_avt_state *state,
+                       const struct pcx_avt_command *command)
+{
+        if (!is_verb_command_and_has(command, 0))
+                return false;
+
+        if (pcx_avt_command_word_equal(&command->verb, "malfar")) {
+                if (pcx_avt_state_undo(state))
+                        send_message(state, "Vi malfaris la lastan agon.");
+                else
+                        send_message(state, "Estas nenio por malfari.");
+        } else if (pcx_avt_command_word_equal(&command->verb, "refar")) {
+                if (pcx_avt_state_redo(state))
+                        send_message(state, "Vi refaris la agon.");
+                else
+                        send_message(state, "Estas nenio por refari.");
+        } else {
+                return false;
+        }
+
+        return true;
+}
+
+static void
+find_noun_words(const struct pcx_avt *avt,
+                struct pcx_avt_command_noun *noun)
+{
+        noun->name.id = pcx_avt_find_word(avt,
+                                          noun->name.start,
+                                          noun->name.length);
+
+        if (noun->adjective.start) {
+                noun->adjective.id = pcx_avt_find_word(avt,
+                                                       noun->adjective.start,
+                                                       noun->adjective.length);
+        }
+}
+
+/* Looks up the numbers of the words once so that the rest of the
+ * command handling can compare them as integers.
+ */
+static void
+find_command_words(const struct pcx_avt *avt,
+                   struct pcx_avt_command *command)
+{
+        if ((command->has & PCX_AVT_COMMAND_HAS_VERB)) {
+                command->verb.id = pcx_avt_find_word(avt,
+                                                     command->verb.start,
+                                                     command->verb.length);
+        }
+
+        if ((command->has & PCX_AVT_COMMAND_HAS_SUBJECT))
+                find_noun_words(avt, &command->subject);
+        if ((command->has & PCX_AVT_COMMAND_HAS_OBJECT))
+                find_noun_words(avt, &command->object);
+        if ((command->has & PCX_AVT_COMMAND_HAS_TOOL))
+                find_noun_words(avt, &command->tool);
+        if ((command->has & PCX_AVT_COMMAND_HAS_DIRECTION))
+                find_noun_words(avt, &command->direction);
+        if ((command->has & PCX_AVT_COMMAND_HAS_IN))
+                find_noun_words(avt, &command->in);
+}
+
+/* Runs the first command in the text and sets next to the start of
+ * the following one, or NULL if there are no more. Returns false if
+ * the rest of the commands shouldn’t be run.
+ */
+static bool
+run_one_command(struct pcx_avt_state *state,
+                const char *text,
+                const char **next)
+{
+        struct pcx_avt_command command;
+        struct pcx_avt_state_references references;
+
+        state->rule_recursion_depth = 0;
+        state->n_steps = 0;
+        state->out_of_steps = false;
+
+        bool parsed = pcx_avt_command_parse(text, &command, next);
+
+        if (parsed)
+                find_command_words(state->avt, &command);
+
+        /* Undoing is allowed even after the game is over */
+        if (parsed && handle_history_command(state, &command))
+                return true;
+
+        if (state->game_over) {
+                send_message(state, "La ludo jam finiĝis.");
+                return false;
+        }
+
+        struct pcx_avt_state_journal_command journal_command =
+                begin_journal_command(state);
+
+        if (parsed) {
+                get_references(state, &command, &references);
+
+                handle_command(state, &command, &references);
+
+                state->previous_references = references;
+        } else {
+                send_message(state, "Mi ne komprenas vin.");
+        }
+
+        after_command(state);
+
+        end_journal_command(state, &journal_command);
+
+        return parsed && !state->out_of_steps && !state->game_over;
+}
+
+enum pcx_avt_state_command_status
+pcx_avt_state_run_command(struct pcx_avt_state *state,
+                          const char *command_str)
+{
+        /* Free up any messages that we’ve already reported to the
+         * caller. The ones that haven’t been read yet stay in the
+         * queue.
+         */
+        if (state->message_buf_pos > 0) {
+                size_t n_unread = (state->message_buf.length -
+                                   state->message_buf_pos);
+
+                memmove(state->message_buf.data,
+                        state->message_buf.data + state->message_buf_pos,
+                        n_unread);
+                pcx_buffer_set_length(&state->message_buf, n_unread);
+                state->message_buf_pos = 0;
+        }
+
+        size_t command_length = strlen(command_str);
+
+        pcx_buffer_set_length(&state->command_buf, command_length + 1);
+
+        char *normalized = (char *) state->command_buf.data;
+
+        command_length = pcx_avt_hat_normalize(normalized,
+                                               command_str,
+                                               command_length);
+        normalized[command_length] = '\0';
+
+        const char *text = normalized;
+
+        do {
+                if (!run_one_command(state, text, &text))
+                        break;
+        } while (text);
+
+        if (state->out_of_steps)
+                return PCX_AVT_STATE_COMMAND_STATUS_OUT_OF_STEPS;
+
+        return PCX_AVT_STATE_COMMAND_STATUS_OK;
+}
+
+const struct pcx_avt_state_message *
+pcx_avt_state_get_next_message(struct pcx_avt_state *state)
+{
+        if (state->message_buf_pos >= state->message_buf.length)
+                return NULL;
+
+        struct pcx_avt_state_message *message =
+                (struct pcx_avt_state_message *)
+                (state->message_buf.data +
+                 state->message_buf_pos);
+
+        state->message_buf_pos +=
+                align_message_start(offsetof(struct pcx_avt_state_message,
+                                             text) +
+                                    message->length + 1);
+
+        return message;
+}
+
+void
+pcx_avt_state_set_message_cb(struct pcx_avt_state *state,
+                             bool (* cb)(const struct pcx_avt_state_message *,
+                                         void *),
+                             void *user_data)
+{
+        state->message_cb = cb;
+        state->message_cb_data = user_data;
+}
+
+void
+pcx_avt_state_set_event_cb(struct pcx_avt_state *state,
+                           void (* cb)(const struct pcx_avt_state_event *,
+                                       void *),
+                           void *user_data)
+{
+        state->event_cb = cb;
+        state->event_cb_data = user_data;
+}
+
+bool
+pcx_avt_state_game_is_over(struct pcx_avt_state *state)
+{
+        return state->game_over;
+}
+
+void
+pcx_avt_state_set_random_cb(struct pcx_avt_state *state,
+                            int (* cb)(void *),
+                            void *user_data)
+{
+        state->random_cb = cb;
+        state->random_cb_data = user_data;
+}
+
+void
+pcx_avt_state_set_seed(struct pcx_avt_state *state,
+                       uint64_t seed)
+{
+        seed_random(&state->random_state, seed);
+}
+
+void
+pcx_avt_state_seed_random_state(struct pcx_avt_state_random_state *rs,
+                                uint64_t seed)
+{
+        seed_random(rs, seed);
+}
+
+void
+pcx_avt_state_get_random_state(const struct pcx_avt_state *state,
+                               struct pcx_avt_state_random_state *random_state)
+{
+        *random_state = state->random_state;
+}
+
+void
+pcx_avt_state_set_random_state(struct pcx_avt_state *state,
+                               const struct pcx_avt_state_random_state *rs)
+{
+        /* xoshiro would only ever generate zeros from this */
+        if ((rs->s[0] | rs->s[1] | rs->s[2] | rs->s[3]) == 0)
+                seed_random(&state->random_state, 0);
+        else
+                state->random_state = *rs;
+}
+
+const char *
+pcx_avt_state_get_current_room_name(struct pcx_avt_state *state)
+{
+        if (state->game_over)
+                return "fino";
+        else if (!check_light(state))
+                return "mallume";
+        else
+                return state->avt->rooms[state->current_room].name;
+}
+
+/* Save files start with this followed by a version number */
+#define PCX_AVT_STATE_SAVE_MAGIC "AVTS"
+#define PCX_AVT_STATE_SAVE_VERSION 3
+
+/* The lists that a movable can be in are numbered like this for the
+ * save file. The contents of movable n is the list after the rooms.
+ */
+#define PCX_AVT_STATE_SAVE_LIST_NOWHERE 0
+#define PCX_AVT_STATE_SAVE_LIST_CARRYING 1
+#define PCX_AVT_STATE_SAVE_FIRST_ROOM_LIST 2
+
+struct pcx_error_domain
+pcx_avt_state_error;
+
+enum save_movable_flag {
+        SAVE_MOVABLE_COPIED = (1 << 0),
+        SAVE_MOVABLE_NAME = (1 << 1),
+        SAVE_MOVABLE_ADJECTIVE = (1 << 2),
+        SAVE_MOVABLE_ATTRIBUTES = (1 << 3),
+        SAVE_MOVABLE_STATS = (1 << 4),
+};
+
+struct save_field {
+        uint8_t offset;
+        uint8_t size;
+};
+
+#define SAVE_FIELD(type, member)                                        \
+        { offsetof(struct type, member), sizeof ((struct type *) 0)->member }
+
+/* The stats that can change while the game is running. These are
+ * saved when they are different from the movable in the pcx_avt.
+ */
+static const struct save_field
+object_save_fields[] = {
+        SAVE_FIELD(pcx_avt_object, points),
+        SAVE_FIELD(pcx_avt_object, weight),
+        SAVE_FIELD(pcx_avt_object, size),
+        SAVE_FIELD(pcx_avt_object, shot_damage),
+        SAVE_FIELD(pcx_avt_object, shots),
+        SAVE_FIELD(pcx_avt_object, hit_damage),
+        SAVE_FIELD(pcx_avt_object, stab_damage),
+        SAVE_FIELD(pcx_avt_object, food_points),
+        SAVE_FIELD(pcx_avt_object, trink_points),
+        SAVE_FIELD(pcx_avt_object, burn_time),
+        SAVE_FIELD(pcx_avt_object, end),
+        SAVE_FIELD(pcx_avt_object, container_size),
+        SAVE_FIELD(pcx_avt_object, enter_room),
+};
+
+static const struct save_field
+monster_save_fields[] = {
+        SAVE_FIELD(pcx_avt_monster, dead_object),
+        SAVE_FIELD(pcx_avt_monster, hunger),
+        SAVE_FIELD(pcx_avt_monster, thrist),
+        SAVE_FIELD(pcx_avt_monster, aggression),
+        SAVE_FIELD(pcx_avt_monster, attack),
+        SAVE_FIELD(pcx_avt_monster, protection),
+        SAVE_FIELD(pcx_avt_monster, lives),
+        SAVE_FIELD(pcx_avt_monster, escape),
+        SAVE_FIELD(pcx_avt_monster, wander),
+};
+
+static const struct pcx_avt_movable *
+get_avt_movable(const struct pcx_avt *avt,
+                size_t index)
+{
+        if (index < avt->n_objects)
+                return &avt->objects[index].base;
+        else
+                return &avt->monsters[index - avt->n_objects].base;
+}
+
+static void
+get_save_fields(const struct pcx_avt *avt,
+                size_t index,
+                const struct save_field **fields,
+                size_t *n_fields)
+{
+        if (index < avt->n_objects) {
+                *fields = object_save_fields;
+                *n_fields = PCX_N_ELEMENTS(object_save_fields);
+        } else {
+                *fields = monster_save_fields;
+                *n_fields = PCX_N_ELEMENTS(monster_save_fields);
+        }
+}
+
+static uint32_t
+get_save_field(const struct pcx_avt_movable *movable,
+               const struct save_field *field)
+{
+        const uint8_t *p = (const uint8_t *) movable + field->offset;
+
+        if (field->size == sizeof (uint16_t)) {
+                uint16_t value;
+                memcpy(&value, p, sizeof value);
+                return value;
+        }
+
+        return *p;
+}
+
+static void
+set_save_field(struct pcx_avt_movable *movable,
+               const struct save_field *field,
+               uint32_t value)
+{
+        uint8_t *p = (uint8_t *) movable + field->offset;
+
+        if (field->size == sizeof (uint16_t)) {
+                uint16_t v = value;
+                memcpy(p, &v, sizeof v);
+        } else {
+                *p = value;
+        }
+}
+
+static uint32_t
+hash_save_uint(uint32_t hash,
+               uint32_t value)
+{
+        for (int i = 0; i < 4; i++)
+                hash = (hash ^ ((value >> (i * 8)) & 0xff)) * 16777619u;
+
+        return hash;
+}
+
+static uint32_t
+hash_save_string(uint32_t hash,
+                 const char *str)
+{
+        do
+                hash = (hash ^ (uint8_t) *str) * 16777619u;
+        while (*(str++));
+
+        return hash;
+}
+
+/* Makes a hash of the parts of the game that the save file depends
+ * on so that a save won’t be loaded into a different game.
+ */
+static uint32_t
+get_save_fingerprint(const struct pcx_avt *avt)
+{
+        uint32_t hash = 2166136261u;
+
+        hash = hash_save_uint(hash, avt->n_rooms);
+        hash = hash_save_uint(hash, avt->n_objects);
+        hash = hash_save_uint(hash, avt->n_monsters);
+        hash = hash_save_uint(hash, avt->n_verbs);
+        hash = hash_save_uint(hash, avt->n_rules);
+
+        for (size_t i = 0; i < avt->n_rooms; i++)
+                hash = hash_save_string(hash, avt->rooms[i].name);
+
+        for (size_t i = 0; i < avt->n_objects + avt->n_monsters; i++)
+                hash = hash_save_string(hash, get_avt_movable(avt, i)->name);
+
+        for (size_t i = 0; i < avt->n_verbs; i++)
+                hash = hash_save_string(hash, avt->verbs[i].name);
+
+        return hash;
+}
+
+static size_t
+get_n_save_lists(const struct pcx_avt_state *state)
+{
+        return (PCX_AVT_STATE_SAVE_FIRST_ROOM_LIST +
+                state->avt->n_rooms +
+                state->n_movables);
+}
+
+static struct pcx_list *
+get_save_list(struct pcx_avt_state *state,
+              size_t list_num)
+{
+        if (list_num == PCX_AVT_STATE_SAVE_LIST_NOWHERE)
+                return &state->nowhere;
+        if (list_num == PCX_AVT_STATE_SAVE_LIST_CARRYING)
+                return &state->carrying;
+
+        list_num -= PCX_AVT_STATE_SAVE_FIRST_ROOM_LIST;
+
+        if (list_num < state->avt->n_rooms)
+                return &state->rooms[list_num].contents;
+
+        return &state->movables[list_num - state->avt->n_rooms].contents;
+}
+
+/* Returns the list that the movable is in when the game starts */
+static size_t
+get_initial_save_list(const struct pcx_avt *avt,
+                      size_t index)
+{
+        const struct pcx_avt_movable *movable = get_avt_movable(avt, index);
+        size_t first_movable_list =
+                PCX_AVT_STATE_SAVE_FIRST_ROOM_LIST + avt->n_rooms;
+
+        switch (movable->location_type) {
+        case PCX_AVT_LOCATION_TYPE_NOWHERE:
+                break;
+        case PCX_AVT_LOCATION_TYPE_CARRYING:
+                return PCX_AVT_STATE_SAVE_LIST_CARRYING;
+        case PCX_AVT_LOCATION_TYPE_IN_ROOM:
+                return PCX_AVT_STATE_SAVE_FIRST_ROOM_LIST + movable->location;
+        case PCX_AVT_LOCATION_TYPE_IN_OBJECT:
+                return first_movable_list + movable->location;
+        case PCX_AVT_LOCATION_TYPE_WITH_MONSTER:
+                return first_movable_list + avt->n_objects + movable->location;
+        }
+
+        return PCX_AVT_STATE_SAVE_LIST_NOWHERE;
+}
+
+static void
+write_save_varint(struct pcx_buffer *buffer,
+                  uint64_t value)
+{
+        while (value >= 0x80) {
+                pcx_buffer_append_c(buffer, (value & 0x7f) | 0x80);
+                value >>= 7;
+        }
+
+        pcx_buffer_append_c(buffer, value);
+}
+
+static void
+write_save_uint32(struct pcx_buffer *buffer,
+                  uint32_t value)
+{
+        for (int i = 0; i < 4; i++)
+                pcx_buffer_append_c(buffer, value >> (i * 8));
+}
+
+static void
+write_save_reference(struct pcx_buffer *buffer,
+                     const struct pcx_avt_state_reference *ref)
+{
+        uint64_t value = ref->movable ? ref->movable->index + 1 : 0;
+
+        write_save_varint(buffer, (value << 1) | ref->plural);
+}
+
+/* Returns the index of a movable in the pcx_avt that has the string
+ * as its name or adjective. The strings are always shared with the
+ * pcx_avt so they are compared by pointer.
+ */
+static size_t
+find_save_string_source(const struct pcx_avt *avt,
+                        const char *str,
+                        bool adjective)
+{
+        size_t n_movables = avt->n_objects + avt->n_monsters;
+
+        for (size_t i = 0; i < n_movables; i++) {
+                const struct pcx_avt_movable *movable =
+                        get_avt_movable(avt, i);
+
+                if ((adjective ? movable->adjective : movable->name) == str)
+                        return i;
+        }
+
+        /* An adjective can only be removed by copying it from a
+         * movable that doesn’t have one so there should always be
+         * one to find.
+         */
+        assert(!"string not found in the pcx_avt");
+
+        return 0;
+}
+
+static void
+write_save_movable(const struct pcx_avt_state *state,
+                   const struct pcx_avt_state_movable *movable,
+                   struct pcx_buffer *buffer)
+{
+        const struct pcx_avt *avt = state->avt;
+        const struct pcx_avt_movable *original =
+                get_avt_movable(avt, movable->copied_from);
+        const struct save_field *fields;
+        size_t n_fields;
+        uint32_t changed_fields = 0;
+        unsigned flags = 0;
+
+        get_save_fields(avt, movable->copied_from, &fields, &n_fields);
+
+        for (size_t i = 0; i < n_fields; i++) {
+                if (get_save_field(&movable->base, fields + i) !=
+                    get_save_field(original, fields + i))
+                        changed_fields |= 1 << i;
+        }
+
+        if (movable->copied_from != movable->index)
+                flags |= SAVE_MOVABLE_COPIED;
+        if (movable->base.name != original->name)
+                flags |= SAVE_MOVABLE_NAME;
+        if (movable->base.adjective != original->adjective)
+                flags |= SAVE_MOVABLE_ADJECTIVE;
+        if (movable->base.attributes != original->attributes)
+                flags |= SAVE_MOVABLE_ATTRIBUTES;
+        if (changed_fields)
+                flags |= SAVE_MOVABLE_STATS;
+
+        if (flags == 0)
+                return;
+
+        write_save_varint(buffer, movable->index);
+        pcx_buffer_append_c(buffer, flags);
+
+        if ((flags & SAVE_MOVABLE_COPIED))
+                write_save_varint(buffer, movable->copied_from);
+        if ((flags & SAVE_MOVABLE_NAME)) {
+                write_save_varint(buffer,
+                                  find_save_string_source(avt,
+                                                          movable->base.name,
+                                                          false));
+        }
+        if ((flags & SAVE_MOVABLE_ADJECTIVE)) {
+                write_save_varint(buffer,
+                                  find_save_string_source(avt,
+                                                          movable->base.
+                                                          adjective,
+                                                          true));
+        }
+        if ((flags & SAVE_MOVABLE_ATTRIBUTES))
+                write_save_varint(buffer, movable->base.attributes);
+        if ((flags & SAVE_MOVABLE_STATS)) {
+                write_save_varint(buffer, changed_fields);
+
+                for (size_t i = 0; i < n_fields; i++) {
+                        if ((changed_fields & (1 << i))) {
+                                write_save_varint(buffer,
+                                                  get_save_field(&movable->base,
+                                                                 fields + i));
+                        }
+                }
+        }
+}
+
+/* Returns whether the list has exactly the same movables in the same
+ * order as it did at the start of the game.
+ */
+static bool
+save_list_is_unchanged(struct pcx_avt_state *state,
+                       size_t list_num,
+                       const int *initial_counts)
+{
+        const struct pcx_avt_state_movable *movable;
+        int count = 0;
+        int last_index = -1;
+
+        pcx_list_for_each(movable,
+                          get_save_list(state, list_num),
+                          location_node) {
+                if (movable->index <= last_index ||
+                    get_initial_save_list(state->avt, movable->index) !=
+                    list_num)
+                        return false;
+
+                last_index = movable->index;
+                count++;
+        }
+
+        return count == initial_counts[list_num];
+}
+
+static void
+write_save_lists(struct pcx_avt_state *state,
+                 struct pcx_buffer *buffer)
+{
+        size_t n_lists = get_n_save_lists(state);
+        int *initial_counts = pcx_calloc(n_lists * sizeof (int));
+
+        for (size_t i = 0; i < state->n_movables; i++)
+                initial_counts[get_initial_save_list(state->avt, i)]++;
+
+        /* The nowhere list isn’t saved. Anything that isn’t in a
+         * saved list and isn’t in an unchanged list must be nowhere.
+         */
+        for (size_t list_num = PCX_AVT_STATE_SAVE_LIST_CARRYING;
+             list_num < n_lists;
+             list_num++) {
+                if (save_list_is_unchanged(state, list_num, initial_counts))
+                        continue;
+
+                struct pcx_list *list = get_save_list(state, list_num);
+                const struct pcx_avt_state_movable *movable;
+
+                write_save_varint(buffer, list_num);
+                write_save_varint(buffer, pcx_list_length(list));
+
+                pcx_list_for_each(movable, list, location_node)
+                        write_save_varint(buffer, movable->index);
+        }
+
+        /* The nowhere list number terminates the lists */
+        write_save_varint(buffer, PCX_AVT_STATE_SAVE_LIST_NOWHERE);
+
+        pcx_free(initial_counts);
+}
+
+static void
+write_save_monster_schedule(struct pcx_avt_state *state,
+                            struct pcx_buffer *buffer)
+{
+        /* The schedule is saved so that the game carries on with the
+         * same random numbers after loading. The turns are saved
+         * relative to the current turn.
+         */
+        size_t n_wakeups = get_n_wakeups(state);
+        const struct pcx_avt_state_wakeup *wakeups = get_wakeups(state);
+
+        write_save_varint(buffer, n_wakeups);
+
+        for (size_t i = 0; i < n_wakeups; i++) {
+                write_save_varint(buffer, wakeups[i].movable);
+                write_save_varint(buffer, wakeups[i].turn - state->turn);
+        }
+}
+
+void
+pcx_avt_state_save(struct pcx_avt_state *state,
+                   struct pcx_buffer *buffer)
+{
+        const struct pcx_avt *avt = state->avt;
+
+        pcx_buffer_append(buffer,
+                          PCX_AVT_STATE_SAVE_MAGIC,
+                          strlen(PCX_AVT_STATE_SAVE_MAGIC));
+        pcx_buffer_append_c(buffer, PCX_AVT_STATE_SAVE_VERSION);
+
+        uint32_t fingerprint = get_save_fingerprint(avt);
+
+        write_save_uint32(buffer, fingerprint);
+
+        write_save_varint(buffer, state->current_room);
+        pcx_buffer_append_c(buffer, state->game_over);
+        /* Zigzag encoding in case the points are negative */
+        write_save_varint(buffer,
+                          ((uint64_t) state->points << 1) ^
+                          (uint64_t) (state->points >> 31));
+        write_save_varint(buffer, state->game_attributes);
+
+        for (int i = 0; i < 4; i++)
+                write_save_uint32(buffer, state->random_state.s[i]);
+
+        const struct pcx_avt_state_references *refs =
+                &state->previous_references;
+
+        write_save_reference(buffer, &refs->object);
+        write_save_reference(buffer, &refs->tool);
+        write_save_reference(buffer, &refs->in);
+        write_save_reference(buffer, &refs->direction);
+
+        int n_changed_rooms = 0;
+
+        for (size_t i = 0; i < avt->n_rooms; i++) {
+                if (state->rooms[i].visited ||
+                    state->rooms[i].attributes != avt->rooms[i].attributes)
+                        n_changed_rooms++;
+        }
+
+        write_save_varint(buffer, n_changed_rooms);
+
+        for (size_t i = 0; i < avt->n_rooms; i++) {
+                const struct pcx_avt_state_room *room = state->rooms + i;
+
+                if (!room->visited &&
+                    room->attributes == avt->rooms[i].attributes)
+                        continue;
+
+                write_save_varint(buffer, i);
+                write_save_varint(buffer, room->attributes);
+                pcx_buffer_append_c(buffer, room->visited);
+        }
+
+        for (size_t i = 0; i < state->n_movables; i++)
+                write_save_movable(state, state->movables + i, buffer);
+
+        /* The movables are terminated by an invalid index */
+        write_save_varint(buffer, state->n_movables);
+
+        write_save_lists(state, buffer);
+
+        write_save_monster_schedule(state, buffer);
+}
+
+struct save_reader {
+        const uint8_t *data;
+        size_t length;
+        size_t pos;
+};
+
+static bool
+read_save_varint(struct save_reader *reader,
+                 uint64_t *value_out)
+{
+        uint64_t value = 0;
+
+        for (int shift = 0; shift < 64; shift += 7) {
+                if (reader->pos >= reader->length)
+                        return false;
+
+                uint8_t byte = reader->data[reader->pos++];
+
+                value |= (uint64_t) (byte & 0x7f) << shift;
+
+                if ((byte & 0x80) == 0) {
+                        *value_out = value;
+                        return true;
+                }
+        }
+
+        return false;
+}
+
+/* Reads a number and checks that it is less than limit */
+static bool
+read_save_number(struct save_reader *reader,
+                 uint64_t limit,
+                 size_t *value_out)
+{
+        uint64_t value;
+
+        if (!read_save_varint(reader, &value) || value >= limit)
+                return false;
+
+        *value_out = value;
+
+        return true;
+}
+
+static bool
+read_save_byte(struct save_reader *reader,
+               uint8_t *value_out)
+{
+        if (reader->pos >= reader->length)
+                return false;
+
+        *value_out = reader->data[reader->pos++];
+
+        return true;
+}
+
+static bool
+read_save_uint32(struct save_reader *reader,
+                 uint32_t *value_out)
+{
+        if (reader->length - reader->pos < 4)
+                return false;
+
+        const uint8_t *p = reader->data + reader->pos;
+
+        *value_out = (p[0] |
+                      (p[1] << 8) |
+                      (p[2] << 16) |
+                      ((uint32_t) p[3] << 24));
+
+        reader->pos += 4;
+
+        return true;
+}
+
+static bool
+read_save_reference(struct pcx_avt_state *state,
+                    struct save_reader *reader,
+                    struct pcx_avt_state_reference *ref)
+{
+        size_t value;
+
+        if (!read_save_number(reader, (state->n_movables + 1) * 2, &value))
+                return false;
+
+        ref->plural = value & 1;
+        ref->movable = ((value >> 1) == 0 ?
+                        NULL :
+                        state->movables + (value >> 1) - 1);
+
+        return true;
+}
+
+static bool
+read_save_movable(struct pcx_avt_state *state,
+                  struct save_reader *reader,
+                  size_t index)
+{
+        const struct pcx_avt *avt = state->avt;
+        struct pcx_avt_state_movable *movable = state->movables + index;
+        uint8_t flags;
+        size_t copied_from = index;
+        size_t name_source, adjective_source;
+        uint64_t attributes, changed_fields = 0;
+
+        if (!read_save_byte(reader, &flags))
+                return false;
+
+        if ((flags & SAVE_MOVABLE_COPIED) &&
+            !read_save_number(reader, state->n_movables, &copied_from))
+                return false;
+
+        const struct pcx_avt_movable *original =
+                get_avt_movable(avt, copied_from);
+
+        name_source = adjective_source = copied_from;
+
+        if ((flags & SAVE_MOVABLE_NAME) &&
+            !read_save_number(reader, state->n_movables, &name_source))
+                return false;
+        if ((flags & SAVE_MOVABLE_ADJECTIVE) &&
+            !read_save_number(reader, state->n_movables, &adjective_source))
+                return false;
+
+        attributes = original->attributes;
+
+        if ((flags & SAVE_MOVABLE_ATTRIBUTES) &&
+            !read_save_varint(reader, &attributes))
+                return false;
+        if ((flags & SAVE_MOVABLE_STATS) &&
+            !read_save_varint(reader, &changed_fields))
+                return false;
+
+        remove_movable_from_name_index(state, movable);
+        update_container_totals(state, movable, -1);
+
+        enum pcx_avt_location_type location_type =
+                movable->base.location_type;
+        uint8_t location = movable->base.location;
+
+        if (copied_from < avt->n_objects) {
+                movable->type = PCX_AVT_STATE_MOVABLE_TYPE_OBJECT;
+                movable->object = avt->objects[copied_from];
+        } else {
+                movable->type = PCX_AVT_STATE_MOVABLE_TYPE_MONSTER;
+                movable->monster =
+                        avt->monsters[copied_from - avt->n_objects];
+        }
+
+        movable->copied_from = copied_from;
+        movable->base.location_type = location_type;
+        movable->base.location = location;
+        const struct pcx_avt_movable *name_movable =
+                get_avt_movable(avt, name_source);
+        const struct pcx_avt_movable *adjective_movable =
+                get_avt_movable(avt, adjective_source);
+
+        movable->base.name = name_movable->name;
+        movable->base.name_word = name_movable->name_word;
+        movable->base.adjective = adjective_movable->adjective;
+        movable->base.adjective_word = adjective_movable->adjective_word;
+        movable->base.attributes = attributes;
+
+        const struct save_field *fields;
+        size_t n_fields;
+        bool ret = true;
+
+        get_save_fields(avt, copied_from, &fields, &n_fields);
+
+        for (size_t i = 0; i < n_fields; i++) {
+                size_t value;
+
+                if ((changed_fields & (UINT64_C(1) << i)) == 0)
+                        continue;
+
+                if (!read_save_number(reader,
+                                      UINT64_C(1) << (fields[i].size * 8),
+                                      &value)) {
+                        ret = false;
+                        break;
+                }
+
+                set_save_field(&movable->base, fields + i, value);
+        }
+
+        add_movable_to_name_index(state, movable);
+        update_container_totals(state, movable, 1);
+        invalidate_room_description(state, movable);
+        invalidate_visibility(state);
+        update_timer(state, movable);
+
+        return ret;
+}
+
+static bool
+read_save_lists(struct pcx_avt_state *state,
+                struct save_reader *reader)
+{
+        size_t n_lists = get_n_save_lists(state);
+        size_t lists_start = reader->pos;
+        size_t list_num, n_movables, index;
+
+        /* First empty all of the lists that changed */
+        while (true) {
+                if (!read_save_number(reader, n_lists, &list_num))
+                        return false;
+
+                if (list_num == PCX_AVT_STATE_SAVE_LIST_NOWHERE)
+                        break;
+
+                if (!read_save_number(reader,
+                                      state->n_movables + 1,
+                                      &n_movables))
+                        return false;
+
+                for (size_t i = 0; i < n_movables; i++) {
+                        if (!read_save_number(reader,
+                                              state->n_movables,
+                                              &index))
+                                return false;
+                }
+
+                struct pcx_list *list = get_save_list(state, list_num);
+
+                while (!pcx_list_empty(list)) {
+                        struct pcx_avt_state_movable *movable =
+                                pcx_container_of(list->next,
+                                                 struct pcx_avt_state_movable,
+                                                 location_node);
+                        disappear_movable(state, movable);
+                }
+        }
+
+        reader->pos = lists_start;
+
+        /* Now fill them again in the saved order. The numbers have
+         * already been validated in the first pass.
+         */
+        while (true) {
+                read_save_number(reader, n_lists, &list_num);
+
+                if (list_num == PCX_AVT_STATE_SAVE_LIST_NOWHERE)
+                        break;
+
+                read_save_number(reader, state->n_movables + 1, &n_movables);
+
+                for (size_t i = 0; i < n_movables; i++) {
+                        read_save_number(reader, state->n_movables, &index);
+
+                        struct pcx_avt_state_movable *movable =
+                                state->movables + index;
+
+                        if (list_num == PCX_AVT_STATE_SAVE_LIST_CARRYING) {
+                                carry_movable(state, movable);
+                                continue;
+                        }
+
+                        size_t room_num =
+                                list_num - PCX_AVT_STATE_SAVE_FIRST_ROOM_LIST;
+
+                        if (room_num < state->avt->n_rooms) {
+                                put_movable_in_room(state, room_num, movable);
+                                continue;
+                        }
+
+                        /* This doesn’t check for cycles because a
+                         * rule can already put a movable inside
+                         * itself.
+                         */
+                        reparent_movable(state,
+                                         state->movables +
+                                         room_num - state->avt->n_rooms,
+                                         movable);
+                }
+        }
+
+        return true;
+}
+
+static bool
+read_save_monster_schedule(struct pcx_avt_state *state,
+                           struct save_reader *reader)
+{
+        size_t n_wakeups;
+
+        if (!read_save_number(reader, state->n_movables + 1, &n_wakeups))
+                return false;
+
+        /* The entries are added one at a time rather than trusting
+         * that the file has them in heap order. Each movable can only
+         * be in the schedule once and it must be a monster.
+         */
+        for (size_t i = 0; i < n_wakeups; i++) {
+                size_t movable;
+                uint64_t delay;
+
+                if (!read_save_number(reader, state->n_movables, &movable) ||
+                    !read_save_varint(reader, &delay) ||
+                    delay > PCX_AVT_STATE_MAX_WANDER_DELAY)
+                        return false;
+
+                const struct pcx_avt_state_movable *m =
+                        state->movables + movable;
+
+                if (m->type != PCX_AVT_STATE_MOVABLE_TYPE_MONSTER ||
+                    monster_is_scheduled(state, m))
+                        return false;
+
+                struct pcx_avt_state_wakeup wakeup = {
+                        .turn = state->turn + delay,
+                        .movable = movable,
+                };
+
+                add_wakeup(state, &wakeup);
+        }
+
+        return true;
+}
+
+static bool
+read_save(struct pcx_avt_state *state,
+          struct save_reader *reader)
+{
+        const struct pcx_avt *avt = state->avt;
+        size_t current_room;
+        uint8_t game_over;
+        uint64_t points, game_attributes;
+
+        if (!read_save_number(reader, avt->n_rooms, &current_room) ||
+            !read_save_byte(reader, &game_over) ||
+            !read_save_varint(reader, &points) ||
+            !read_save_varint(reader, &game_attributes))
+                return false;
+
+        set_current_room(state, current_room);
+        state->game_over = game_over;
+        state->points = (int) ((points >> 1) ^ -(points & 1));
+        set_game_attributes(state, game_attributes);
+
+        struct pcx_avt_state_random_state random_state;
+
+        for (int i = 0; i < 4; i++) {
+                if (!read_save_uint32(reader, random_state.s + i))
+                        return false;
+        }
+
+        pcx_avt_state_set_random_state(state, &random_state);
+
+        struct pcx_avt_state_references *refs = &state->previous_references;
+
+        if (!read_save_reference(state, reader, &refs->object) ||
+            !read_save_reference(state, reader, &refs->tool) ||
+            !read_save_reference(state, reader, &refs->in) ||
+            !read_save_reference(state, reader, &refs->direction))
+                return false;
+
+        size_t n_changed_rooms;
+
+        if (!read_save_number(reader, avt->n_rooms + 1, &n_changed_rooms))
+                return false;
+
+        for (size_t i = 0; i < n_changed_rooms; i++) {
+                size_t room_num;
+                uint64_t attributes;
+                uint8_t visited;
+
+                if (!read_save_number(reader, avt->n_rooms, &room_num) ||
+                    !read_save_varint(reader, &attributes) ||
+                    !read_save_byte(reader, &visited))
+                        return false;
+
+                set_room_attributes(state, room_num, attributes);
+                state->rooms[room_num].visited = visited;
+        }
+
+        while (true) {
+                size_t index;
+
+                if (!read_save_number(reader, state->n_movables + 1, &index))
+                        return false;
+
+                if (index == state->n_movables)
+                        break;
+
+                if (!read_save_movable(state, reader, index))
+                        return false;
+        }
+
+        if (!read_save_lists(state, reader))
+                return false;
+
+        if (!read_save_monster_schedule(state, reader))
+                return false;
+
+        state->monster_check_room = state->current_room;
+
+        return reader->pos == reader->length;
+}
+
+struct pcx_avt_state *
+pcx_avt_state_load(const struct pcx_avt *avt,
+                   const uint8_t *data,
+                   size_t length,
+                   struct pcx_error **error)
+{
+        size_t magic_length = strlen(PCX_AVT_STATE_SAVE_MAGIC);
+        size_t header_length = magic_length + 1 + sizeof (uint32_t);
+
+        if (length < header_length ||
+            memcmp(data, PCX_AVT_STATE_SAVE_MAGIC, magic_length)) {
+                pcx_set_error(error,
+                              &pcx_avt_state_error,
+                              PCX_AVT_STATE_ERROR_INVALID_SAVE,
+                              "The data is not a saved game");
+                return NULL;
+        }
+
+        if (data[magic_length] != PCX_AVT_STATE_SAVE_VERSION) {
+                pcx_set_error(error,
+                              &pcx_avt_state_error,
+                              PCX_AVT_STATE_ERROR_UNSUPPORTED_VERSION,
+                              "The saved game has an unsupported version");
+                return NULL;
+        }
+
+        const uint8_t *p = data + magic_length + 1;
+        uint32_t fingerprint = (p[0] |
+                                (p[1] << 8) |
+                                (p[2] << 16) |
+                                ((uint32_t) p[3] << 24));
+
+        if (fingerprint != get_save_fingerprint(avt)) {
+                pcx_set_error(error,
+                              &pcx_avt_state_error,
+                              PCX_AVT_STATE_ERROR_WRONG_GAME,
+                              "The saved game is for a different game");
+                return NULL;
+        }
+
+        struct pcx_avt_state *state = create_initial_state(avt);
+        struct save_reader reader = {
+                .data = data,
+                .length = length,
+                .pos = header_length,
+        };
+
+        if (!read_save(state, &reader)) {
+                pcx_avt_state_free(state);
+                pcx_set_error(error,
+                              &pcx_avt_state_error,
+                              PCX_AVT_STATE_ERROR_INVALID_SAVE,
+                              "The saved game is corrupt");
+                return NULL;
+        }
+
+        return state;
+}
+
+void
+pcx_avt_state_free(struct pcx_avt_state *state)
+{
+        pcx_buffer_destroy(&state->message_buf);
+
+        pcx_free(state->movables);
+
+        pcx_free(state->condition_cache);
+        pcx_free(state->timer_bits);
+        pcx_free(state->scheduled_bits);
+        pcx_free(state->present_bits);
+        pcx_free(state->name_buckets);
+        pcx_buffer_destroy(&state->name_entries);
+        pcx_buffer_destroy(&state->journal_entries);
+        pcx_buffer_destroy(&state->journal_commands);
+        pcx_buffer_destroy(&state->monster_schedule);
 
-        free_movables(state);
+        for (size_t i = 0; i < state->avt->n_rooms; i++)
+                pcx_buffer_destroy(&state->rooms[i].description);
 
-        pcx_free(state->object_index);
-        pcx_free(state->monster_index);
         pcx_free(state->rooms);
 
         pcx_buffer_destroy(&state->stack);
+        pcx_buffer_destroy(&state->command_buf);
 
         pcx_free(state);
 }
@@ -20,8 +20,20 @@
 #define PCX_AVT_STATE_H
 
 #include "pcx-avt.h"
+#include "pcx-buffer.h"
+#include "pcx-error.h"
+
+extern struct pcx_error_domain
+pcx_avt_state_error;
+
+enum pcx_avt_state_error {
+        PCX_AVT_STATE_ERROR_INVALID_SAVE,
+        PCX_AVT_STATE_ERROR_UNSUPPORTED_VERSION,
+        PCX_AVT_STATE_ERROR_WRONG_GAME,
+};
 
 struct pcx_avt_state;
+struct pcx_avt_state_template;
 
 enum pcx_avt_state_message_type {
         PCX_AVT_STATE_MESSAGE_TYPE_NORMAL,
@@ -33,36 +45,269 @@ enum pcx_avt_state_message_type {
 
 struct pcx_avt_state_message {
         enum pcx_avt_state_message_type type;
+        /* The length of the text in bytes, not including the
+         * terminator.
+         */
+        uint32_t length;
         /* Null-terminated string containing the text */
         char text[];
 };
 
+enum pcx_avt_state_event_type {
+        /* A movable moved to a different location */
+        PCX_AVT_STATE_EVENT_MOVED,
+        /* The attributes, name or adjective of a movable changed */
+        PCX_AVT_STATE_EVENT_MOVABLE_CHANGED,
+        PCX_AVT_STATE_EVENT_ROOM_ATTRIBUTES,
+        PCX_AVT_STATE_EVENT_GAME_ATTRIBUTES,
+        /* The player moved to a different room */
+        PCX_AVT_STATE_EVENT_CURRENT_ROOM,
+        PCX_AVT_STATE_EVENT_POINTS,
+        PCX_AVT_STATE_EVENT_GAME_OVER,
+        /* The actions of a rule are about to be run */
+        PCX_AVT_STATE_EVENT_RULE,
+};
+
+/* The movables are numbered with the objects first followed by the
+ * monsters in the order of the pcx_avt. Rooms and rules are numbered
+ * by their position in the pcx_avt.
+ */
+struct pcx_avt_state_event {
+        enum pcx_avt_state_event_type type;
+
+        union {
+                struct {
+                        int movable;
+                        enum pcx_avt_location_type location_type;
+                        /* The room number for
+                         * PCX_AVT_LOCATION_TYPE_IN_ROOM, the number
+                         * of the containing movable for
+                         * PCX_AVT_LOCATION_TYPE_IN_OBJECT and
+                         * PCX_AVT_LOCATION_TYPE_WITH_MONSTER or -1
+                         * otherwise.
+                         */
+                        int location;
+                } moved;
+                struct {
+                        int movable;
+                        uint32_t attributes;
+                } movable_changed;
+                struct {
+                        int room;
+                        uint32_t attributes;
+                } room_attributes;
+                uint64_t game_attributes;
+                int current_room;
+                /* The new total */
+                int points;
+                bool game_over;
+                int rule;
+        };
+};
+
+/* The internal state of the random number generator that each
+ * pcx_avt_state owns. It is copied by pcx_avt_state_clone and saved by
+ * pcx_avt_state_save.
+ */
+struct pcx_avt_state_random_state {
+        uint32_t s[4];
+};
+
 struct pcx_avt_state *
 pcx_avt_state_new(const struct pcx_avt *avt);
 
+/* Creates a new state like pcx_avt_state_new but with the random
+ * number generator set to the given state before anything is run.
+ * The rules in the first turn of the game can already use random
+ * numbers so setting the generator afterwards would leave that turn
+ * the same in every game.
+ */
+struct pcx_avt_state *
+pcx_avt_state_new_with_random(const struct pcx_avt *avt,
+                              const struct pcx_avt_state_random_state *rs);
+
+/* Prepares the starting state of a game so that new states can be
+ * created from it quickly with pcx_avt_state_new_from_template. This
+ * is useful when the same game is started many times. The pcx_avt
+ * must stay alive for as long as the template.
+ */
+struct pcx_avt_state_template *
+pcx_avt_state_template_new(const struct pcx_avt *avt);
+
+/* Creates a new state in the same way as pcx_avt_state_new_with_random,
+ * or pcx_avt_state_new if rs is NULL. The new state doesn’t depend on
+ * the template so the template can be freed first.
+ */
+struct pcx_avt_state *
+pcx_avt_state_new_from_template(const struct pcx_avt_state_template *template,
+                                const struct pcx_avt_state_random_state *rs);
+
+void
+pcx_avt_state_template_free(struct pcx_avt_state_template *template);
+
+/* Creates a copy of the state including any messages that are waiting
+ * in the queue. The copy can then carry on independently of the
+ * original. The random, message and event callbacks are also copied
+ * so they should be set again if their user data can’t be shared.
+ */
+struct pcx_avt_state *
+pcx_avt_state_clone(const struct pcx_avt_state *state);
+
+/* Appends a compact description of the game to the buffer so that it
+ * can be restored later with pcx_avt_state_load. Only the parts that
+ * differ from the start of the game are saved. The message queue
+ * isn’t saved.
+ */
 void
+pcx_avt_state_save(struct pcx_avt_state *state,
+                   struct pcx_buffer *buffer);
+
+/* Creates a new state from data made by pcx_avt_state_save. The
+ * data must have been saved from a state for the same game. No
+ * messages are queued. Returns NULL and sets the error if the data
+ * can’t be loaded.
+ */
+struct pcx_avt_state *
+pcx_avt_state_load(const struct pcx_avt *avt,
+                   const uint8_t *data,
+                   size_t length,
+                   struct pcx_error **error);
+
+enum pcx_avt_state_command_status {
+        PCX_AVT_STATE_COMMAND_STATUS_OK,
+        /* The command needed more steps than the limit set with
+         * pcx_avt_state_set_step_limit. The changes that it made
+         * before reaching the limit are kept and no more rules are
+         * run for it.
+         */
+        PCX_AVT_STATE_COMMAND_STATUS_OUT_OF_STEPS,
+};
+
+/* Runs the commands that the player typed. The text can contain
+ * several commands separated by punctuation or by “kaj”, such as
+ * “prenu la lampon, iru norden kaj rigardu”. They are run one after
+ * the other in the same way as if they were typed separately, so each
+ * one can be undone on its own. The rest of the commands are skipped
+ * if one of them isn’t understood, runs out of steps or ends the
+ * game. The messages of all of the commands are queued together.
+ */
+enum pcx_avt_state_command_status
 pcx_avt_state_run_command(struct pcx_avt_state *state,
                           const char *command);
 
+/* Sets the maximum number of steps that running a single command can
+ * take, so that a game with rules that trigger each other many times
+ * can’t use too much time. Each rule that runs and each of its actions
+ * is a step. Zero means no limit, which is the default.
+ */
+void
+pcx_avt_state_set_step_limit(struct pcx_avt_state *state,
+                             unsigned max_steps);
+
+/* Reverts the changes made by the last command that hasn’t already
+ * been undone. This is the same as the player typing “malfaru”
+ * except that no message is queued. Returns false if there is
+ * nothing to undo. The history isn’t copied by
+ * pcx_avt_state_clone or pcx_avt_state_save.
+ */
+bool
+pcx_avt_state_undo(struct pcx_avt_state *state);
+
+/* Makes the changes of the last undone command again. This is the
+ * same as the player typing “refaru” except that no message is
+ * queued. Running any other command forgets the undone commands.
+ * Returns false if there is nothing to redo.
+ */
+bool
+pcx_avt_state_redo(struct pcx_avt_state *state);
+
+/* Sets the maximum number of bytes to use to remember the changes
+ * made by each command so that they can be undone. When the limit is
+ * reached the oldest commands are forgotten first. Zero disables
+ * undo.
+ */
+void
+pcx_avt_state_set_undo_limit(struct pcx_avt_state *state,
+                             size_t max_bytes);
+
 /* Returns the next message in the queue or NULL if there are no more
  * messages. The returned data is owned by the pcx_avt_state and is
- * valid until the next call to pcx_avt_state_run_command.
+ * valid until the next call to pcx_avt_state_run_command. Messages
+ * that haven’t been read by then are kept in the queue in front of
+ * the messages of the next command.
  */
 const struct pcx_avt_state_message *
 pcx_avt_state_get_next_message(struct pcx_avt_state *state);
 
+/* Sets a callback to be called with each message as soon as it is
+ * complete instead of adding it to the queue. The message points
+ * into memory owned by the state and is only valid until the
+ * callback returns, so the host can consume it without it being
+ * copied. The callback returns false if the host has no room for the
+ * message. The message is then added to the queue instead, along
+ * with all of the messages after it until the host has read the
+ * queue with pcx_avt_state_get_next_message, so the order is kept.
+ * The callback must not call any other functions on the state.
+ * Setting the callback to NULL queues the messages again.
+ */
+void
+pcx_avt_state_set_message_cb(struct pcx_avt_state *state,
+                             bool (* cb)(const struct pcx_avt_state_message *,
+                                         void *),
+                             void *user_data);
+
+/* Sets a callback to be called whenever something changes in the
+ * state, so that a client can follow the game without querying it
+ * after every command. The events are also sent for the changes made
+ * by undoing and redoing. The event is only valid until the callback
+ * returns and the callback must not modify the state.
+ */
+void
+pcx_avt_state_set_event_cb(struct pcx_avt_state *state,
+                           void (* cb)(const struct pcx_avt_state_event *,
+                                       void *),
+                           void *user_data);
+
 bool
 pcx_avt_state_game_is_over(struct pcx_avt_state *state);
 
 /* Sets a callback to use for generating random numbers. The number
  * returned should be in the range [0,99] inclusive. If this isn’t
- * called then rand() will be used. This is mostly just for debugging.
+ * called, or cb is NULL, then the state’s own generator will be used.
+ * This is mostly just for debugging.
  */
 void
 pcx_avt_state_set_random_cb(struct pcx_avt_state *state,
                             int (* cb)(void *),
                             void *user_data);
 
+/* Resets the random number generator so that the same seed always
+ * gives the same results. A new state always starts with the same
+ * seed and the first turn has already been run by the time this can
+ * be called, so a host that wants each game to be different should
+ * create the state with pcx_avt_state_new_with_random instead.
+ */
+void
+pcx_avt_state_set_seed(struct pcx_avt_state *state,
+                       uint64_t seed);
+
+/* Fills in a random state in the same way as pcx_avt_state_set_seed */
+void
+pcx_avt_state_seed_random_state(struct pcx_avt_state_random_state *rs,
+                                uint64_t seed);
+
+void
+pcx_avt_state_get_random_state(const struct pcx_avt_state *state,
+                               struct pcx_avt_state_random_state *random_state);
+
+/* Restores the generator to a state returned by
+ * pcx_avt_state_get_random_state. It can also be set to random data,
+ * except that all zeros is treated the same as a seed of zero.
+ */
+void
+pcx_avt_state_set_random_state(struct pcx_avt_state *state,
+                               const struct pcx_avt_state_random_state *rs);
+
 const char *
 pcx_avt_state_get_current_room_name(struct pcx_avt_state *state);
 
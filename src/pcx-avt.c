@@ -20,7 +20,995 @@
 
 #include "pcx-avt.h"
 
+#include <string.h>
+#include <stddef.h>
+
 #include "pcx-util.h"
+#include "pcx-buffer.h"
+#include "pcx-avt-hat.h"
+
+const char * const
+pcx_avt_special_verb_names[PCX_AVT_N_SPECIAL_VERBS] = {
+        [PCX_AVT_SPECIAL_VERB_EST] = "est",
+        [PCX_AVT_SPECIAL_VERB_PRISKRIB] = "priskrib",
+        [PCX_AVT_SPECIAL_VERB_FAJRIG] = "fajrig",
+        [PCX_AVT_SPECIAL_VERB_FIN] = "fin",
+        [PCX_AVT_SPECIAL_VERB_LEG] = "leg",
+        [PCX_AVT_SPECIAL_VERB_BRULIG] = "brulig",
+        [PCX_AVT_SPECIAL_VERB_JXET] = "ĵet",
+        [PCX_AVT_SPECIAL_VERB_PREN] = "pren",
+        [PCX_AVT_SPECIAL_VERB_MET] = "met",
+        [PCX_AVT_SPECIAL_VERB_ENIR] = "enir",
+        [PCX_AVT_SPECIAL_VERB_ELIR] = "elir",
+        [PCX_AVT_SPECIAL_VERB_RIGARD] = "rigard",
+        [PCX_AVT_SPECIAL_VERB_NORDENIR] = "nordenir",
+        [PCX_AVT_SPECIAL_VERB_ORIENTENIR] = "orientenir",
+        [PCX_AVT_SPECIAL_VERB_SUDENIR] = "sudenir",
+        [PCX_AVT_SPECIAL_VERB_OKCIDENTENIR] = "okcidentenir",
+        [PCX_AVT_SPECIAL_VERB_SUPRENIR] = "suprenir",
+        [PCX_AVT_SPECIAL_VERB_SUBENIR] = "subenir",
+};
+
+static size_t
+count_movable_words(const struct pcx_avt_movable *movable)
+{
+        return 2 + movable->n_aliases * 2;
+}
+
+static size_t
+count_words(const struct pcx_avt *avt)
+{
+        size_t n_words = avt->n_verbs;
+
+        for (size_t i = 0; i < avt->n_objects; i++)
+                n_words += count_movable_words(&avt->objects[i].base);
+
+        for (size_t i = 0; i < avt->n_monsters; i++)
+                n_words += count_movable_words(&avt->monsters[i].base);
+
+        for (size_t i = 0; i < avt->n_rooms; i++)
+                n_words += avt->rooms[i].n_directions;
+
+        return n_words;
+}
+
+uint32_t
+pcx_avt_find_word(const struct pcx_avt *avt,
+                  const char *word,
+                  size_t length)
+{
+        if (avt->word_hash_size == 0)
+                return PCX_AVT_NO_WORD;
+
+        size_t mask = avt->word_hash_size - 1;
+        size_t pos = pcx_avt_hat_hash_word(word, length) & mask;
+
+        while (avt->word_hash[pos] != PCX_AVT_NO_WORD) {
+                uint32_t word_num = avt->word_hash[pos];
+                const char *other = avt->words[word_num - 1];
+
+                if (!strncmp(word, other, length) && other[length] == '\0')
+                        return word_num;
+
+                pos = (pos + 1) & mask;
+        }
+
+        return PCX_AVT_NO_WORD;
+}
+
+static uint32_t
+add_word(struct pcx_avt *avt,
+         const char *name)
+{
+        if (name == NULL)
+                return PCX_AVT_NO_WORD;
+
+        /* The name is left as it was written so that it can be shown
+         * to the player. The vocabulary has its own copy in the
+         * canonical form.
+         */
+        char *word = pcx_strdup(name);
+
+        pcx_avt_hat_normalize_string(word);
+
+        size_t mask = avt->word_hash_size - 1;
+        size_t pos = pcx_avt_hat_hash_string(word) & mask;
+
+        while (avt->word_hash[pos] != PCX_AVT_NO_WORD) {
+                uint32_t word_num = avt->word_hash[pos];
+
+                if (!strcmp(word, avt->words[word_num - 1])) {
+                        pcx_free(word);
+                        return word_num;
+                }
+
+                pos = (pos + 1) & mask;
+        }
+
+        avt->words[avt->n_words++] = word;
+        avt->word_hash[pos] = avt->n_words;
+
+        return avt->n_words;
+}
+
+static void
+add_movable_words(struct pcx_avt *avt,
+                  struct pcx_avt_movable *movable)
+{
+        movable->name_word = add_word(avt, movable->name);
+        movable->adjective_word = add_word(avt, movable->adjective);
+
+        for (size_t i = 0; i < movable->n_aliases; i++) {
+                struct pcx_avt_alias *alias = movable->aliases + i;
+
+                alias->name_word = add_word(avt, alias->name);
+                alias->adjective_word = add_word(avt, alias->adjective);
+        }
+}
+
+/* Gives every word that the player can use to refer to something in
+ * the game a number so that the interpreter can compare the numbers
+ * instead of the strings.
+ */
+static void
+build_vocabulary(struct pcx_avt *avt)
+{
+        size_t max_words = count_words(avt);
+        size_t size = 8;
+
+        while (size < max_words * 2)
+                size *= 2;
+
+        avt->word_hash_size = size;
+        avt->word_hash = pcx_calloc(size * sizeof *avt->word_hash);
+        avt->words = pcx_alloc(max_words * sizeof *avt->words);
+        avt->n_words = 0;
+
+        for (size_t i = 0; i < avt->n_objects; i++)
+                add_movable_words(avt, &avt->objects[i].base);
+
+        for (size_t i = 0; i < avt->n_monsters; i++)
+                add_movable_words(avt, &avt->monsters[i].base);
+
+        for (size_t i = 0; i < avt->n_rooms; i++) {
+                struct pcx_avt_room *room = avt->rooms + i;
+
+                for (size_t j = 0; j < room->n_directions; j++) {
+                        struct pcx_avt_direction *dir = room->directions + j;
+
+                        dir->name_word = add_word(avt, dir->name);
+                }
+        }
+
+        uint32_t *verb_words = pcx_alloc(avt->n_verbs * sizeof *verb_words);
+
+        for (size_t i = 0; i < avt->n_verbs; i++)
+                verb_words[i] = add_word(avt, avt->verbs[i].name);
+
+        avt->word_verbs = pcx_calloc((avt->n_words + 1) *
+                                     sizeof *avt->word_verbs);
+
+        /* If two verbs have the same name then the first one is used,
+         * which is what happened with a linear search.
+         */
+        for (size_t i = avt->n_verbs; i > 0; i--)
+                avt->word_verbs[verb_words[i - 1]] = avt->verbs + i - 1;
+
+        pcx_free(verb_words);
+}
+
+const struct pcx_avt_verb *
+pcx_avt_find_verb(const struct pcx_avt *avt,
+                  const char *word,
+                  size_t length)
+{
+        if (avt->word_verbs == NULL)
+                return NULL;
+
+        return avt->word_verbs[pcx_avt_find_word(avt, word, length)];
+}
+
+static void
+add_instruction(struct pcx_buffer *code,
+                enum pcx_avt_opcode op,
+                enum pcx_avt_rule_subject subject,
+                unsigned arg,
+                uint32_t value)
+{
+        struct pcx_avt_instruction instruction = {
+                .op = op,
+                .subject = subject,
+                .arg = arg,
+                .value = value,
+        };
+
+        pcx_buffer_append(code, &instruction, sizeof instruction);
+}
+
+static uint32_t
+get_attribute_mask(uint8_t attribute)
+{
+        return attribute < 32 ? (UINT32_C(1) << attribute) : 0;
+}
+
+static int
+get_object_stat_offset(enum pcx_avt_condition condition)
+{
+        switch (condition) {
+        case PCX_AVT_CONDITION_SHOTS:
+                return offsetof(struct pcx_avt_object, shots);
+        case PCX_AVT_CONDITION_WEIGHT:
+                return offsetof(struct pcx_avt_object, weight);
+        case PCX_AVT_CONDITION_SIZE:
+                return offsetof(struct pcx_avt_object, size);
+        case PCX_AVT_CONDITION_CONTAINER_SIZE:
+                return offsetof(struct pcx_avt_object, container_size);
+        case PCX_AVT_CONDITION_BURN_TIME:
+                return offsetof(struct pcx_avt_object, burn_time);
+        default:
+                break;
+        }
+
+        return -1;
+}
+
+static void
+compile_condition(const struct pcx_avt *avt,
+                  const struct pcx_avt_condition_data *condition,
+                  struct pcx_buffer *code)
+{
+        enum pcx_avt_rule_subject subject = condition->subject;
+        unsigned data = condition->data;
+        uint32_t mask = get_attribute_mask(data);
+        unsigned monster = avt->n_objects + data;
+        enum pcx_avt_opcode op;
+        unsigned arg = 0;
+        uint32_t value = 0;
+
+        switch (condition->condition) {
+        case PCX_AVT_CONDITION_IN_ROOM:
+                op = PCX_AVT_OP_IN_ROOM;
+                arg = data;
+                break;
+        case PCX_AVT_CONDITION_OBJECT_IS:
+                op = PCX_AVT_OP_IS_MOVABLE;
+                arg = data;
+                break;
+        case PCX_AVT_CONDITION_MONSTER_IS:
+                op = PCX_AVT_OP_IS_MOVABLE;
+                arg = monster;
+                break;
+        case PCX_AVT_CONDITION_ANOTHER_OBJECT_PRESENT:
+                op = PCX_AVT_OP_MOVABLE_PRESENT;
+                arg = data;
+                break;
+        case PCX_AVT_CONDITION_ANOTHER_MONSTER_PRESENT:
+                op = PCX_AVT_OP_MOVABLE_PRESENT;
+                arg = monster;
+                break;
+        case PCX_AVT_CONDITION_SHOTS:
+        case PCX_AVT_CONDITION_WEIGHT:
+        case PCX_AVT_CONDITION_SIZE:
+        case PCX_AVT_CONDITION_CONTAINER_SIZE:
+        case PCX_AVT_CONDITION_BURN_TIME:
+                op = PCX_AVT_OP_OBJECT_STAT_AT_LEAST;
+                arg = get_object_stat_offset(condition->condition);
+                value = data;
+                break;
+        case PCX_AVT_CONDITION_SOMETHING:
+                op = PCX_AVT_OP_SOMETHING;
+                break;
+        case PCX_AVT_CONDITION_NOTHING:
+                op = PCX_AVT_OP_NOTHING;
+                break;
+        case PCX_AVT_CONDITION_NONE:
+                /* Always passes so there’s no need to check it */
+                return;
+        case PCX_AVT_CONDITION_OBJECT_ATTRIBUTE:
+                op = PCX_AVT_OP_OBJECT_ATTRIBUTE;
+                value = mask;
+                break;
+        case PCX_AVT_CONDITION_NOT_OBJECT_ATTRIBUTE:
+                op = PCX_AVT_OP_NOT_OBJECT_ATTRIBUTE;
+                value = mask;
+                break;
+        case PCX_AVT_CONDITION_ROOM_ATTRIBUTE:
+                op = PCX_AVT_OP_ROOM_ATTRIBUTE;
+                value = mask;
+                break;
+        case PCX_AVT_CONDITION_NOT_ROOM_ATTRIBUTE:
+                op = PCX_AVT_OP_NOT_ROOM_ATTRIBUTE;
+                value = mask;
+                break;
+        case PCX_AVT_CONDITION_MONSTER_ATTRIBUTE:
+                op = PCX_AVT_OP_MONSTER_ATTRIBUTE;
+                value = mask;
+                break;
+        case PCX_AVT_CONDITION_NOT_MONSTER_ATTRIBUTE:
+                op = PCX_AVT_OP_NOT_MONSTER_ATTRIBUTE;
+                value = mask;
+                break;
+        case PCX_AVT_CONDITION_PLAYER_ATTRIBUTE:
+                op = PCX_AVT_OP_PLAYER_ATTRIBUTE;
+                value = mask;
+                break;
+        case PCX_AVT_CONDITION_NOT_PLAYER_ATTRIBUTE:
+                op = PCX_AVT_OP_NOT_PLAYER_ATTRIBUTE;
+                value = mask;
+                break;
+        case PCX_AVT_CONDITION_CHANCE:
+                op = PCX_AVT_OP_CHANCE;
+                value = data;
+                break;
+        case PCX_AVT_CONDITION_OBJECT_SAME_ADJECTIVE:
+                op = PCX_AVT_OP_SAME_ADJECTIVE;
+                arg = data;
+                break;
+        case PCX_AVT_CONDITION_MONSTER_SAME_ADJECTIVE:
+                op = PCX_AVT_OP_SAME_ADJECTIVE;
+                arg = monster;
+                break;
+        case PCX_AVT_CONDITION_OBJECT_SAME_NAME:
+                op = PCX_AVT_OP_SAME_NAME;
+                arg = data;
+                break;
+        case PCX_AVT_CONDITION_MONSTER_SAME_NAME:
+                op = PCX_AVT_OP_SAME_NAME;
+                arg = monster;
+                break;
+        case PCX_AVT_CONDITION_OBJECT_SAME_NOUN:
+                op = PCX_AVT_OP_SAME_NOUN;
+                arg = data;
+                break;
+        case PCX_AVT_CONDITION_MONSTER_SAME_NOUN:
+                op = PCX_AVT_OP_SAME_NOUN;
+                arg = monster;
+                break;
+        default:
+                op = PCX_AVT_OP_FAIL;
+                break;
+        }
+
+        add_instruction(code, op, subject, arg, value);
+}
+
+static int
+get_object_stat_action_offset(enum pcx_avt_action action)
+{
+        switch (action) {
+        case PCX_AVT_ACTION_CHANGE_END:
+                return offsetof(struct pcx_avt_object, end);
+        case PCX_AVT_ACTION_CHANGE_SHOTS:
+                return offsetof(struct pcx_avt_object, shots);
+        case PCX_AVT_ACTION_CHANGE_WEIGHT:
+                return offsetof(struct pcx_avt_object, weight);
+        case PCX_AVT_ACTION_CHANGE_SIZE:
+                return offsetof(struct pcx_avt_object, size);
+        case PCX_AVT_ACTION_CHANGE_CONTAINER_SIZE:
+                return offsetof(struct pcx_avt_object, container_size);
+        case PCX_AVT_ACTION_CHANGE_BURN_TIME:
+                return offsetof(struct pcx_avt_object, burn_time);
+        default:
+                break;
+        }
+
+        return -1;
+}
+
+static void
+compile_action(const struct pcx_avt *avt,
+               const struct pcx_avt_action_data *action,
+               struct pcx_buffer *code)
+{
+        enum pcx_avt_rule_subject subject = action->subject;
+        unsigned data = action->data;
+        uint32_t mask = get_attribute_mask(data);
+        unsigned monster = avt->n_objects + data;
+        enum pcx_avt_opcode op;
+        unsigned arg = 0;
+        uint32_t value = 0;
+
+        switch (action->action) {
+        case PCX_AVT_ACTION_MOVE_TO:
+                /* If the action is the room action then the player
+                 * moves, otherwise the object moves.
+                 */
+                if (subject == PCX_AVT_RULE_SUBJECT_ROOM)
+                        op = PCX_AVT_OP_MOVE_PLAYER;
+                else
+                        op = PCX_AVT_OP_MOVE_TO_ROOM;
+                arg = data;
+                break;
+        case PCX_AVT_ACTION_MOVE_INTO:
+                op = PCX_AVT_OP_MOVE_INTO;
+                arg = data;
+                break;
+        case PCX_AVT_ACTION_REPLACE_OBJECT_IN_ROOM:
+        case PCX_AVT_ACTION_REPLACE_OBJECT_IN_ROOM_2:
+                op = PCX_AVT_OP_REPLACE_IN_ROOM;
+                arg = data;
+                break;
+        case PCX_AVT_ACTION_REPLACE_MONSTER_IN_ROOM:
+        case PCX_AVT_ACTION_REPLACE_MONSTER_IN_ROOM_2:
+                op = PCX_AVT_OP_REPLACE_IN_ROOM;
+                arg = monster;
+                break;
+        case PCX_AVT_ACTION_REPLACE_OBJECT:
+                op = PCX_AVT_OP_REPLACE;
+                arg = data;
+                break;
+        case PCX_AVT_ACTION_ANOTHER_OBJECT_APPEAR:
+                op = PCX_AVT_OP_APPEAR;
+                arg = data;
+                break;
+        case PCX_AVT_ACTION_CHANGE_END:
+        case PCX_AVT_ACTION_CHANGE_SHOTS:
+        case PCX_AVT_ACTION_CHANGE_WEIGHT:
+        case PCX_AVT_ACTION_CHANGE_SIZE:
+        case PCX_AVT_ACTION_CHANGE_CONTAINER_SIZE:
+        case PCX_AVT_ACTION_CHANGE_BURN_TIME:
+                op = PCX_AVT_OP_SET_OBJECT_STAT;
+                arg = get_object_stat_action_offset(action->action);
+                value = data;
+                break;
+        case PCX_AVT_ACTION_SOMETHING:
+        case PCX_AVT_ACTION_NOTHING_ROOM:
+                /* These don’t do anything */
+                return;
+        case PCX_AVT_ACTION_NOTHING:
+                op = PCX_AVT_OP_DISAPPEAR;
+                break;
+        case PCX_AVT_ACTION_CARRY:
+                op = PCX_AVT_OP_CARRY;
+                break;
+        case PCX_AVT_ACTION_CARRY_ANOTHER_OBJECT:
+                op = PCX_AVT_OP_CARRY_MOVABLE;
+                arg = data;
+                break;
+        case PCX_AVT_ACTION_SET_OBJECT_ATTRIBUTE:
+                op = PCX_AVT_OP_SET_OBJECT_ATTRIBUTE;
+                value = mask;
+                break;
+        case PCX_AVT_ACTION_UNSET_OBJECT_ATTRIBUTE:
+                op = PCX_AVT_OP_UNSET_OBJECT_ATTRIBUTE;
+                value = mask;
+                break;
+        case PCX_AVT_ACTION_SET_ROOM_ATTRIBUTE:
+                op = PCX_AVT_OP_SET_ROOM_ATTRIBUTE;
+                value = mask;
+                break;
+        case PCX_AVT_ACTION_UNSET_ROOM_ATTRIBUTE:
+                op = PCX_AVT_OP_UNSET_ROOM_ATTRIBUTE;
+                value = mask;
+                break;
+        case PCX_AVT_ACTION_SET_MONSTER_ATTRIBUTE:
+                op = PCX_AVT_OP_SET_MONSTER_ATTRIBUTE;
+                value = mask;
+                break;
+        case PCX_AVT_ACTION_UNSET_MONSTER_ATTRIBUTE:
+                op = PCX_AVT_OP_UNSET_MONSTER_ATTRIBUTE;
+                value = mask;
+                break;
+        case PCX_AVT_ACTION_SET_PLAYER_ATTRIBUTE:
+                op = PCX_AVT_OP_SET_PLAYER_ATTRIBUTE;
+                value = mask;
+                break;
+        case PCX_AVT_ACTION_UNSET_PLAYER_ATTRIBUTE:
+                op = PCX_AVT_OP_UNSET_PLAYER_ATTRIBUTE;
+                value = mask;
+                break;
+        case PCX_AVT_ACTION_CHANGE_OBJECT_ADJECTIVE:
+                op = PCX_AVT_OP_CHANGE_ADJECTIVE;
+                arg = data;
+                break;
+        case PCX_AVT_ACTION_CHANGE_MONSTER_ADJECTIVE:
+                op = PCX_AVT_OP_CHANGE_ADJECTIVE;
+                arg = monster;
+                break;
+        case PCX_AVT_ACTION_CHANGE_OBJECT_NAME:
+                op = PCX_AVT_OP_CHANGE_NAME;
+                arg = data;
+                break;
+        case PCX_AVT_ACTION_CHANGE_MONSTER_NAME:
+                op = PCX_AVT_OP_CHANGE_NAME;
+                arg = monster;
+                break;
+        case PCX_AVT_ACTION_COPY_OBJECT:
+                op = PCX_AVT_OP_COPY;
+                arg = data;
+                break;
+        case PCX_AVT_ACTION_COPY_MONSTER:
+                op = PCX_AVT_OP_COPY;
+                arg = monster;
+                break;
+        case PCX_AVT_ACTION_RUN_RULE:
+                op = PCX_AVT_OP_RUN_RULE;
+                arg = data;
+                break;
+        default:
+                return;
+        }
+
+        add_instruction(code, op, subject, arg, value);
+}
+
+static void
+add_condition_inputs(const struct pcx_avt_instruction *ins,
+                     struct pcx_avt_rule *rule)
+{
+        switch ((enum pcx_avt_opcode) ins->op) {
+        case PCX_AVT_OP_MOVABLE_PRESENT:
+                /* Whether a movable is present depends on where it
+                 * is, whether its containers are closed and whether
+                 * there is light in the player’s room.
+                 */
+                rule->inputs |= ((1 << PCX_AVT_RULE_INPUT_CURRENT_ROOM) |
+                                 (1 << PCX_AVT_RULE_INPUT_ROOM_ATTRIBUTES) |
+                                 (1 << PCX_AVT_RULE_INPUT_MOVABLES));
+                break;
+        case PCX_AVT_OP_ROOM_ATTRIBUTE:
+        case PCX_AVT_OP_NOT_ROOM_ATTRIBUTE:
+                rule->inputs |= 1 << PCX_AVT_RULE_INPUT_ROOM_ATTRIBUTES;
+                break;
+        case PCX_AVT_OP_PLAYER_ATTRIBUTE:
+        case PCX_AVT_OP_NOT_PLAYER_ATTRIBUTE:
+                rule->inputs |= 1 << PCX_AVT_RULE_INPUT_GAME_ATTRIBUTES;
+                break;
+        case PCX_AVT_OP_CHANCE:
+                rule->has_chance = true;
+                break;
+        default:
+                /* The room of the rule is checked separately and the
+                 * rest of the conditions only look at the subjects.
+                 */
+                break;
+        }
+}
+
+static void
+compile_rules(struct pcx_avt *avt)
+{
+        struct pcx_buffer code = PCX_BUFFER_STATIC_INIT;
+        /* The offsets of the start of the conditions and actions for
+         * each rule. The pointers can only be set once the buffer has
+         * stopped moving.
+         */
+        size_t *offsets = pcx_alloc(avt->n_rules * 2 * sizeof *offsets);
+
+        for (size_t i = 0; i < avt->n_rules; i++) {
+                const struct pcx_avt_rule *rule = avt->rules + i;
+
+                offsets[i * 2] = code.length;
+
+                for (unsigned c = 0; c < rule->n_conditions; c++)
+                        compile_condition(avt, rule->conditions + c, &code);
+
+                add_instruction(&code, PCX_AVT_OP_END, 0, 0, 0);
+
+                offsets[i * 2 + 1] = code.length;
+
+                for (unsigned a = 0; a < rule->n_actions; a++)
+                        compile_action(avt, rule->actions + a, &code);
+
+                add_instruction(&code, PCX_AVT_OP_END, 0, 0, 0);
+        }
+
+        avt->code = (struct pcx_avt_instruction *) code.data;
+
+        for (size_t i = 0; i < avt->n_rules; i++) {
+                struct pcx_avt_rule *rule = avt->rules + i;
+
+                rule->condition_code = (const struct pcx_avt_instruction *)
+                        (code.data + offsets[i * 2]);
+                rule->action_code = (const struct pcx_avt_instruction *)
+                        (code.data + offsets[i * 2 + 1]);
+
+                for (const struct pcx_avt_instruction *ins =
+                             rule->condition_code;
+                     ins->op != PCX_AVT_OP_END;
+                     ins++)
+                        add_condition_inputs(ins, rule);
+        }
+
+        pcx_free(offsets);
+}
+
+static void
+add_text_segment(struct pcx_buffer *text_code,
+                 enum pcx_avt_text_op op,
+                 enum pcx_avt_rule_subject subject,
+                 bool suffix,
+                 const char *text,
+                 size_t length)
+{
+        /* Join neighbouring pieces of literal text, such as the
+         * text on either side of the first “$” in “$$”.
+         */
+        if (op == PCX_AVT_TEXT_OP_LITERAL && text_code->length > 0) {
+                struct pcx_avt_text_segment *last =
+                        (struct pcx_avt_text_segment *)
+                        (text_code->data + text_code->length) - 1;
+
+                if (last->op == PCX_AVT_TEXT_OP_LITERAL &&
+                    last->text + last->length == text) {
+                        last->length += length;
+                        return;
+                }
+        }
+
+        struct pcx_avt_text_segment segment = {
+                .op = op,
+                .subject = subject,
+                .suffix = suffix,
+                .length = length,
+                .text = text,
+        };
+
+        pcx_buffer_append(text_code, &segment, sizeof segment);
+}
+
+static bool
+get_text_subject(char ch,
+                 enum pcx_avt_rule_subject *subject)
+{
+        switch (ch) {
+        case 'A':
+                *subject = PCX_AVT_RULE_SUBJECT_OBJECT;
+                return true;
+        case 'P':
+                *subject = PCX_AVT_RULE_SUBJECT_TOOL;
+                return true;
+        case 'M':
+                *subject = PCX_AVT_RULE_SUBJECT_MONSTER;
+                return true;
+        case 'E':
+                *subject = PCX_AVT_RULE_SUBJECT_IN;
+                return true;
+        case '>':
+                *subject = PCX_AVT_RULE_SUBJECT_DIRECTION;
+                return true;
+        }
+
+        return false;
+}
+
+static void
+compile_text(const char *text,
+             struct pcx_buffer *text_code)
+{
+        while (true) {
+                const char *dollar = strchr(text, '$');
+
+                if (dollar == NULL)
+                        break;
+
+                if (dollar > text) {
+                        add_text_segment(text_code,
+                                         PCX_AVT_TEXT_OP_LITERAL,
+                                         0, /* subject */
+                                         false, /* suffix */
+                                         text,
+                                         dollar - text);
+                }
+
+                enum pcx_avt_rule_subject subject;
+
+                switch (dollar[1]) {
+                case '\0':
+                        /* Treat a dollar at the end as literal text */
+                        text = dollar;
+                        goto done;
+                case 'V':
+                        add_text_segment(text_code,
+                                         PCX_AVT_TEXT_OP_VERB,
+                                         0, /* subject */
+                                         false, /* suffix */
+                                         NULL, /* text */
+                                         0 /* length */);
+                        break;
+                case 'D':
+                        add_text_segment(text_code,
+                                         PCX_AVT_TEXT_OP_DELAY,
+                                         0, /* subject */
+                                         false, /* suffix */
+                                         NULL, /* text */
+                                         0 /* length */);
+                        break;
+                case 'F':
+                        /* The monsters flee. FIXME */
+                        break;
+                case 'S':
+                        add_text_segment(text_code,
+                                         PCX_AVT_TEXT_OP_SHOW_ALWAYS,
+                                         0, /* subject */
+                                         false, /* suffix */
+                                         NULL, /* text */
+                                         0 /* length */);
+                        break;
+                case '$':
+                        /* This isn’t mentioned in the docs but it
+                         * seems like a good idea.
+                         */
+                        add_text_segment(text_code,
+                                         PCX_AVT_TEXT_OP_LITERAL,
+                                         0, /* subject */
+                                         false, /* suffix */
+                                         dollar + 1,
+                                         1 /* length */);
+                        break;
+                default:
+                        if (!get_text_subject(dollar[1], &subject))
+                                break;
+
+                        bool suffix = dollar[2] == 'n';
+
+                        add_text_segment(text_code,
+                                         PCX_AVT_TEXT_OP_SUBJECT,
+                                         subject,
+                                         suffix,
+                                         NULL, /* text */
+                                         0 /* length */);
+
+                        if (suffix)
+                                dollar++;
+                        break;
+                }
+
+                text = dollar + 2;
+        }
+
+done:
+        if (*text) {
+                add_text_segment(text_code,
+                                 PCX_AVT_TEXT_OP_LITERAL,
+                                 0, /* subject */
+                                 false, /* suffix */
+                                 text,
+                                 strlen(text));
+        }
+
+        add_text_segment(text_code,
+                         PCX_AVT_TEXT_OP_END,
+                         0, /* subject */
+                         false, /* suffix */
+                         NULL, /* text */
+                         0 /* length */);
+}
+
+static void
+compile_rule_texts(struct pcx_avt *avt)
+{
+        struct pcx_buffer text_code = PCX_BUFFER_STATIC_INIT;
+        /* The offset of the segments for each rule. The pointers can
+         * only be set once the buffer has stopped moving.
+         */
+        size_t *offsets = pcx_alloc(MAX(avt->n_rules, 1) * sizeof *offsets);
+
+        for (size_t i = 0; i < avt->n_rules; i++) {
+                const struct pcx_avt_rule *rule = avt->rules + i;
+
+                offsets[i] = text_code.length;
+
+                if (rule->text)
+                        compile_text(rule->text, &text_code);
+        }
+
+        avt->text_code = (struct pcx_avt_text_segment *) text_code.data;
+
+        for (size_t i = 0; i < avt->n_rules; i++) {
+                struct pcx_avt_rule *rule = avt->rules + i;
+
+                if (rule->text) {
+                        rule->text_code = (const struct pcx_avt_text_segment *)
+                                (text_code.data + offsets[i]);
+                }
+        }
+
+        pcx_free(offsets);
+}
+
+enum rule_key_type {
+        RULE_KEY_NONE,
+        RULE_KEY_ROOM,
+        RULE_KEY_MOVABLE,
+};
+
+static enum rule_key_type
+get_rule_key(const struct pcx_avt *avt,
+             const struct pcx_avt_rule *rule,
+             unsigned *key_out)
+{
+        for (unsigned i = 0; i < rule->n_conditions; i++) {
+                const struct pcx_avt_condition_data *condition =
+                        rule->conditions + i;
+
+                switch (condition->condition) {
+                case PCX_AVT_CONDITION_IN_ROOM:
+                        *key_out = condition->data;
+                        return RULE_KEY_ROOM;
+                case PCX_AVT_CONDITION_OBJECT_IS:
+                        if (condition->subject == PCX_AVT_RULE_SUBJECT_ROOM ||
+                            condition->subject == PCX_AVT_RULE_SUBJECT_OBJECT) {
+                                *key_out = condition->data;
+                                return RULE_KEY_MOVABLE;
+                        }
+                        break;
+                case PCX_AVT_CONDITION_MONSTER_IS:
+                        if (condition->subject == PCX_AVT_RULE_SUBJECT_ROOM ||
+                            condition->subject ==
+                            PCX_AVT_RULE_SUBJECT_MONSTER) {
+                                *key_out = avt->n_objects + condition->data;
+                                return RULE_KEY_MOVABLE;
+                        }
+                        break;
+                case PCX_AVT_CONDITION_CHANCE:
+                        /* Checking the chance uses up a random number
+                         * so if it comes before the key then the rule
+                         * always has to be checked.
+                         */
+                        return RULE_KEY_NONE;
+                default:
+                        break;
+                }
+        }
+
+        return RULE_KEY_NONE;
+}
+
+static size_t
+make_buckets(const unsigned *counts,
+             size_t n_keys,
+             struct pcx_avt_rule_bucket **buckets_out,
+             unsigned *starts,
+             unsigned *next_start)
+{
+        size_t n_buckets = 0;
+
+        for (size_t key = 0; key < n_keys; key++) {
+                if (counts[key] > 0)
+                        n_buckets++;
+        }
+
+        struct pcx_avt_rule_bucket *buckets =
+                pcx_alloc(MAX(n_buckets, 1) * sizeof *buckets);
+        struct pcx_avt_rule_bucket *bucket = buckets;
+
+        for (size_t key = 0; key < n_keys; key++) {
+                if (counts[key] == 0)
+                        continue;
+
+                bucket->key = key;
+                bucket->n_rules = counts[key];
+                bucket->start = *next_start;
+                starts[key] = *next_start;
+                *next_start += counts[key];
+                bucket++;
+        }
+
+        *buckets_out = buckets;
+
+        return n_buckets;
+}
+
+static void
+build_rule_index(struct pcx_avt *avt,
+                 struct pcx_avt_verb *verb)
+{
+        size_t n_movables = avt->n_objects + avt->n_monsters;
+        unsigned *room_counts = pcx_calloc(MAX(avt->n_rooms, 1) *
+                                           sizeof (unsigned) * 2);
+        unsigned *room_starts = room_counts + avt->n_rooms;
+        unsigned *movable_counts = pcx_calloc(MAX(n_movables, 1) *
+                                              sizeof (unsigned) * 2);
+        unsigned *movable_starts = movable_counts + n_movables;
+        enum rule_key_type *key_types =
+                pcx_alloc(MAX(verb->n_rules, 1) * sizeof *key_types);
+        unsigned *keys = pcx_alloc(MAX(verb->n_rules, 1) * sizeof *keys);
+        unsigned n_shared = 0;
+
+        for (int i = 0; i < verb->n_rules; i++) {
+                const struct pcx_avt_rule *rule = avt->rules + verb->rules[i];
+
+                key_types[i] = get_rule_key(avt, rule, keys + i);
+
+                switch (key_types[i]) {
+                case RULE_KEY_NONE:
+                        n_shared++;
+                        break;
+                case RULE_KEY_ROOM:
+                        room_counts[keys[i]]++;
+                        break;
+                case RULE_KEY_MOVABLE:
+                        movable_counts[keys[i]]++;
+                        break;
+                }
+        }
+
+        unsigned next_start = 0;
+
+        verb->shared_bucket.n_rules = n_shared;
+        verb->shared_bucket.start = next_start;
+        unsigned shared_start = next_start;
+        next_start += n_shared;
+
+        verb->n_room_buckets = make_buckets(room_counts,
+                                            avt->n_rooms,
+                                            &verb->room_buckets,
+                                            room_starts,
+                                            &next_start);
+        verb->n_movable_buckets = make_buckets(movable_counts,
+                                               n_movables,
+                                               &verb->movable_buckets,
+                                               movable_starts,
+                                               &next_start);
+
+        verb->bucket_rules = pcx_alloc(MAX(verb->n_rules, 1) *
+                                       sizeof (uint16_t));
+
+        /* Add the rules in order so that each bucket will be sorted */
+        for (int i = 0; i < verb->n_rules; i++) {
+                unsigned *start;
+
+                switch (key_types[i]) {
+                case RULE_KEY_ROOM:
+                        start = room_starts + keys[i];
+                        break;
+                case RULE_KEY_MOVABLE:
+                        start = movable_starts + keys[i];
+                        break;
+                default:
+                        start = &shared_start;
+                        break;
+                }
+
+                verb->bucket_rules[(*start)++] = i;
+        }
+
+        pcx_free(keys);
+        pcx_free(key_types);
+        pcx_free(movable_counts);
+        pcx_free(room_counts);
+}
+
+const struct pcx_avt_rule_bucket *
+pcx_avt_find_rule_bucket(const struct pcx_avt_rule_bucket *buckets,
+                         size_t n_buckets,
+                         unsigned key)
+{
+        size_t min = 0, max = n_buckets;
+
+        while (min < max) {
+                size_t mid = (min + max) / 2;
+
+                if (buckets[mid].key == key)
+                        return buckets + mid;
+                else if (buckets[mid].key < key)
+                        min = mid + 1;
+                else
+                        max = mid;
+        }
+
+        return NULL;
+}
+
+void
+pcx_avt_prepare(struct pcx_avt *avt)
+{
+        build_vocabulary(avt);
+
+        for (int i = 0; i < PCX_AVT_N_SPECIAL_VERBS; i++) {
+                const char *name = pcx_avt_special_verb_names[i];
+
+                avt->special_verbs[i] =
+                        pcx_avt_find_verb(avt, name, strlen(name));
+        }
+
+        compile_rules(avt);
+        compile_rule_texts(avt);
+
+        for (size_t i = 0; i < avt->n_verbs; i++)
+                build_rule_index(avt, avt->verbs + i);
+}
 
 static void
 free_aliases(struct pcx_avt_movable *movable)
@@ -44,10 +1032,22 @@ pcx_avt_free(struct pcx_avt *avt)
         for (size_t i = 0; i < avt->n_verbs; i++) {
                 pcx_free(avt->verbs[i].name);
                 pcx_free(avt->verbs[i].rules);
+                pcx_free(avt->verbs[i].room_buckets);
+                pcx_free(avt->verbs[i].movable_buckets);
+                pcx_free(avt->verbs[i].bucket_rules);
         }
 
         pcx_free(avt->verbs);
 
+        for (size_t i = 0; i < avt->n_words; i++)
+                pcx_free(avt->words[i]);
+
+        pcx_free(avt->words);
+        pcx_free(avt->word_hash);
+        pcx_free(avt->word_verbs);
+        pcx_free(avt->code);
+        pcx_free(avt->text_code);
+
         for (size_t i = 0; i < avt->n_rooms; i++) {
                 struct pcx_avt_room *room = avt->rooms + i;
 
@@ -141,10 +141,19 @@ enum pcx_avt_action {
         PCX_AVT_ACTION_MOVE_INTO = 0x84,
 };
 
+/* The number of a word in the vocabulary of the game. Words that
+ * aren’t in the vocabulary get this number.
+ */
+#define PCX_AVT_NO_WORD 0
+
 struct pcx_avt_alias {
         bool plural;
         char *adjective;
         char *name;
+        /* The numbers of the words in pcx_avt->words. These are set
+         * by pcx_avt_prepare.
+         */
+        uint32_t adjective_word, name_word;
 };
 
 struct pcx_avt_movable {
@@ -152,6 +161,11 @@ struct pcx_avt_movable {
          * adjective can be NULL
          */
         char *name, *adjective;
+        /* The numbers of the words in pcx_avt->words, or
+         * PCX_AVT_NO_WORD if there is no adjective. These are set by
+         * pcx_avt_prepare.
+         */
+        uint32_t name_word, adjective_word;
         /* Owned by the parent pcx_avt. Can be NULL. */
         const char *description;
 
@@ -216,6 +230,8 @@ struct pcx_avt_monster {
 struct pcx_avt_direction {
         /* Owned by this. This is the root word without any endings */
         char *name;
+        /* The number of the name in pcx_avt->words */
+        uint32_t name_word;
         /* Owned by the parent pcx_avt. Can be NULL */
         const char *description;
         uint8_t target;
@@ -253,6 +269,8 @@ enum pcx_avt_rule_subject {
         PCX_AVT_RULE_SUBJECT_IN,
 };
 
+#define PCX_AVT_N_RULE_SUBJECTS (PCX_AVT_RULE_SUBJECT_IN + 1)
+
 struct pcx_avt_condition_data {
         enum pcx_avt_rule_subject subject;
         enum pcx_avt_condition condition;
@@ -265,13 +283,200 @@ struct pcx_avt_action_data {
         uint8_t data;
 };
 
+/* Verbs that the interpreter runs rules for by itself rather than
+ * because the player typed them.
+ */
+enum pcx_avt_special_verb {
+        PCX_AVT_SPECIAL_VERB_EST,
+        PCX_AVT_SPECIAL_VERB_PRISKRIB,
+        PCX_AVT_SPECIAL_VERB_FAJRIG,
+        PCX_AVT_SPECIAL_VERB_FIN,
+        PCX_AVT_SPECIAL_VERB_LEG,
+        PCX_AVT_SPECIAL_VERB_BRULIG,
+        PCX_AVT_SPECIAL_VERB_JXET,
+        PCX_AVT_SPECIAL_VERB_PREN,
+        PCX_AVT_SPECIAL_VERB_MET,
+        PCX_AVT_SPECIAL_VERB_ENIR,
+        PCX_AVT_SPECIAL_VERB_ELIR,
+        PCX_AVT_SPECIAL_VERB_RIGARD,
+        PCX_AVT_SPECIAL_VERB_NORDENIR,
+        PCX_AVT_SPECIAL_VERB_ORIENTENIR,
+        PCX_AVT_SPECIAL_VERB_SUDENIR,
+        PCX_AVT_SPECIAL_VERB_OKCIDENTENIR,
+        PCX_AVT_SPECIAL_VERB_SUPRENIR,
+        PCX_AVT_SPECIAL_VERB_SUBENIR,
+};
+
+#define PCX_AVT_N_SPECIAL_VERBS (PCX_AVT_SPECIAL_VERB_SUBENIR + 1)
+
+/* The root of each special verb, indexed by pcx_avt_special_verb */
+extern const char * const
+pcx_avt_special_verb_names[PCX_AVT_N_SPECIAL_VERBS];
+
+/* The conditions and actions of the rules are compiled into a list
+ * of instructions when the pcx_avt is prepared so that the interpreter
+ * doesn’t need to decode them every time. Movables are referenced by
+ * a single number where the monsters come after all of the objects.
+ */
+enum pcx_avt_opcode {
+        /* Ends the list of conditions or actions */
+        PCX_AVT_OP_END,
+
+        /* Conditions. The rule is skipped as soon as one fails. */
+
+        /* arg is the room */
+        PCX_AVT_OP_IN_ROOM,
+        /* arg is the movable */
+        PCX_AVT_OP_IS_MOVABLE,
+        PCX_AVT_OP_MOVABLE_PRESENT,
+        /* arg is the offset of a uint8_t in pcx_avt_object and value
+         * is the minimum.
+         */
+        PCX_AVT_OP_OBJECT_STAT_AT_LEAST,
+        PCX_AVT_OP_SOMETHING,
+        PCX_AVT_OP_NOTHING,
+        /* value is the attribute mask */
+        PCX_AVT_OP_OBJECT_ATTRIBUTE,
+        PCX_AVT_OP_NOT_OBJECT_ATTRIBUTE,
+        PCX_AVT_OP_MONSTER_ATTRIBUTE,
+        PCX_AVT_OP_NOT_MONSTER_ATTRIBUTE,
+        PCX_AVT_OP_ROOM_ATTRIBUTE,
+        PCX_AVT_OP_NOT_ROOM_ATTRIBUTE,
+        PCX_AVT_OP_PLAYER_ATTRIBUTE,
+        PCX_AVT_OP_NOT_PLAYER_ATTRIBUTE,
+        /* value is the percentage */
+        PCX_AVT_OP_CHANCE,
+        /* arg is the movable to compare with */
+        PCX_AVT_OP_SAME_ADJECTIVE,
+        PCX_AVT_OP_SAME_NAME,
+        PCX_AVT_OP_SAME_NOUN,
+        /* Used for unknown conditions */
+        PCX_AVT_OP_FAIL,
+
+        /* Actions */
+
+        /* arg is the room */
+        PCX_AVT_OP_MOVE_PLAYER,
+        PCX_AVT_OP_MOVE_TO_ROOM,
+        /* arg is the movable */
+        PCX_AVT_OP_MOVE_INTO,
+        PCX_AVT_OP_REPLACE_IN_ROOM,
+        PCX_AVT_OP_REPLACE,
+        PCX_AVT_OP_APPEAR,
+        /* arg is the offset of a uint8_t in pcx_avt_object and value
+         * is the new value.
+         */
+        PCX_AVT_OP_SET_OBJECT_STAT,
+        PCX_AVT_OP_DISAPPEAR,
+        PCX_AVT_OP_CARRY,
+        /* arg is the movable */
+        PCX_AVT_OP_CARRY_MOVABLE,
+        /* value is the attribute mask */
+        PCX_AVT_OP_SET_OBJECT_ATTRIBUTE,
+        PCX_AVT_OP_UNSET_OBJECT_ATTRIBUTE,
+        PCX_AVT_OP_SET_ROOM_ATTRIBUTE,
+        PCX_AVT_OP_UNSET_ROOM_ATTRIBUTE,
+        PCX_AVT_OP_SET_MONSTER_ATTRIBUTE,
+        PCX_AVT_OP_UNSET_MONSTER_ATTRIBUTE,
+        PCX_AVT_OP_SET_PLAYER_ATTRIBUTE,
+        PCX_AVT_OP_UNSET_PLAYER_ATTRIBUTE,
+        /* arg is the movable to copy from */
+        PCX_AVT_OP_CHANGE_ADJECTIVE,
+        PCX_AVT_OP_CHANGE_NAME,
+        PCX_AVT_OP_COPY,
+        /* arg is the rule number */
+        PCX_AVT_OP_RUN_RULE,
+};
+
+struct pcx_avt_instruction {
+        uint8_t op;
+        /* A pcx_avt_rule_subject */
+        uint8_t subject;
+        uint16_t arg;
+        uint32_t value;
+};
+
+/* The text of a rule is split into segments when the game is prepared
+ * so that the substitutions don’t have to be searched for every time
+ * the message is sent.
+ */
+enum pcx_avt_text_op {
+        /* Marks the end of the message */
+        PCX_AVT_TEXT_OP_END,
+        /* text and length are a part of the rule text to add as is */
+        PCX_AVT_TEXT_OP_LITERAL,
+        /* Adds the name of the subject. If suffix is set then “n”
+         * is added as well.
+         */
+        PCX_AVT_TEXT_OP_SUBJECT,
+        /* Adds the verb that the player typed */
+        PCX_AVT_TEXT_OP_VERB,
+        /* Starts a new message to be displayed after a delay */
+        PCX_AVT_TEXT_OP_DELAY,
+        /* Shows the rest of the text even if the player isn’t in the
+         * room of the rule.
+         */
+        PCX_AVT_TEXT_OP_SHOW_ALWAYS,
+};
+
+struct pcx_avt_text_segment {
+        uint8_t op;
+        /* A pcx_avt_rule_subject */
+        uint8_t subject;
+        bool suffix;
+        uint32_t length;
+        /* Points into pcx_avt->strings */
+        const char *text;
+};
+
+/* A list of a verb’s rules that can only pass when the rule’s room or
+ * the movable of the command is a particular one.
+ */
+struct pcx_avt_rule_bucket {
+        /* The room number or the movable number */
+        uint16_t key;
+        uint16_t n_rules;
+        /* Offset into pcx_avt_verb->bucket_rules */
+        uint16_t start;
+};
+
 struct pcx_avt_verb {
         char *name;
 
         int n_rules;
         uint16_t *rules;
+
+        /* Index of the rules so that only the ones that could match
+         * need to be checked. Every rule is in exactly one bucket.
+         * The buckets contain positions in the rules array rather
+         * than rule numbers so that merging them back together in
+         * ascending order gives the original declaration order. The
+         * room and movable buckets are sorted by key.
+         */
+        size_t n_room_buckets;
+        struct pcx_avt_rule_bucket *room_buckets;
+        size_t n_movable_buckets;
+        struct pcx_avt_rule_bucket *movable_buckets;
+        /* Rules that aren’t restricted to a room or a movable */
+        struct pcx_avt_rule_bucket shared_bucket;
+        uint16_t *bucket_rules;
 };
 
+/* Parts of the game state that the conditions of a rule depend on
+ * when it is run without any subjects, like the “est” rules that are
+ * run after every command.
+ */
+enum pcx_avt_rule_input {
+        /* The room that the player is in */
+        PCX_AVT_RULE_INPUT_CURRENT_ROOM,
+        PCX_AVT_RULE_INPUT_ROOM_ATTRIBUTES,
+        PCX_AVT_RULE_INPUT_GAME_ATTRIBUTES,
+        /* The location and attributes of any movable */
+        PCX_AVT_RULE_INPUT_MOVABLES,
+};
+
+#define PCX_AVT_N_RULE_INPUTS (PCX_AVT_RULE_INPUT_MOVABLES + 1)
+
 struct pcx_avt_rule {
         /* Owned by pcx_avt->strings. Can be NULL. */
         const char *text;
@@ -282,6 +487,25 @@ struct pcx_avt_rule {
         struct pcx_avt_condition_data *conditions;
         unsigned n_actions;
         struct pcx_avt_action_data *actions;
+
+        /* The compiled versions of the above. These point into
+         * pcx_avt->code and are terminated by PCX_AVT_OP_END.
+         */
+        const struct pcx_avt_instruction *condition_code;
+        const struct pcx_avt_instruction *action_code;
+        /* Points into pcx_avt->text_code and is terminated by
+         * PCX_AVT_TEXT_OP_END, or NULL if text is NULL.
+         */
+        const struct pcx_avt_text_segment *text_code;
+
+        /* Bitmask of (1 << pcx_avt_rule_input) for the inputs that
+         * the conditions depend on when there are no subjects.
+         */
+        uint8_t inputs;
+        /* The conditions use a random number so they always have to
+         * be checked again.
+         */
+        bool has_chance;
 };
 
 struct pcx_avt {
@@ -312,8 +536,67 @@ struct pcx_avt {
 
         /* Text to be displayed at the start of the game. Can be NULL */
         char *introduction;
+
+        /* Every different word in the names of the verbs, movables,
+         * aliases and directions. Each word is numbered by its
+         * position in the array plus one so that PCX_AVT_NO_WORD can
+         * be zero. The words are copies of the names converted to the
+         * canonical form and they are owned by the pcx_avt.
+         */
+        size_t n_words;
+        char **words;
+        /* Open-addressed hash table to find the number of a word.
+         * Each entry is a word number, or PCX_AVT_NO_WORD if the slot
+         * is empty. The size is always a power of two.
+         */
+        size_t word_hash_size;
+        uint32_t *word_hash;
+        /* The first verb with each word as its name, indexed by the
+         * word number, or NULL if the word isn’t a verb.
+         */
+        const struct pcx_avt_verb **word_verbs;
+
+        /* The verbs for the special verbs, or NULL if the game
+         * doesn’t have any rules for them.
+         */
+        const struct pcx_avt_verb *special_verbs[PCX_AVT_N_SPECIAL_VERBS];
+
+        /* The compiled instructions for all of the rules */
+        struct pcx_avt_instruction *code;
+        /* The segments of the text for all of the rules */
+        struct pcx_avt_text_segment *text_code;
 };
 
+/* Builds the lookup tables that the interpreter uses. This needs to
+ * be called once the pcx_avt is completely loaded.
+ */
+void
+pcx_avt_prepare(struct pcx_avt *avt);
+
+/* Finds the number of the given word, which must be in the canonical
+ * form made by pcx_avt_hat_normalize. Returns PCX_AVT_NO_WORD if it
+ * isn’t in the vocabulary of the game.
+ */
+uint32_t
+pcx_avt_find_word(const struct pcx_avt *avt,
+                  const char *word,
+                  size_t length);
+
+/* Finds the verb that matches the given word, which must be in the
+ * canonical form made by pcx_avt_hat_normalize. Returns NULL if there
+ * is no verb.
+ */
+const struct pcx_avt_verb *
+pcx_avt_find_verb(const struct pcx_avt *avt,
+                  const char *word,
+                  size_t length);
+
+/* Returns the bucket with the given key or NULL if there isn’t one */
+const struct pcx_avt_rule_bucket *
+pcx_avt_find_rule_bucket(const struct pcx_avt_rule_bucket *buckets,
+                         size_t n_buckets,
+                         unsigned key);
+
 void
 pcx_avt_free(struct pcx_avt *avt);
 
@@ -3189,7 +3189,9 @@ pcx_parser_parse(struct pcx_source *source,
 
         if (ret) {
                 avt = pcx_calloc(sizeof *avt);
-                if (!compile_file(&parser, avt, error)) {
+                if (compile_file(&parser, avt, error)) {
+                        pcx_avt_prepare(avt);
+                } else {
                         pcx_avt_free(avt);
                         avt = NULL;
                 }
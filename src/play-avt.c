@@ -24,6 +24,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
 
 #include "pcx-avt-state.h"
 #include "pcx-buffer.h"
@@ -202,7 +203,12 @@ main(int argc, char **argv)
                         fputc('\n', stdout);
                 }
 
-                data.state = pcx_avt_state_new(data.avt);
+                struct pcx_avt_state_random_state random_state;
+
+                pcx_avt_state_seed_random_state(&random_state, time(NULL));
+
+                data.state = pcx_avt_state_new_with_random(data.avt,
+                                                           &random_state);
 
                 print_messages(&data);
 
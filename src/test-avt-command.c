@@ -25,12 +25,33 @@
 #include <string.h>
 #include <stdlib.h>
 
+#include "pcx-avt-grammar.h"
+#include "pcx-avt-hat.h"
+
+static bool
+parse_command(const char *text,
+              struct pcx_avt_command *command)
+{
+        /* The words point into the buffer so it is only valid until
+         * the next command is parsed.
+         */
+        static char buf[128];
+        size_t length = strlen(text);
+
+        assert(length < sizeof buf);
+
+        length = pcx_avt_hat_normalize(buf, text, length);
+        buf[length] = '\0';
+
+        return pcx_avt_command_parse(buf, command, NULL);
+}
+
 static void
 check_word_order(const char *phrase)
 {
         struct pcx_avt_command command;
 
-        assert(pcx_avt_command_parse(phrase, &command));
+        assert(parse_command(phrase, &command));
 
         assert(command.has & PCX_AVT_COMMAND_HAS_SUBJECT);
         assert(!command.subject.article);
@@ -58,7 +79,7 @@ check_word_order_no_adjective(const char *phrase, bool article)
 {
         struct pcx_avt_command command;
 
-        assert(pcx_avt_command_parse(phrase, &command));
+        assert(parse_command(phrase, &command));
 
         assert(command.has & PCX_AVT_COMMAND_HAS_SUBJECT);
         assert(command.subject.article == article);
@@ -86,28 +107,98 @@ check_pronoun(const char *pronoun,
               bool plural)
 {
         struct pcx_avt_command command;
+        char expected[16];
+        size_t expected_length = pcx_avt_hat_normalize(expected,
+                                                       pronoun,
+                                                       strlen(pronoun));
 
-        assert(pcx_avt_command_parse(pronoun, &command));
+        assert(parse_command(pronoun, &command));
         assert(command.has & PCX_AVT_COMMAND_HAS_SUBJECT);
         assert(!command.subject.article);
         assert(command.subject.plural == plural);
         assert(!command.subject.accusative);
         assert(command.subject.is_pronoun);
         assert(command.subject.adjective.start == NULL);
-        assert(command.subject.name.length == strlen(pronoun));
-        assert(!memcmp(command.subject.name.start, pronoun, strlen(pronoun)));
+        assert(command.subject.name.length == expected_length);
+        assert(!memcmp(command.subject.name.start, expected, expected_length));
 
         assert(command.subject.pronoun.person == person);
         assert(command.subject.pronoun.genders == genders);
         assert(command.subject.pronoun.plural == plural);
 }
 
+static void
+check_grammar_words(void)
+{
+        for (enum pcx_avt_grammar_word word = PCX_AVT_GRAMMAR_WORD_NONE + 1;
+             word < PCX_AVT_GRAMMAR_N_WORDS;
+             word++) {
+                const char *text = pcx_avt_grammar_get_word(word);
+
+                assert(pcx_avt_grammar_find_word(text, strlen(text)) == word);
+        }
+
+        assert(pcx_avt_grammar_find_word("", 0) == PCX_AVT_GRAMMAR_WORD_NONE);
+        assert(pcx_avt_grammar_find_word("lan", 2) == PCX_AVT_GRAMMAR_WORD_LA);
+        assert(pcx_avt_grammar_find_word("lan", 3) ==
+               PCX_AVT_GRAMMAR_WORD_NONE);
+        assert(pcx_avt_grammar_find_word("nordo", 5) ==
+               PCX_AVT_GRAMMAR_WORD_NONE);
+        assert(pcx_avt_grammar_find_word("sxi", 3) ==
+               PCX_AVT_GRAMMAR_WORD_NONE);
+}
+
+static void
+check_several_commands(void)
+{
+        struct pcx_avt_command command;
+        const char *text =
+                "prenu la lampon, n kaj rigardu ĝin. iru sub la tablon! ";
+        const char *next;
+
+        assert(pcx_avt_command_parse(text, &command, &next));
+        assert(command.has == (PCX_AVT_COMMAND_HAS_VERB |
+                               PCX_AVT_COMMAND_HAS_OBJECT));
+        assert(pcx_avt_command_word_equal(&command.verb, "pren"));
+        assert(pcx_avt_command_word_equal(&command.object.name, "lamp"));
+
+        assert(pcx_avt_command_parse(next, &command, &next));
+        assert(command.has == (PCX_AVT_COMMAND_HAS_SUBJECT |
+                               PCX_AVT_COMMAND_HAS_VERB |
+                               PCX_AVT_COMMAND_HAS_DIRECTION));
+        assert(pcx_avt_command_word_equal(&command.direction.name, "nord"));
+
+        assert(pcx_avt_command_parse(next, &command, &next));
+        assert(command.has == (PCX_AVT_COMMAND_HAS_VERB |
+                               PCX_AVT_COMMAND_HAS_OBJECT));
+        assert(command.object.is_pronoun);
+
+        assert(!strcmp(next, "iru sub la tablon! "));
+
+        assert(pcx_avt_command_parse("rigardu, kaj iru norden",
+                                     &command,
+                                     &next));
+        assert(!strcmp(next, "iru norden"));
+        assert(pcx_avt_command_parse(next, &command, &next));
+        assert(next == NULL);
+
+        assert(pcx_avt_command_parse("la hundoj kaj iru", &command, &next));
+        assert(command.has == PCX_AVT_COMMAND_HAS_SUBJECT);
+        assert(command.subject.adjective.start == NULL);
+        assert(!strcmp(next, "iru"));
+
+        /* Empty commands between the separators aren’t allowed */
+        assert(!pcx_avt_command_parse(", rigardu", &command, &next));
+        assert(pcx_avt_command_parse("rigardu ,", &command, &next));
+        assert(next == NULL);
+}
+
 int
 main(int argc, char **argv)
 {
         struct pcx_avt_command command;
 
-        assert(pcx_avt_command_parse("la hundo "
+        assert(parse_command("la hundo "
                                      "ĵetu "
                                      "la raton "
                                      "al la plaĝo "
@@ -156,7 +247,7 @@ main(int argc, char **argv)
         assert(!memcmp(command.tool.name.start, "aviadil", 7));
         assert(command.tool.adjective.start == NULL);
 
-        assert(pcx_avt_command_parse("la griza hundo", &command));
+        assert(parse_command("la griza hundo", &command));
         assert(command.has == PCX_AVT_COMMAND_HAS_SUBJECT);
         assert(command.subject.article);
         assert(!command.subject.plural);
@@ -168,7 +259,7 @@ main(int argc, char **argv)
         assert(command.subject.name.length == 4);
         assert(!memcmp(command.subject.name.start, "hund", 4));
 
-        assert(pcx_avt_command_parse("grizaj hundoj", &command));
+        assert(parse_command("grizaj hundoj", &command));
         assert(command.has == PCX_AVT_COMMAND_HAS_SUBJECT);
         assert(!command.subject.article);
         assert(command.subject.plural);
@@ -180,7 +271,7 @@ main(int argc, char **argv)
         assert(command.subject.name.length == 4);
         assert(!memcmp(command.subject.name.start, "hund", 4));
 
-        assert(pcx_avt_command_parse("hundoj grizaj", &command));
+        assert(parse_command("hundoj grizaj", &command));
         assert(command.has == PCX_AVT_COMMAND_HAS_SUBJECT);
         assert(!command.subject.article);
         assert(command.subject.plural);
@@ -192,9 +283,9 @@ main(int argc, char **argv)
         assert(command.subject.name.length == 4);
         assert(!memcmp(command.subject.name.start, "hund", 4));
 
-        assert(!pcx_avt_command_parse("griza hundoj", &command));
+        assert(!parse_command("griza hundoj", &command));
 
-        assert(pcx_avt_command_parse("la hundon grizan", &command));
+        assert(parse_command("la hundon grizan", &command));
         assert(command.has == PCX_AVT_COMMAND_HAS_OBJECT);
         assert(command.object.article);
         assert(!command.object.plural);
@@ -206,9 +297,9 @@ main(int argc, char **argv)
         assert(command.object.name.length == 4);
         assert(!memcmp(command.object.name.start, "hund", 4));
 
-        assert(!pcx_avt_command_parse("la hundo grizan", &command));
+        assert(!parse_command("la hundo grizan", &command));
 
-        assert(pcx_avt_command_parse("en la skatolon blankan", &command));
+        assert(parse_command("en la skatolon blankan", &command));
         assert(command.has == PCX_AVT_COMMAND_HAS_IN);
         assert(command.in.article);
         assert(!command.in.plural);
@@ -220,7 +311,7 @@ main(int argc, char **argv)
         assert(command.in.name.length == 6);
         assert(!memcmp(command.in.name.start, "skatol", 6));
 
-        assert(pcx_avt_command_parse("en la skatoloj", &command));
+        assert(parse_command("en la skatoloj", &command));
         assert(command.has == PCX_AVT_COMMAND_HAS_IN);
         assert(command.in.article);
         assert(command.in.plural);
@@ -230,7 +321,7 @@ main(int argc, char **argv)
         assert(command.in.name.length == 6);
         assert(!memcmp(command.in.name.start, "skatol", 6));
 
-        assert(pcx_avt_command_parse("al la blanka skatolo", &command));
+        assert(parse_command("al la blanka skatolo", &command));
         assert(command.has == PCX_AVT_COMMAND_HAS_DIRECTION);
         assert(command.direction.name.length == 6);
         assert(!memcmp(command.direction.name.start, "skatol", 6));
@@ -238,12 +329,12 @@ main(int argc, char **argv)
         assert(command.direction.adjective.length == 5);
         assert(!memcmp(command.direction.adjective.start, "blank", 5));
 
-        assert(pcx_avt_command_parse("AL LA    skatolo   ", &command));
+        assert(parse_command("AL LA    skatolo   ", &command));
         assert(command.has == PCX_AVT_COMMAND_HAS_DIRECTION);
         assert(command.direction.name.length == 6);
         assert(!memcmp(command.direction.name.start, "skatol", 6));
 
-        assert(pcx_avt_command_parse("  merden   ", &command));
+        assert(parse_command("  merden   ", &command));
         assert(command.has == PCX_AVT_COMMAND_HAS_DIRECTION);
         assert(!command.direction.article);
         assert(!command.direction.plural);
@@ -252,29 +343,29 @@ main(int argc, char **argv)
         assert(command.direction.name.length == 4);
         assert(!memcmp(command.direction.name.start, "merd", 4));
 
-        assert(!pcx_avt_command_parse("hundo hundo", &command));
-        assert(!pcx_avt_command_parse("hundon hundon", &command));
-        assert(!pcx_avt_command_parse("per hundo per hundo", &command));
-        assert(!pcx_avt_command_parse("merden merden", &command));
-        assert(!pcx_avt_command_parse("en la maro en la maro", &command));
-        assert(!pcx_avt_command_parse("iru iru", &command));
+        assert(!parse_command("hundo hundo", &command));
+        assert(!parse_command("hundon hundon", &command));
+        assert(!parse_command("per hundo per hundo", &command));
+        assert(!parse_command("merden merden", &command));
+        assert(!parse_command("en la maro en la maro", &command));
+        assert(!parse_command("iru iru", &command));
 
-        assert(pcx_avt_command_parse("iras", &command));
+        assert(parse_command("iras", &command));
         assert(command.has == PCX_AVT_COMMAND_HAS_VERB);
         assert(command.verb.length == 2);
         assert(!memcmp(command.verb.start, "ir", 2));
 
-        assert(pcx_avt_command_parse("iros", &command));
+        assert(parse_command("iros", &command));
         assert(command.has == PCX_AVT_COMMAND_HAS_VERB);
         assert(command.verb.length == 2);
         assert(!memcmp(command.verb.start, "ir", 2));
 
-        assert(pcx_avt_command_parse("iri", &command));
+        assert(parse_command("iri", &command));
         assert(command.has == PCX_AVT_COMMAND_HAS_VERB);
         assert(command.verb.length == 2);
         assert(!memcmp(command.verb.start, "ir", 2));
 
-        assert(!pcx_avt_command_parse("iris", &command));
+        assert(!parse_command("iris", &command));
 
         check_word_order("blanka hundo nigran katon");
         check_word_order("hundo blanka nigran katon");
@@ -291,7 +382,7 @@ main(int argc, char **argv)
         check_word_order_no_adjective("la hundo la katon", true);
         check_word_order_no_adjective("la katon la hundo", true);
 
-        assert(pcx_avt_command_parse("al la urbo hundo iros", &command));
+        assert(parse_command("al la urbo hundo iros", &command));
         assert(command.has == (PCX_AVT_COMMAND_HAS_VERB |
                                PCX_AVT_COMMAND_HAS_SUBJECT |
                                PCX_AVT_COMMAND_HAS_DIRECTION));
@@ -354,24 +445,25 @@ main(int argc, char **argv)
                       PCX_AVT_COMMAND_GENDER_THING,
                       true);
 
-        assert(!pcx_avt_command_parse("griza ĝi", &command));
-        assert(!pcx_avt_command_parse("la ĝi", &command));
-        assert(!pcx_avt_command_parse("ĝij", &command));
+        assert(!parse_command("griza ĝi", &command));
+        assert(!parse_command("la ĝi", &command));
+        assert(!parse_command("ĝij", &command));
 
-        pcx_avt_command_parse("iru!", &command);
+        parse_command("iru!", &command);
         assert(command.has == PCX_AVT_COMMAND_HAS_VERB);
         assert(command.verb.length == 2);
         assert(!memcmp(command.verb.start, "iru", 2));
 
-        assert(pcx_avt_command_parse("iru.", &command));
-        assert(pcx_avt_command_parse("iru?", &command));
-        assert(pcx_avt_command_parse("iru  !  ", &command));
-        assert(!pcx_avt_command_parse("iru#", &command));
-        assert(!pcx_avt_command_parse("iru  !!  ", &command));
-        assert(!pcx_avt_command_parse("iru  ! vorto ", &command));
-        assert(!pcx_avt_command_parse("norden-iru", &command));
+        assert(parse_command("iru.", &command));
+        assert(parse_command("iru?", &command));
+        assert(parse_command("iru  !  ", &command));
+        assert(!parse_command("iru#", &command));
+        assert(!parse_command("iru  !!  ", &command));
+        assert(!parse_command("iru  ! vorto ", &command));
+        assert(!parse_command(".", &command));
+        assert(!parse_command("norden-iru", &command));
 
-        assert(pcx_avt_command_parse("mi manĝos mian lunĉon", &command));
+        assert(parse_command("mi manĝos mian lunĉon", &command));
         assert(command.has == (PCX_AVT_COMMAND_HAS_VERB |
                                PCX_AVT_COMMAND_HAS_SUBJECT |
                                PCX_AVT_COMMAND_HAS_OBJECT));
@@ -383,7 +475,7 @@ main(int argc, char **argv)
         assert(!command.object.is_pronoun);
         assert(!memcmp(command.object.name.start, "lunĉ", 5));
 
-        assert(pcx_avt_command_parse("mi manĝos lunĉon mian", &command));
+        assert(parse_command("mi manĝos lunĉon mian", &command));
         assert(command.has == (PCX_AVT_COMMAND_HAS_VERB |
                                PCX_AVT_COMMAND_HAS_SUBJECT |
                                PCX_AVT_COMMAND_HAS_OBJECT));
@@ -395,7 +487,40 @@ main(int argc, char **argv)
         assert(!command.object.is_pronoun);
         assert(!memcmp(command.object.name.start, "lunĉ", 5));
 
-        assert(!pcx_avt_command_parse("mi manĝos la mian lunĉon", &command));
+        assert(!parse_command("mi manĝos la mian lunĉon", &command));
+
+        /* The x-system and capital letters are converted before
+         * parsing
+         */
+        assert(parse_command("MANGXU LA ĈOKOLADAN KUKETON", &command));
+        assert(command.has == (PCX_AVT_COMMAND_HAS_VERB |
+                               PCX_AVT_COMMAND_HAS_OBJECT));
+        assert(pcx_avt_command_word_equal(&command.verb, "manĝ"));
+        assert(pcx_avt_command_word_equal(&command.object.adjective,
+                                          "ĉokolad"));
+        assert(pcx_avt_command_word_equal(&command.object.name, "kuket"));
+
+        assert(parse_command("Ŝaltu la Cxambran lampon", &command));
+        assert(pcx_avt_command_word_equal(&command.verb, "ŝalt"));
+        assert(pcx_avt_command_word_equal(&command.object.adjective,
+                                          "ĉambr"));
+        assert(pcx_avt_command_word_equal(&command.object.name, "lamp"));
+
+        assert(parse_command("  OKC ", &command));
+        assert(command.has == (PCX_AVT_COMMAND_HAS_SUBJECT |
+                               PCX_AVT_COMMAND_HAS_VERB |
+                               PCX_AVT_COMMAND_HAS_DIRECTION));
+        assert(pcx_avt_command_word_equal(&command.direction.name,
+                                          "okcident"));
+
+        assert(parse_command("Cx", &command));
+        assert(command.has == (PCX_AVT_COMMAND_HAS_SUBJECT |
+                               PCX_AVT_COMMAND_HAS_VERB));
+        assert(pcx_avt_command_word_equal(&command.verb, "ĉes"));
+
+        check_grammar_words();
+
+        check_several_commands();
 
         return EXIT_SUCCESS;
 }
@@ -24,6 +24,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <stddef.h>
+#include <stdalign.h>
 
 #include "pcx-avt-state.h"
 #include "pcx-buffer.h"
@@ -33,9 +35,45 @@ struct data {
         struct pcx_buffer command_buffer;
         struct pcx_avt *avt;
         struct pcx_avt_state *state;
+        /* The original state after the “clone” command. The test
+         * carries on with the copy and “switch” swaps the two so that
+         * they can be checked separately.
+         */
+        struct pcx_avt_state *other_state;
+        /* Created the first time the game is restarted */
+        struct pcx_avt_state_template *template;
         FILE *input;
         int line_num;
         int random_number;
+        /* After the “seed” command the state’s own random number
+         * generator is used instead of random_number.
+         */
+        bool use_seed;
+        /* After the “sink” command the messages are received with
+         * a callback and copied here. Each one is a
+         * pcx_avt_state_message followed by the text.
+         */
+        bool use_sink;
+        struct pcx_buffer sink_buffer;
+        size_t sink_pos;
+        /* After “sink_limit” the callback refuses any more messages
+         * once this many have been received since the last command
+         * so that they are queued instead. -1 if there is no limit.
+         */
+        int sink_limit;
+        int n_sunk_messages;
+        /* Set by “keep” so that the next command is run without
+         * reading the messages first.
+         */
+        bool keep_messages;
+        /* The current room and game over state as reported by the
+         * events so that they can be checked against the state. The
+         * room is -1 until an event reports it.
+         */
+        int event_room;
+        bool event_game_over;
+        /* The result of the last command */
+        enum pcx_avt_state_command_status command_status;
 };
 
 static int
@@ -46,14 +84,131 @@ random_cb(void *user_data)
         return data->random_number;
 }
 
+static size_t
+get_message_size(const struct pcx_avt_state_message *message)
+{
+        const size_t alignment = alignof(struct pcx_avt_state_message);
+        size_t size = (offsetof(struct pcx_avt_state_message, text) +
+                       message->length + 1);
+
+        return (size + alignment - 1) & ~(alignment - 1);
+}
+
+static void
+check_message_length(struct data *data,
+                     const struct pcx_avt_state_message *message)
+{
+        if (strlen(message->text) != message->length) {
+                fprintf(stderr,
+                        "Message has the wrong length at line %i: %s\n",
+                        data->line_num,
+                        message->text);
+                exit(EXIT_FAILURE);
+        }
+}
+
+static bool
+message_cb(const struct pcx_avt_state_message *message,
+           void *user_data)
+{
+        struct data *data = user_data;
+
+        check_message_length(data, message);
+
+        if (data->sink_limit >= 0 &&
+            data->n_sunk_messages >= data->sink_limit)
+                return false;
+
+        pcx_buffer_append(&data->sink_buffer,
+                          message,
+                          get_message_size(message));
+        data->n_sunk_messages++;
+
+        return true;
+}
+
+static void
+event_cb(const struct pcx_avt_state_event *event,
+         void *user_data)
+{
+        struct data *data = user_data;
+
+        switch (event->type) {
+        case PCX_AVT_STATE_EVENT_CURRENT_ROOM:
+                data->event_room = event->current_room;
+                break;
+        case PCX_AVT_STATE_EVENT_GAME_OVER:
+                data->event_game_over = event->game_over;
+                break;
+        default:
+                break;
+        }
+}
+
+static void
+set_callbacks(struct data *data)
+{
+        if (data->use_seed) {
+                pcx_avt_state_set_random_cb(data->state,
+                                            NULL, /* cb */
+                                            NULL /* user_data */);
+        } else {
+                pcx_avt_state_set_random_cb(data->state,
+                                            random_cb,
+                                            data);
+        }
+
+        pcx_avt_state_set_event_cb(data->state, event_cb, data);
+        data->event_room = -1;
+        data->event_game_over = pcx_avt_state_game_is_over(data->state);
+
+        if (data->use_sink) {
+                pcx_avt_state_set_message_cb(data->state,
+                                             message_cb,
+                                             data);
+        }
+}
+
+static const struct pcx_avt_state_message *
+get_next_message(struct data *data)
+{
+        const struct pcx_avt_state_message *message;
+
+        if (data->sink_pos < data->sink_buffer.length) {
+                message = (const struct pcx_avt_state_message *)
+                        (data->sink_buffer.data + data->sink_pos);
+
+                data->sink_pos += get_message_size(message);
+
+                return message;
+        }
+
+        /* Messages sent before the callback was set or that the
+         * callback refused are still queued.
+         */
+        message = pcx_avt_state_get_next_message(data->state);
+
+        if (message)
+                check_message_length(data, message);
+
+        return message;
+}
+
 static void
-create_avt_state(struct data *data)
+create_avt_state(struct data *data,
+                 const struct pcx_avt_state_random_state *rs)
 {
-        data->state = pcx_avt_state_new(data->avt);
+        /* The first state is created directly and the restarts use
+         * the template so that both ways get tested.
+         */
+        if (data->template) {
+                data->state = pcx_avt_state_new_from_template(data->template,
+                                                              rs);
+        } else {
+                data->state = pcx_avt_state_new(data->avt);
+        }
 
-        pcx_avt_state_set_random_cb(data->state,
-                                    random_cb,
-                                    data);
+        set_callbacks(data);
 }
 
 static bool
@@ -93,8 +248,7 @@ read_line(struct data *data)
 static bool
 ensure_empty_message_queue(struct data *data)
 {
-        const struct pcx_avt_state_message *msg =
-                pcx_avt_state_get_next_message(data->state);
+        const struct pcx_avt_state_message *msg = get_next_message(data);
 
         if (msg == NULL)
                 return true;
@@ -128,16 +282,174 @@ check_room_name(struct data *data,
         return true;
 }
 
+static bool
+check_events(struct data *data)
+{
+        if (data->event_game_over != pcx_avt_state_game_is_over(data->state)) {
+                fprintf(stderr,
+                        "Game over event doesn’t match the state at "
+                        "line %i\n",
+                        data->line_num);
+                return false;
+        }
+
+        if (data->event_room == -1)
+                return true;
+
+        /* The name is only the room’s own name when the player can
+         * see it.
+         */
+        const char *room_name =
+                pcx_avt_state_get_current_room_name(data->state);
+
+        if (strcmp(room_name, "fino") &&
+            strcmp(room_name, "mallume") &&
+            strcmp(room_name, data->avt->rooms[data->event_room].name)) {
+                fprintf(stderr,
+                        "Room event doesn’t match the state at line %i:\n"
+                        " Event: %s\n"
+                        " State: %s\n",
+                        data->line_num,
+                        data->avt->rooms[data->event_room].name,
+                        room_name);
+                return false;
+        }
+
+        return true;
+}
+
+static bool
+save_and_load(struct data *data)
+{
+        struct pcx_buffer saved = PCX_BUFFER_STATIC_INIT;
+        struct pcx_buffer resaved = PCX_BUFFER_STATIC_INIT;
+        struct pcx_error *error = NULL;
+        bool ret = true;
+
+        pcx_avt_state_save(data->state, &saved);
+
+        struct pcx_avt_state *state = pcx_avt_state_load(data->avt,
+                                                         saved.data,
+                                                         saved.length,
+                                                         &error);
+
+        if (state == NULL) {
+                fprintf(stderr,
+                        "Error loading saved game at line %i: %s\n",
+                        data->line_num,
+                        error->message);
+                pcx_error_free(error);
+                ret = false;
+                goto out;
+        }
+
+        pcx_avt_state_free(data->state);
+        data->state = state;
+        set_callbacks(data);
+
+        /* Saving again should give exactly the same data */
+        pcx_avt_state_save(data->state, &resaved);
+
+        if (resaved.length != saved.length ||
+            memcmp(resaved.data, saved.data, saved.length)) {
+                fprintf(stderr,
+                        "Saved game changed after loading at line %i\n",
+                        data->line_num);
+                ret = false;
+        }
+
+out:
+        pcx_buffer_destroy(&resaved);
+        pcx_buffer_destroy(&saved);
+
+        return ret;
+}
+
+static bool
+restart(struct data *data,
+        const struct pcx_avt_state_random_state *rs)
+{
+        if (!ensure_empty_message_queue(data))
+                return false;
+
+        pcx_avt_state_free(data->state);
+
+        if (data->template == NULL)
+                data->template = pcx_avt_state_template_new(data->avt);
+
+        create_avt_state(data, rs);
+
+        return true;
+}
+
 static bool
 handle_test_command(struct data *data,
                     const char *command)
 {
         if (!strcmp(command, "restart")) {
+                return restart(data, NULL /* rs */);
+        } else if (!strncmp(command, "restart_seed ", 13)) {
+                /* Start a new game that uses the state’s own random
+                 * number generator from the first turn.
+                 */
+                struct pcx_avt_state_random_state rs;
+
+                pcx_avt_state_seed_random_state(&rs,
+                                                strtoull(command + 13,
+                                                         NULL,
+                                                         10));
+                data->use_seed = true;
+
+                return restart(data, &rs);
+        } else if (!strcmp(command, "clone")) {
+                /* Carry on with a copy of the state to check that
+                 * nothing is lost and keep the original to check
+                 * that the two are independent.
+                 */
+                if (data->other_state)
+                        pcx_avt_state_free(data->other_state);
+
+                data->other_state = data->state;
+                data->state = pcx_avt_state_clone(data->state);
+                set_callbacks(data);
+
+                return true;
+        } else if (!strcmp(command, "switch")) {
+                if (data->other_state == NULL) {
+                        fprintf(stderr,
+                                "“switch” used without “clone” at line %i\n",
+                                data->line_num);
+                        return false;
+                }
+
                 if (!ensure_empty_message_queue(data))
                         return false;
 
-                pcx_avt_state_free(data->state);
-                create_avt_state(data);
+                struct pcx_avt_state *state = data->state;
+                data->state = data->other_state;
+                data->other_state = state;
+                set_callbacks(data);
+
+                return true;
+        } else if (!strcmp(command, "save")) {
+                if (!ensure_empty_message_queue(data))
+                        return false;
+
+                return save_and_load(data);
+        } else if (!strcmp(command, "sink")) {
+                /* Carry on receiving the messages with a callback */
+                data->use_sink = true;
+                set_callbacks(data);
+
+                return true;
+        } else if (!strncmp(command, "sink_limit ", 11)) {
+                data->sink_limit = strtol(command + 11, NULL, 10);
+                data->use_sink = true;
+                set_callbacks(data);
+
+                return true;
+        } else if (!strcmp(command, "keep")) {
+                data->keep_messages = true;
 
                 return true;
         } else if (!strcmp(command, "game_over")) {
@@ -159,8 +471,42 @@ handle_test_command(struct data *data,
                 }
 
                 return true;
+        } else if (!strcmp(command, "out_of_steps")) {
+                if (data->command_status !=
+                    PCX_AVT_STATE_COMMAND_STATUS_OUT_OF_STEPS) {
+                        fprintf(stderr,
+                                "Command expected to run out of steps at "
+                                "line %i.\n",
+                                data->line_num);
+                        return false;
+                }
+
+                return true;
+        } else if (!strcmp(command, "not_out_of_steps")) {
+                if (data->command_status !=
+                    PCX_AVT_STATE_COMMAND_STATUS_OK) {
+                        fprintf(stderr,
+                                "Command unexpectedly ran out of steps at "
+                                "line %i.\n",
+                                data->line_num);
+                        return false;
+                }
+
+                return true;
+        } else if (!strncmp(command, "step_limit ", 11)) {
+                pcx_avt_state_set_step_limit(data->state,
+                                             strtoul(command + 11, NULL, 10));
+                return true;
         } else if (!strncmp(command, "random ", 7)) {
                 data->random_number = strtol(command + 7, NULL, 10);
+                data->use_seed = false;
+                set_callbacks(data);
+                return true;
+        } else if (!strncmp(command, "seed ", 5)) {
+                data->use_seed = true;
+                set_callbacks(data);
+                pcx_avt_state_set_seed(data->state,
+                                       strtoull(command + 5, NULL, 10));
                 return true;
         } else if (!strncmp(command, "room ", 5)) {
                 return check_room_name(data, command + 5);
@@ -210,10 +556,24 @@ run_test(struct data *data)
                         while (*typed_text == ' ')
                                 typed_text++;
 
-                        if (!ensure_empty_message_queue(data))
-                                return false;
+                        if (data->keep_messages) {
+                                data->keep_messages = false;
+                        } else {
+                                if (!ensure_empty_message_queue(data))
+                                        return false;
+
+                                pcx_buffer_set_length(&data->sink_buffer, 0);
+                                data->sink_pos = 0;
+                        }
 
-                        pcx_avt_state_run_command(data->state, typed_text);
+                        data->n_sunk_messages = 0;
+
+                        data->command_status =
+                                pcx_avt_state_run_command(data->state,
+                                                          typed_text);
+
+                        if (!check_events(data))
+                                return false;
                 } else if (*first_character == '@') {
                         char *at_command = first_character + 1;
 
@@ -231,7 +591,7 @@ run_test(struct data *data)
                                 return false;
                 } else {
                         const struct pcx_avt_state_message *msg =
-                                pcx_avt_state_get_next_message(data->state);
+                                get_next_message(data);
 
                         if (msg == NULL) {
                                 fprintf(stderr,
@@ -252,8 +612,7 @@ run_test(struct data *data)
                 }
         }
 
-        const struct pcx_avt_state_message *msg =
-                pcx_avt_state_get_next_message(data->state);
+        const struct pcx_avt_state_message *msg = get_next_message(data);
 
         if (msg) {
                 fprintf(stderr,
@@ -275,6 +634,8 @@ main(int argc, char **argv)
 
         struct data data = {
                 .command_buffer = PCX_BUFFER_STATIC_INIT,
+                .sink_buffer = PCX_BUFFER_STATIC_INIT,
+                .sink_limit = -1,
         };
         const char *avt_filename = argv[1];
         const char *test_script = argc > 2 ? argv[2] : NULL;
@@ -301,21 +662,27 @@ main(int argc, char **argv)
                                         strerror(errno));
                                 retval = EXIT_FAILURE;
                         } else {
-                                create_avt_state(&data);
+                                create_avt_state(&data, NULL /* rs */);
 
                                 if (!run_test(&data))
                                         retval = EXIT_FAILURE;
 
                                 pcx_avt_state_free(data.state);
+                                if (data.other_state)
+                                        pcx_avt_state_free(data.other_state);
 
                                 fclose(data.input);
                         }
                 }
 
+                if (data.template)
+                        pcx_avt_state_template_free(data.template);
+
                 pcx_avt_free(data.avt);
         }
 
         pcx_buffer_destroy(&data.command_buffer);
+        pcx_buffer_destroy(&data.sink_buffer);
 
         return retval;
 }
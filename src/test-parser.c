@@ -1096,6 +1096,18 @@ main(int argc, char **argv)
                (PCX_AVT_OBJECT_ATTRIBUTE_CLOSED |
                 PCX_AVT_OBJECT_ATTRIBUTE_PORTABLE));
 
+        /* Both balls share the same word for their name */
+        assert(avt->objects[3].base.name_word != PCX_AVT_NO_WORD);
+        assert(avt->objects[3].base.name_word ==
+               avt->objects[4].base.name_word);
+        assert(avt->objects[3].base.adjective_word !=
+               avt->objects[4].base.adjective_word);
+        assert(pcx_avt_find_word(avt, "pilk", 4) ==
+               avt->objects[3].base.name_word);
+        assert(!strcmp(avt->words[avt->objects[4].base.adjective_word - 1],
+                       "verd"));
+        assert(pcx_avt_find_word(avt, "pilko", 5) == PCX_AVT_NO_WORD);
+
         pcx_avt_free(avt);
 
         avt = expect_success(BLURB
@@ -1226,6 +1238,11 @@ main(int argc, char **argv)
         assert(avt->verbs[0].n_rules == 1);
         assert(avt->verbs[0].rules[0] == 0);
         assert(!strcmp(rule->text, "Ne dormu!"));
+        /* Text without any substitutions is a single segment */
+        assert(rule->text_code[0].op == PCX_AVT_TEXT_OP_LITERAL);
+        assert(rule->text_code[0].text == rule->text);
+        assert(rule->text_code[0].length == strlen(rule->text));
+        assert(rule->text_code[1].op == PCX_AVT_TEXT_OP_END);
         assert(rule->points == 0);
         /* Implicitly added condition because the rule is in a room */
         assert(rule->n_conditions == 6);
@@ -1243,6 +1260,16 @@ main(int argc, char **argv)
         assert(rule->conditions[4].condition == PCX_AVT_CONDITION_NOTHING);
         assert(rule->conditions[5].subject == PCX_AVT_RULE_SUBJECT_IN);
         assert(rule->conditions[5].condition == PCX_AVT_CONDITION_NOTHING);
+        /* Check the compiled version of the conditions */
+        assert(rule->condition_code[0].op == PCX_AVT_OP_IN_ROOM);
+        assert(rule->condition_code[0].arg == 1);
+        for (int i = 1; i <= 5; i++) {
+                assert(rule->condition_code[i].op == PCX_AVT_OP_NOTHING);
+                assert(rule->condition_code[i].subject ==
+                       rule->conditions[i].subject);
+        }
+        assert(rule->condition_code[6].op == PCX_AVT_OP_END);
+        assert(rule->action_code[0].op == PCX_AVT_OP_END);
 
         rule++;
 
@@ -1250,6 +1277,20 @@ main(int argc, char **argv)
         assert(avt->verbs[1].n_rules == 2);
         assert(avt->verbs[1].rules[0] == 1);
         assert(avt->verbs[1].rules[1] == 2);
+        /* The first rule is restricted to the red potato and the
+         * second one has a condition for the brown potato.
+         */
+        assert(avt->verbs[1].shared_bucket.n_rules == 0);
+        assert(avt->verbs[1].n_room_buckets == 0);
+        assert(avt->verbs[1].n_movable_buckets == 2);
+        assert(avt->verbs[1].movable_buckets[0].key == 0);
+        assert(avt->verbs[1].movable_buckets[0].n_rules == 1);
+        assert(avt->verbs[1].movable_buckets[1].key == 3);
+        assert(avt->verbs[1].movable_buckets[1].n_rules == 1);
+        assert(avt->verbs[1].bucket_rules[avt->verbs[1].
+                                          movable_buckets[0].start] == 1);
+        assert(avt->verbs[1].bucket_rules[avt->verbs[1].
+                                          movable_buckets[1].start] == 0);
         assert(rule->text == avt->rules[0].text);
         assert(rule->points == 0);
         /* Implicitly added condition because the rule is in an object */